@@ -45,6 +45,23 @@ class gateway_t {
         metadata_t
         resolve(const std::string& name) const = 0;
 
+        // Resolves the service for the given routing key. Gateways which can't route the requests
+        // by key, treat them as any other request.
+        virtual
+        metadata_t
+        resolve(const std::string& name, const std::string& /* key */) const {
+            return resolve(name);
+        }
+
+        // Whether the keyed requests are routed by this gateway across the whole cluster, including
+        // the local node. Otherwise, the locator serves them from the local services when possible,
+        // same as any other request.
+        virtual
+        bool
+        keyed() const {
+            return false;
+        }
+
         virtual
         void
         consume(const std::string& uuid, const std::string& name, const metadata_t& meta) = 0;
@@ -53,6 +70,13 @@ class gateway_t {
         void
         cleanup(const std::string& uuid, const std::string& name) = 0;
 
+        // Periodic load reports from the remote nodes, for the load-aware gateways.
+        virtual
+        void
+        report(const std::string& /* uuid */, const std::string& /* name */, uint64_t /* load */) {
+            // Empty.
+        }
+
     protected:
         gateway_t(context_t&, const std::string& /* name */, const Json::Value& /* args */) {
             // Empty.
@@ -27,6 +27,7 @@
 
 #include "json/json.h"
 
+#include <map>
 #include <mutex>
 #include <sstream>
 
@@ -41,8 +42,109 @@ struct storage_error_t:
     { }
 };
 
+// NOTE: Thrown by the backends when the requested object doesn't exist, so that it could be told apart
+// from the actual failures.
+
+struct storage_not_found_t:
+    public storage_error_t
+{
+    template<typename... Args>
+    storage_not_found_t(const std::string& format, const Args&... args):
+        storage_error_t(format, args...)
+    { }
+};
+
 namespace api {
 
+// NOTE: Read-only view of a stored object. It either owns its data or references some memory kept
+// alive by the view itself, like a file mapping, so large objects could be consumed without copying.
+
+class blob_t {
+    public:
+        blob_t():
+            m_data(nullptr),
+            m_size(0)
+        { }
+
+        explicit
+        blob_t(std::string&& value) {
+            auto owner = std::make_shared<std::string>(std::move(value));
+
+            m_data = owner->data();
+            m_size = owner->size();
+            m_owner = owner;
+        }
+
+        blob_t(const char* data, size_t size, const std::shared_ptr<const void>& owner):
+            m_data(data),
+            m_size(size),
+            m_owner(owner)
+        { }
+
+        const char*
+        data() const {
+            return m_data;
+        }
+
+        size_t
+        size() const {
+            return m_size;
+        }
+
+        // Returns a view of a part of this blob, which shares its ownership.
+        blob_t
+        slice(const char* data, size_t size) const {
+            BOOST_ASSERT(data >= m_data && data + size <= m_data + m_size);
+
+            return blob_t(data, size, m_owner);
+        }
+
+        std::string
+        str() const {
+            return std::string(m_data, m_size);
+        }
+
+    private:
+        const char* m_data;
+        size_t m_size;
+
+        std::shared_ptr<const void> m_owner;
+};
+
+// NOTE: Writes a single object piece by piece, so that it never has to be held in memory as a whole.
+// The object appears in the storage only when it's committed, and is discarded otherwise.
+
+class object_writer_t {
+    public:
+        virtual
+       ~object_writer_t() {
+            // Empty.
+        }
+
+        virtual
+        void
+        append(const char* data, size_t size) = 0;
+
+        virtual
+        void
+        commit() = 0;
+};
+
+// NOTE: Reads a single object piece by piece, so that it never has to be held in memory as a whole.
+
+class object_reader_t {
+    public:
+        virtual
+       ~object_reader_t() {
+            // Empty.
+        }
+
+        // Returns the next piece of the object, or an empty blob once the object is over.
+        virtual
+        blob_t
+        next() = 0;
+};
+
 class storage_t {
     public:
         typedef storage_t category_type;
@@ -69,32 +171,244 @@ class storage_t {
         std::vector<std::string>
         find(const std::string& collection, const std::vector<std::string>& tags) = 0;
 
+        // Batched versions of the above. The default implementations simply loop over the keys, but
+        // the storages might do better by sharing the lookups or issuing the I/O in parallel.
+
+        // Objects which don't exist are omitted from the result, any other error fails the whole batch.
+        // The default implementation expects the missing objects to be reported as storage_not_found_t.
+        virtual
+        std::map<std::string, std::string>
+        read_many(const std::string& collection, const std::vector<std::string>& keys);
+
+        // All the objects are assigned the same tags.
+        virtual
+        void
+        write_many(const std::string& collection, const std::map<std::string, std::string>& objects, const std::vector<std::string>& tags);
+
+        virtual
+        void
+        remove_many(const std::string& collection, const std::vector<std::string>& keys);
+
+        // Same as read(), but the storages might implement it without copying the object. The default
+        // implementation simply wraps the read() result.
+        virtual
+        blob_t
+        view(const std::string& collection, const std::string& key);
+
+        // Streaming version of write(). The default implementation buffers the whole object and then
+        // writes it in one go, so the storages should override it if they can do better.
+        virtual
+        std::unique_ptr<object_writer_t>
+        writer(const std::string& collection, const std::string& key, const std::vector<std::string>& tags);
+
+        // Streaming version of view(). The default implementation returns the whole view() result as
+        // a single piece, which is fine for the storages which map the objects into memory.
+        virtual
+        std::unique_ptr<object_reader_t>
+        reader(const std::string& collection, const std::string& key);
+
         // Helper methods
 
+        // Zero-copy version of get<std::string>().
+        blob_t
+        get_blob(const std::string& collection, const std::string& key);
+
         template<class T>
         T
         get(const std::string& collection, const std::string& key);
 
+        // Batched version of get<T>(), objects which don't exist are omitted.
+        template<class T>
+        std::map<std::string, T>
+        get_many(const std::string& collection, const std::vector<std::string>& keys);
+
         template<class T>
         void
         put(const std::string& collection, const std::string& key, const T& object, const std::vector<std::string>& tags);
 
+    private:
+        template<class T>
+        static
+        void
+        decode(const char* data, size_t size, T& result);
+
     protected:
         storage_t(context_t&, const std::string& /* name */, const Json::Value& /* args */) {
             // Empty.
         }
 };
 
+inline
+std::map<std::string, std::string>
+storage_t::read_many(const std::string& collection, const std::vector<std::string>& keys) {
+    std::map<std::string, std::string> result;
+
+    for(auto it = keys.begin(); it != keys.end(); ++it) {
+        try {
+            result[*it] = read(collection, *it);
+        } catch(const storage_not_found_t& e) {
+            // Other errors are propagated, as a broken object is not the same as a missing one.
+            continue;
+        }
+    }
+
+    return result;
+}
+
+inline
+void
+storage_t::write_many(const std::string& collection, const std::map<std::string, std::string>& objects, const std::vector<std::string>& tags) {
+    for(auto it = objects.begin(); it != objects.end(); ++it) {
+        write(collection, it->first, it->second, tags);
+    }
+}
+
+inline
+void
+storage_t::remove_many(const std::string& collection, const std::vector<std::string>& keys) {
+    for(auto it = keys.begin(); it != keys.end(); ++it) {
+        remove(collection, *it);
+    }
+}
+
+inline
+blob_t
+storage_t::view(const std::string& collection, const std::string& key) {
+    return blob_t(read(collection, key));
+}
+
+namespace detail {
+
+// NOTE: Fallback for the backends which can only write the objects as a whole. Such backends should
+// provide their own writers if they're expected to store large objects.
+
+struct buffered_writer_t:
+    public object_writer_t
+{
+    buffered_writer_t(storage_t& storage_, const std::string& collection_, const std::string& key_,
+                      const std::vector<std::string>& tags_):
+        storage(storage_),
+        collection(collection_),
+        key(key_),
+        tags(tags_)
+    { }
+
+    virtual
+    void
+    append(const char* data, size_t size) {
+        buffer.append(data, size);
+    }
+
+    virtual
+    void
+    commit() {
+        storage.write(collection, key, buffer, tags);
+    }
+
+private:
+    storage_t& storage;
+
+    const std::string collection;
+    const std::string key;
+    const std::vector<std::string> tags;
+
+    std::string buffer;
+};
+
+struct blob_reader_t:
+    public object_reader_t
+{
+    explicit
+    blob_reader_t(const blob_t& blob_):
+        blob(blob_)
+    { }
+
+    virtual
+    blob_t
+    next() {
+        blob_t result;
+
+        std::swap(result, blob);
+
+        return result;
+    }
+
+private:
+    blob_t blob;
+};
+
+} // namespace detail
+
+inline
+std::unique_ptr<object_writer_t>
+storage_t::writer(const std::string& collection, const std::string& key, const std::vector<std::string>& tags) {
+    return std::unique_ptr<object_writer_t>(new detail::buffered_writer_t(*this, collection, key, tags));
+}
+
+inline
+std::unique_ptr<object_reader_t>
+storage_t::reader(const std::string& collection, const std::string& key) {
+    return std::unique_ptr<object_reader_t>(new detail::blob_reader_t(view(collection, key)));
+}
+
+inline
+blob_t
+storage_t::get_blob(const std::string& collection, const std::string& key) {
+    const blob_t blob(view(collection, key));
+
+    msgpack::zone zone;
+    msgpack::object object;
+
+    size_t offset = 0;
+
+    // NOTE: Unlike the buffered unpacker, this one leaves the strings in place, so the resulting
+    // object references the blob memory.
+    const msgpack::unpack_return rv = msgpack::unpack(blob.data(), blob.size(), &offset, &zone, &object);
+
+    if(rv != msgpack::UNPACK_SUCCESS && rv != msgpack::UNPACK_EXTRA_BYTES) {
+        throw storage_error_t("corrupted object");
+    }
+
+    if(object.type != msgpack::type::RAW) {
+        throw storage_error_t("object type mismatch");
+    }
+
+    return blob.slice(object.via.raw.ptr, object.via.raw.size);
+}
+
 template<class T>
 T
 storage_t::get(const std::string& collection, const std::string& key) {
     T result;
-    msgpack::unpacked unpacked;
 
-    std::string blob(read(collection, key));
+    const blob_t blob(view(collection, key));
+
+    decode(blob.data(), blob.size(), result);
+
+    return result;
+}
+
+template<class T>
+std::map<std::string, T>
+storage_t::get_many(const std::string& collection, const std::vector<std::string>& keys) {
+    std::map<std::string, T> result;
+
+    const std::map<std::string, std::string> objects(read_many(collection, keys));
+
+    for(auto it = objects.begin(); it != objects.end(); ++it) {
+        decode(it->second.data(), it->second.size(), result[it->first]);
+    }
+
+    return result;
+}
+
+template<class T>
+void
+storage_t::decode(const char* data, size_t size, T& result) {
+    msgpack::unpacked unpacked;
 
     try {
-        msgpack::unpack(&unpacked, blob.data(), blob.size());
+        msgpack::unpack(&unpacked, data, size);
     } catch(const msgpack::unpack_error& e) {
         throw storage_error_t("corrupted object");
     }
@@ -104,8 +418,6 @@ storage_t::get(const std::string& collection, const std::string& key) {
     } catch(const msgpack::type_error& e) {
         throw storage_error_t("object type mismatch");
     }
-
-    return result;
 }
 
 template<class T>
@@ -138,29 +450,27 @@ struct category_traits<storage_t> {
 
             typename instance_map_t::iterator it(m_instances.find(name));
 
-            ptr_type instance;
-
             if(it != m_instances.end()) {
-                instance = it->second.lock();
+                return it->second;
             }
 
-            if(!instance) {
-                instance = std::make_shared<T>(
-                    std::ref(context),
-                    name,
-                    args
-                );
+            ptr_type instance = std::make_shared<T>(
+                std::ref(context),
+                name,
+                args
+            );
 
-                m_instances[name] = instance;
-            }
+            m_instances[name] = instance;
 
             return instance;
         }
 
     private:
+        // NOTE: Storages are kept alive for the lifetime of the repository, as they might hold some
+        // costly state, like caches or indices, which must not be rebuilt on every access.
         typedef std::map<
             std::string,
-            std::weak_ptr<storage_t>
+            ptr_type
         > instance_map_t;
 
         instance_map_t m_instances;
@@ -23,6 +23,8 @@
 
 #include "cocaine/common.hpp"
 
+#include <functional>
+
 namespace cocaine { namespace api {
 
 struct stream_t {
@@ -42,6 +44,37 @@ struct stream_t {
     virtual
     void
     close() = 0;
+
+    typedef std::function<
+        void(bool)
+    > pressure_handler_t;
+
+    // NOTE: Flow control. The handler is invoked with true when the consumer on the other end of
+    // this stream falls behind, and with false when it catches up again. Might be invoked from any
+    // thread. Streams without flow control never invoke it.
+    virtual
+    void
+    watch(const pressure_handler_t& /* handler */) { }
+
+    // NOTE: Flow control in the other direction. Asks the peer to stop sending until resumed, when
+    // the incoming data can't be consumed as fast as it arrives. Might be called from any thread.
+    // Streams without flow control ignore it.
+    virtual
+    void
+    pause() { }
+
+    virtual
+    void
+    resume() { }
+
+    // Tells whether nothing written to this stream can ever reach the consumer anymore, because the
+    // stream has been closed or the consumer is gone, so that long-lived producers could drop it.
+    // Streams which can't tell never report that.
+    virtual
+    bool
+    closed() const {
+        return false;
+    }
 };
 
 typedef std::shared_ptr<stream_t> stream_ptr_t;
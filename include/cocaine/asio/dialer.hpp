@@ -0,0 +1,243 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_IO_DIALER_HPP
+#define COCAINE_IO_DIALER_HPP
+
+#include "cocaine/asio/reactor.hpp"
+#include "cocaine/asio/socket.hpp"
+#include "cocaine/asio/timeout.hpp"
+
+#include <map>
+
+namespace cocaine { namespace io {
+
+// NOTE: Establishes an outgoing connection without blocking the reactor. Given a list of endpoints,
+// the dialer starts a non-blocking connection attempt to the first one, and then starts the next one
+// either when the previous attempt fails or after a short delay, without cancelling the ones still in
+// progress. The first attempt to succeed wins and the rest are dropped. The endpoints are reordered
+// so that the address families alternate, as in RFC 6555 "Happy Eyeballs".
+
+template<class Medium>
+struct dialer {
+    COCAINE_DECLARE_NONCOPYABLE(dialer)
+
+    typedef Medium medium_type;
+    typedef typename medium_type::endpoint endpoint_type;
+    typedef socket<medium_type> socket_type;
+
+    typedef std::function<
+        void(const std::shared_ptr<socket_type>&, const std::error_code&)
+    > handler_type;
+
+    dialer(reactor_t& reactor, const std::vector<endpoint_type>& endpoints):
+        m_reactor(reactor),
+        m_endpoints(interleave(endpoints)),
+        m_next(0),
+        m_delay(0.0f),
+        m_stagger(reactor),
+        m_timeout(reactor)
+    {
+        m_stagger.bind(std::bind(&dialer::next, this));
+        m_timeout.bind(std::bind(&dialer::on_timeout, this));
+    }
+
+   ~dialer() {
+        cancel();
+    }
+
+    // The handler is called exactly once, either with the connected socket or with the error of the
+    // last failed attempt, possibly right from bind(). The dialer must not be destroyed from within
+    // the handler, defer it via reactor_t::post() instead.
+    template<class ConnectHandler>
+    void
+    bind(ConnectHandler handler, float timeout, float delay = 0.25f) {
+        m_handler = handler;
+        m_delay = delay;
+
+        if(timeout > 0.0f) {
+            m_timeout.start(timeout);
+        }
+
+        next();
+    }
+
+    void
+    unbind() {
+        cancel();
+
+        m_handler = nullptr;
+    }
+
+private:
+    struct attempt_t {
+        std::shared_ptr<socket_type> socket;
+        std::shared_ptr<ev::io> watcher;
+    };
+
+    static
+    std::vector<endpoint_type>
+    interleave(const std::vector<endpoint_type>& endpoints) {
+        std::vector<endpoint_type> primary, secondary, result;
+
+        for(auto it = endpoints.begin(); it != endpoints.end(); ++it) {
+            if(it->protocol().family() == endpoints.front().protocol().family()) {
+                primary.push_back(*it);
+            } else {
+                secondary.push_back(*it);
+            }
+        }
+
+        for(size_t i = 0; i < std::max(primary.size(), secondary.size()); ++i) {
+            if(i < primary.size())   result.push_back(primary[i]);
+            if(i < secondary.size()) result.push_back(secondary[i]);
+        }
+
+        return result;
+    }
+
+    void
+    next() {
+        while(m_next < m_endpoints.size()) {
+            const endpoint_type& endpoint = m_endpoints[m_next++];
+
+            std::shared_ptr<socket_type> socket;
+            std::error_code ec;
+
+            try {
+                socket = std::make_shared<socket_type>(endpoint.protocol());
+            } catch(const std::system_error& e) {
+                m_error = e.code();
+                continue;
+            }
+
+            if(socket->connect(endpoint, ec)) {
+                // Connected right away, which is usually the case for the local endpoints.
+                finish(socket, ec);
+                return;
+            }
+
+            if(ec) {
+                m_error = ec;
+                continue;
+            }
+
+            auto watcher = std::make_shared<ev::io>(m_reactor.native());
+
+            watcher->set<dialer, &dialer::on_event>(this);
+            watcher->start(socket->fd(), ev::WRITE);
+
+            m_attempts[socket->fd()] = attempt_t { socket, watcher };
+
+            // Give this attempt a head start before trying the next endpoint.
+            m_stagger.stop();
+            m_stagger.start(m_delay);
+
+            return;
+        }
+
+        if(m_attempts.empty()) {
+            finish(std::shared_ptr<socket_type>(), m_error ? m_error : std::error_code(
+                EHOSTUNREACH,
+                std::system_category()
+            ));
+        }
+    }
+
+    void
+    on_event(ev::io& io, int /* revents */) {
+        auto it = m_attempts.find(io.fd);
+
+        if(it == m_attempts.end()) {
+            return;
+        }
+
+        // NOTE: Keep the watcher alive until this event handler returns.
+        const attempt_t attempt = it->second;
+
+        m_attempts.erase(it);
+
+        const std::error_code ec = attempt.socket->error();
+
+        if(!ec) {
+            finish(attempt.socket, ec);
+            return;
+        }
+
+        m_error = ec;
+
+        // Don't wait for the delay, start the next attempt right away.
+        next();
+    }
+
+    void
+    on_timeout() {
+        finish(std::shared_ptr<socket_type>(), std::error_code(ETIMEDOUT, std::system_category()));
+    }
+
+    void
+    finish(const std::shared_ptr<socket_type>& socket, const std::error_code& ec) {
+        cancel();
+
+        // Make sure that the handler is called only once.
+        handler_type handler;
+
+        std::swap(handler, m_handler);
+
+        if(handler) {
+            handler(socket, ec);
+        }
+    }
+
+    void
+    cancel() {
+        m_stagger.stop();
+        m_timeout.stop();
+
+        m_attempts.clear();
+        m_next = m_endpoints.size();
+    }
+
+private:
+    reactor_t& m_reactor;
+
+    const std::vector<endpoint_type> m_endpoints;
+
+    // Next endpoint to try.
+    size_t m_next;
+
+    // Delay between the attempts.
+    float m_delay;
+
+    io::timeout_t m_stagger;
+    io::timeout_t m_timeout;
+
+    // Attempts in progress, indexed by their file descriptors.
+    std::map<int, attempt_t> m_attempts;
+
+    // Last failure.
+    std::error_code m_error;
+
+    handler_type m_handler;
+};
+
+}} // namespace cocaine::io
+
+#endif
@@ -40,7 +40,8 @@ struct readable_stream {
         m_idle_watcher(reactor.native()),
         m_reactor(reactor),
         m_rd_offset(0),
-        m_rx_offset(0)
+        m_rx_offset(0),
+        m_paused(false)
     {
         m_socket_watcher.set<readable_stream, &readable_stream::on_event>(this);
         m_idle_watcher.set<readable_stream, &readable_stream::on_idle>(this);
@@ -53,7 +54,8 @@ struct readable_stream {
         m_idle_watcher(reactor.native()),
         m_reactor(reactor),
         m_rd_offset(0),
-        m_rx_offset(0)
+        m_rx_offset(0),
+        m_paused(false)
     {
         m_socket_watcher.set<readable_stream, &readable_stream::on_event>(this);
         m_idle_watcher.set<readable_stream, &readable_stream::on_idle>(this);
@@ -65,7 +67,7 @@ struct readable_stream {
     bind(ReadHandler read_handler,
          ErrorHandler error_handler)
     {
-        if(!m_socket_watcher.is_active()) {
+        if(!m_paused && !m_socket_watcher.is_active()) {
             m_socket_watcher.start(m_socket->fd(), ev::READ);
         }
 
@@ -87,6 +89,46 @@ struct readable_stream {
         m_handle_error = nullptr;
     }
 
+    // NOTE: Flow control. While paused, the stream doesn't read from the socket nor parse the data
+    // already received, so that the peer gets blocked by the kernel once its socket buffer fills up.
+
+    void
+    pause() {
+        if(m_paused) {
+            return;
+        }
+
+        m_paused = true;
+
+        if(m_socket_watcher.is_active()) {
+            m_socket_watcher.stop();
+        }
+
+        if(m_idle_watcher.is_active()) {
+            m_idle_watcher.stop();
+        }
+    }
+
+    void
+    resume() {
+        if(!m_paused) {
+            return;
+        }
+
+        m_paused = false;
+
+        if(!m_handle_read) {
+            // The stream is not bound.
+            return;
+        }
+
+        m_socket_watcher.start(m_socket->fd(), ev::READ);
+
+        if(m_rd_offset != m_rx_offset) {
+            m_idle_watcher.start();
+        }
+    }
+
     size_t
     footprint() const {
         return m_ring.size();
@@ -146,7 +188,8 @@ private:
             return;
         }
 
-        if(m_rd_offset != m_rx_offset && !m_idle_watcher.is_active()) {
+        // NOTE: The handler might have paused the stream.
+        if(!m_paused && m_rd_offset != m_rx_offset && !m_idle_watcher.is_active()) {
             m_idle_watcher.start();
         }
     }
@@ -185,6 +228,8 @@ private:
     off_t m_rd_offset,
           m_rx_offset;
 
+    bool m_paused;
+
     // Socket data callback.
     std::function<
         size_t(const char*, size_t)
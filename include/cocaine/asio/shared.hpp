@@ -0,0 +1,455 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_IO_SHARED_HPP
+#define COCAINE_IO_SHARED_HPP
+
+#include "cocaine/common.hpp"
+
+#include "cocaine/asio/writable_stream.hpp"
+
+#if defined(__clang__) || defined(HAVE_GCC46)
+    #include <atomic>
+#else
+    #include <cstdatomic>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace cocaine { namespace io {
+
+// NOTE: Shared memory transport for co-located peers. The segment is a memfd holding two single
+// producer single consumer byte rings, one for each direction, and every ring is accompanied with
+// two eventfds: one is signalled by the producer when the data arrives into an empty ring, and the
+// other one is signalled by the consumer when it frees some space for a blocked producer.
+//
+// The segment is created by the engine and passed to the slave over the control socket, see
+// send_descriptors(). The slave side attaches to it using the very same classes.
+
+namespace detail {
+
+struct ring_header_t {
+    // Consumer position, monotonic.
+    std::atomic<uint64_t> head;
+    char pad0[64 - sizeof(std::atomic<uint64_t>)];
+
+    // Producer position, monotonic.
+    std::atomic<uint64_t> tail;
+    char pad1[64 - sizeof(std::atomic<uint64_t>)];
+
+    // Set by the producer when it's waiting for the consumer to free some space.
+    std::atomic<uint32_t> waiting;
+    char pad2[64 - sizeof(std::atomic<uint32_t>)];
+};
+
+inline
+void
+signal(int fd) {
+    const uint64_t value = 1;
+
+    // NOTE: The only possible failure is the counter overflow, which still means a pending wakeup.
+    if(::write(fd, &value, sizeof(value)) == -1) {
+        return;
+    }
+}
+
+inline
+void
+drain(int fd) {
+    uint64_t value;
+
+    if(::read(fd, &value, sizeof(value)) == -1) {
+        return;
+    }
+}
+
+} // namespace detail
+
+struct shared_segment;
+
+struct shared_ring {
+    COCAINE_DECLARE_NONCOPYABLE(shared_ring)
+
+    typedef int endpoint_type;
+
+    shared_ring(const std::shared_ptr<shared_segment>& segment,
+                detail::ring_header_t* header,
+                char* data,
+                size_t capacity,
+                int wait_fd,
+                int peer_fd):
+        m_segment(segment),
+        m_header(header),
+        m_data(data),
+        m_mask(capacity - 1),
+        m_wait_fd(wait_fd),
+        m_peer_fd(peer_fd)
+    { }
+
+    // Operations
+
+    ssize_t
+    write(const char* buffer, size_t size, std::error_code& /* ec */) {
+        const uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+
+        uint64_t head = m_header->head.load(std::memory_order_acquire);
+
+        if(tail - head == m_mask + 1) {
+            // Reset the wakeup counter, announce that we're waiting for the consumer and check
+            // again, in case it has freed some space in the meantime.
+            detail::drain(m_wait_fd);
+
+            m_header->waiting.store(1);
+
+            head = m_header->head.load();
+
+            if(tail - head == m_mask + 1) {
+                errno = EAGAIN;
+                return -1;
+            }
+        }
+
+        const size_t length = std::min<uint64_t>(size, m_mask + 1 - (tail - head));
+        const size_t offset = tail & m_mask;
+        const size_t chunk  = std::min<size_t>(length, m_mask + 1 - offset);
+
+        std::memcpy(m_data + offset, buffer, chunk);
+        std::memcpy(m_data, buffer + chunk, length - chunk);
+
+        m_header->tail.store(tail + length);
+
+        // The consumer might be sleeping if it has consumed everything before this write.
+        if(m_header->head.load() == tail) {
+            detail::signal(m_peer_fd);
+        }
+
+        if(length < size) {
+            // The ring is full now and the caller will wait for some space to write the rest, so ask
+            // the consumer for a wakeup, same as above. If it has freed some space before noticing
+            // the request, wake the caller right away instead.
+            detail::drain(m_wait_fd);
+
+            m_header->waiting.store(1);
+
+            if(m_header->head.load() != head) {
+                detail::signal(m_wait_fd);
+            }
+        }
+
+        return length;
+    }
+
+    ssize_t
+    read(char* buffer, size_t size, std::error_code& /* ec */) {
+        // Reset the wakeup counter first, so that no wakeups are lost.
+        detail::drain(m_wait_fd);
+
+        const uint64_t head = m_header->head.load(std::memory_order_relaxed);
+        const uint64_t tail = m_header->tail.load(std::memory_order_acquire);
+
+        if(tail == head) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        const size_t length = std::min<uint64_t>(size, tail - head);
+        const size_t offset = head & m_mask;
+        const size_t chunk  = std::min<size_t>(length, m_mask + 1 - offset);
+
+        std::memcpy(buffer, m_data + offset, chunk);
+        std::memcpy(buffer + chunk, m_data, length - chunk);
+
+        m_header->head.store(head + length);
+
+        if(m_header->waiting.exchange(0)) {
+            detail::signal(m_peer_fd);
+        }
+
+        // Keep the wakeup pending if there's still something left in the ring.
+        if(m_header->tail.load() != head + length) {
+            detail::signal(m_wait_fd);
+        }
+
+        return length;
+    }
+
+public:
+    int
+    fd() const {
+        return m_wait_fd;
+    }
+
+private:
+    // Keeps the mapping alive.
+    const std::shared_ptr<shared_segment> m_segment;
+
+    detail::ring_header_t* const m_header;
+    char* const m_data;
+
+    const uint64_t m_mask;
+
+    // Descriptor to wait on and the one to wake the peer with.
+    const int m_wait_fd;
+    const int m_peer_fd;
+};
+
+// NOTE: Writers of the shared rings wait for the consumer signal, not for the descriptor to become
+// writable, as the eventfd always is.
+
+template<>
+struct writable_event<shared_ring> {
+    enum { value = ev::READ };
+};
+
+struct shared_segment:
+    public std::enable_shared_from_this<shared_segment>
+{
+    COCAINE_DECLARE_NONCOPYABLE(shared_segment)
+
+    enum class side {
+        // Creates the segment, writes into the first ring and reads from the second one.
+        origin,
+
+        // Attaches to an existing segment, reads from the first ring and writes into the second.
+        peer
+    };
+
+    enum {
+        // Memory, and then the data and the space eventfds for the first and the second rings.
+        descriptor_count = 5
+    };
+
+    // Creates a new segment with two rings of the given capacity, which must be a power of two.
+    explicit
+    shared_segment(size_t capacity):
+        m_side(side::origin),
+        m_capacity(capacity)
+    {
+        BOOST_ASSERT(capacity && (capacity & (capacity - 1)) == 0);
+
+        std::fill(m_fds, m_fds + descriptor_count, -1);
+
+#if defined(SYS_memfd_create)
+        m_fds[0] = ::syscall(SYS_memfd_create, "cocaine", 1U /* MFD_CLOEXEC */);
+#else
+        errno = ENOSYS;
+#endif
+
+        if(m_fds[0] == -1) {
+            throw std::system_error(errno, std::system_category(), "unable to create a shared segment");
+        }
+
+        if(::ftruncate(m_fds[0], size()) != 0) {
+            auto ec = std::error_code(errno, std::system_category());
+            close();
+            throw std::system_error(ec, "unable to allocate a shared segment");
+        }
+
+        for(size_t i = 1; i < descriptor_count; ++i) {
+            m_fds[i] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+            if(m_fds[i] == -1) {
+                auto ec = std::error_code(errno, std::system_category());
+                close();
+                throw std::system_error(ec, "unable to create a shared segment event");
+            }
+        }
+
+        map();
+    }
+
+    // Attaches to the segment created by the other side, taking ownership of the descriptors.
+    shared_segment(const int (&fds)[descriptor_count], size_t capacity):
+        m_side(side::peer),
+        m_capacity(capacity)
+    {
+        std::copy(fds, fds + descriptor_count, m_fds);
+
+        for(size_t i = 1; i < descriptor_count; ++i) {
+            ::fcntl(m_fds[i], F_SETFL, O_NONBLOCK);
+        }
+
+        map();
+    }
+
+   ~shared_segment() {
+        ::munmap(m_base, size());
+        close();
+    }
+
+    // Rings
+
+    std::shared_ptr<shared_ring>
+    reader() {
+        return ring(m_side == side::origin ? 1 : 0, false);
+    }
+
+    std::shared_ptr<shared_ring>
+    writer() {
+        return ring(m_side == side::origin ? 0 : 1, true);
+    }
+
+public:
+    const int*
+    fds() const {
+        return m_fds;
+    }
+
+    size_t
+    capacity() const {
+        return m_capacity;
+    }
+
+private:
+    size_t
+    size() const {
+        return 2 * (sizeof(detail::ring_header_t) + m_capacity);
+    }
+
+    void
+    map() {
+        void* base = ::mmap(nullptr, size(), PROT_READ | PROT_WRITE, MAP_SHARED, m_fds[0], 0);
+
+        if(base == MAP_FAILED) {
+            auto ec = std::error_code(errno, std::system_category());
+            close();
+            throw std::system_error(ec, "unable to map a shared segment");
+        }
+
+        m_base = static_cast<char*>(base);
+    }
+
+    std::shared_ptr<shared_ring>
+    ring(size_t index, bool producer) {
+        char* header = m_base + index * (sizeof(detail::ring_header_t) + m_capacity);
+
+        const int data_fd  = m_fds[1 + index * 2];
+        const int space_fd = m_fds[2 + index * 2];
+
+        return std::make_shared<shared_ring>(
+            shared_from_this(),
+            reinterpret_cast<detail::ring_header_t*>(header),
+            header + sizeof(detail::ring_header_t),
+            m_capacity,
+            producer ? space_fd : data_fd,
+            producer ? data_fd  : space_fd
+        );
+    }
+
+    void
+    close() {
+        for(size_t i = 0; i < descriptor_count; ++i) {
+            if(m_fds[i] >= 0) ::close(m_fds[i]);
+        }
+    }
+
+private:
+    const side m_side;
+    const size_t m_capacity;
+
+    int m_fds[descriptor_count];
+
+    char* m_base;
+};
+
+// Sends a message along with the given descriptors over a local socket. The message must be sent in
+// full, so this should only be used while there's nothing else pending on the socket. If the message
+// can't be sent in full, the socket is shut down, as the peer would get a truncated frame otherwise.
+
+inline
+void
+send_descriptors(int socket, const char* data, size_t size, const int* fds, size_t count) {
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * count));
+
+    iovec iov = { const_cast<char*>(data), size };
+
+    msghdr message;
+
+    std::memset(&message, 0, sizeof(message));
+
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+
+    std::memcpy(CMSG_DATA(header), fds, sizeof(int) * count);
+
+    ssize_t sent = 0;
+
+    do {
+        sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while(sent == -1 && errno == EINTR);
+
+    if(sent == -1) {
+        // Nothing has been sent, so the socket is still usable.
+        throw std::system_error(errno, std::system_category(), "unable to send the descriptors");
+    }
+
+    // NOTE: The descriptors are delivered along with the first byte, so the rest of the message is
+    // sent as is. The message is tiny, so this practically never happens, but the socket might still
+    // be non-blocking, hence the wait.
+    for(size_t offset = sent; offset != size; offset += sent) {
+        pollfd target = { socket, POLLOUT, 0 };
+
+        const int rv = ::poll(&target, 1, 1000);
+
+        if(rv == 0) {
+            sent = -1;
+            errno = ETIMEDOUT;
+        } else if(rv == -1) {
+            sent = -1;
+        } else {
+            sent = ::send(socket, data + offset, size - offset, MSG_NOSIGNAL);
+        }
+
+        if(sent == -1) {
+            if(errno == EINTR || errno == EAGAIN) {
+                sent = 0;
+                continue;
+            }
+
+            const std::error_code ec(errno, std::system_category());
+
+            ::shutdown(socket, SHUT_RDWR);
+
+            throw std::system_error(ec, "unable to send the descriptors");
+        }
+    }
+}
+
+}} // namespace cocaine::io
+
+#endif
@@ -79,6 +79,21 @@ struct socket {
         ::fcntl(m_fd, F_SETFL, O_NONBLOCK);
     }
 
+    // Creates an unconnected socket for the given protocol, see connect() below.
+    explicit
+    socket(typename endpoint_type::protocol_type protocol) {
+        m_fd = ::socket(protocol.family(), protocol.type(), protocol.protocol());
+
+        if(m_fd == -1) {
+            throw std::system_error(errno, std::system_category(), "unable to create a socket");
+        }
+
+        medium_type::configure(m_fd);
+
+        ::fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+        ::fcntl(m_fd, F_SETFL, O_NONBLOCK);
+    }
+
     explicit
     socket(int fd):
         m_fd(fd)
@@ -126,6 +141,35 @@ struct socket {
         return length;
     }
 
+    // Starts a non-blocking connection. Returns true if the connection has been established right
+    // away, otherwise the socket becomes writable once the connection either succeeds or fails, and
+    // the outcome can be checked with error().
+
+    bool
+    connect(const endpoint_type& endpoint, std::error_code& ec) {
+        if(::connect(m_fd, endpoint.data(), endpoint.size()) == 0) {
+            return true;
+        }
+
+        if(errno != EINPROGRESS && errno != EINTR) {
+            ec = std::error_code(errno, std::system_category());
+        }
+
+        return false;
+    }
+
+    std::error_code
+    error() const {
+        int code = 0;
+        socklen_t size = sizeof(code);
+
+        if(::getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &code, &size) != 0) {
+            code = errno;
+        }
+
+        return std::error_code(code, std::system_category());
+    }
+
 public:
     int
     fd() const {
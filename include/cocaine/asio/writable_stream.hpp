@@ -27,6 +27,13 @@
 
 namespace cocaine { namespace io {
 
+// The event to wait for when the socket can't accept any more data.
+
+template<class Socket>
+struct writable_event {
+    enum { value = ev::WRITE };
+};
+
 template<class Socket>
 struct writable_stream {
     COCAINE_DECLARE_NONCOPYABLE(writable_stream)
@@ -34,12 +41,20 @@ struct writable_stream {
     typedef Socket socket_type;
     typedef typename socket_type::endpoint_type endpoint_type;
 
+    enum watermarks: size_t {
+        // When this many bytes are pending in the ring, the producers are asked to back off, until
+        // the peer drains the ring down to the low watermark.
+        high_watermark = 4 * 1024 * 1024,
+        low_watermark  = 1024 * 1024
+    };
+
     writable_stream(reactor_t& reactor, endpoint_type endpoint):
         m_socket(std::make_shared<socket_type>(endpoint)),
         m_socket_watcher(reactor.native()),
         m_reactor(reactor),
         m_tx_offset(0),
-        m_wr_offset(0)
+        m_wr_offset(0),
+        m_throttled(false)
     {
         m_socket_watcher.set<writable_stream, &writable_stream::on_event>(this);
         m_ring.resize(65536);
@@ -50,7 +65,8 @@ struct writable_stream {
         m_socket_watcher(reactor.native()),
         m_reactor(reactor),
         m_tx_offset(0),
-        m_wr_offset(0)
+        m_wr_offset(0),
+        m_throttled(false)
     {
         m_socket_watcher.set<writable_stream, &writable_stream::on_event>(this);
         m_ring.resize(65536);
@@ -62,9 +78,23 @@ struct writable_stream {
         m_handle_error = error_handler;
     }
 
+    template<class ErrorHandler, class PressureHandler>
+    void
+    bind(ErrorHandler error_handler,
+         PressureHandler pressure_handler)
+    {
+        std::unique_lock<std::mutex> lock(m_ring_mutex);
+
+        m_handle_error = error_handler;
+        m_handle_pressure = pressure_handler;
+    }
+
     void
     unbind() {
+        std::unique_lock<std::mutex> lock(m_ring_mutex);
+
         m_handle_error = nullptr;
+        m_handle_pressure = nullptr;
     }
 
     size_t
@@ -118,8 +148,16 @@ struct writable_stream {
 
         m_wr_offset += size;
 
+        if(!m_throttled && m_handle_pressure && pending() >= high_watermark) {
+            m_throttled = true;
+
+            // NOTE: Pressure notifications are delivered via the reactor, as writers might be in
+            // other threads and hold their own locks.
+            m_reactor.post(std::bind(m_handle_pressure, true));
+        }
+
         if(!m_socket_watcher.is_active()) {
-            m_socket_watcher.start(m_socket->fd(), ev::WRITE);
+            m_socket_watcher.start(m_socket->fd(), writable_event<socket_type>::value);
             m_reactor.post(deferred_wakeup_action());
         }
     }
@@ -147,9 +185,22 @@ private:
             if(m_tx_offset == m_wr_offset) {
                 m_socket_watcher.stop();
             }
+
+            if(m_throttled && pending() <= low_watermark) {
+                m_throttled = false;
+
+                if(m_handle_pressure) {
+                    m_reactor.post(std::bind(m_handle_pressure, false));
+                }
+            }
         }
     }
 
+    size_t
+    pending() const {
+        return m_wr_offset - m_tx_offset;
+    }
+
 private:
     const std::shared_ptr<socket_type> m_socket;
 
@@ -167,10 +218,18 @@ private:
 
     std::mutex m_ring_mutex;
 
+    // Whether the producers were asked to back off.
+    bool m_throttled;
+
     // Write error handler.
     std::function<
         void(const std::error_code&)
     > m_handle_error;
+
+    // Backpressure handler.
+    std::function<
+        void(bool)
+    > m_handle_pressure;
 };
 
 }} // namespace cocaine::io
@@ -41,6 +41,8 @@ struct defaults {
     static const unsigned long queue_limit;
     static const unsigned long concurrency;
     static const unsigned long crashlog_limit;
+    static const unsigned long crashlog_size;
+    static const unsigned long shared_ring_size;
 
     // Default I/O policy.
     static const float control_timeout;
@@ -80,6 +80,9 @@ class actor_t {
         void
         on_failure(int fd, const std::error_code& ec);
 
+        void
+        on_pressure(int fd, bool throttled);
+
     private:
         context_t& m_context;
 
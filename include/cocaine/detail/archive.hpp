@@ -23,7 +23,10 @@
 
 #include "cocaine/common.hpp"
 
+#include <set>
+
 struct archive;
+struct archive_entry;
 
 namespace cocaine {
 
@@ -31,11 +34,16 @@ struct archive_error_t:
     public std::runtime_error
 {
     archive_error_t(archive* source);
+    archive_error_t(const std::string& reason);
 };
 
 class archive_t {
     public:
         archive_t(context_t& context, const std::string& archive);
+
+        // NOTE: The archive memory is not copied, so it must outlive the object.
+        archive_t(context_t& context, const char* data, size_t size);
+
        ~archive_t();
 
         void
@@ -46,10 +54,32 @@ class archive_t {
         type() const;
 
     private:
+        void
+        open(const char* data, size_t size);
+
         static
         void
         extract(archive* source, archive* target);
 
+        // Extracts the entry to the given path, unless the file there has the same content already.
+        // Returns false if the entry has been skipped.
+        static
+        bool
+        update(archive* source, archive* target, archive_entry* entry, const std::string& pathname);
+
+        // Writes the entry header and copies the given number of leading bytes from the given file.
+        static
+        void
+        rewrite(archive* target, archive_entry* entry, int fd, off_t size);
+
+        static
+        void
+        finish(archive* target);
+
+        // Removes everything in the target directory which hasn't been deployed from the archive.
+        void
+        prune(const std::string& prefix, const std::set<std::string>& deployed);
+
     private:
         const std::unique_ptr<logging::log_t> m_log;
 
@@ -0,0 +1,76 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_ASYNC_STORAGE_HPP
+#define COCAINE_ASYNC_STORAGE_HPP
+
+#include "cocaine/api/storage.hpp"
+
+#include "cocaine/rpc/slots/deferred.hpp"
+
+namespace cocaine {
+
+class executor_t;
+
+// NOTE: Runs the operations of a synchronous storage on an executor, so that a slow backend doesn't
+// block the calling reactor. The results are delivered via deferreds, which can be returned as is
+// from the service slots.
+
+class async_storage_t {
+    COCAINE_DECLARE_NONCOPYABLE(async_storage_t)
+
+    public:
+        async_storage_t(const api::category_traits<api::storage_t>::ptr_type& storage, executor_t& executor);
+
+        deferred<std::string>
+        read(const std::string& collection, const std::string& key);
+
+        deferred<void>
+        write(const std::string& collection, const std::string& key, const std::string& blob, const std::vector<std::string>& tags);
+
+        deferred<void>
+        remove(const std::string& collection, const std::string& key);
+
+        deferred<std::vector<std::string>>
+        find(const std::string& collection, const std::vector<std::string>& tags);
+
+        deferred<std::map<std::string, std::string>>
+        read_many(const std::string& collection, const std::vector<std::string>& keys);
+
+        deferred<void>
+        write_many(const std::string& collection, const std::map<std::string, std::string>& objects, const std::vector<std::string>& tags);
+
+        deferred<void>
+        remove_many(const std::string& collection, const std::vector<std::string>& keys);
+
+    private:
+        template<class R>
+        deferred<R>
+        submit(const std::function<R()>& operation);
+
+    private:
+        const api::category_traits<api::storage_t>::ptr_type m_storage;
+
+        executor_t& m_executor;
+};
+
+} // namespace cocaine
+
+#endif
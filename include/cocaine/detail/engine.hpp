@@ -41,6 +41,8 @@ namespace ev {
 
 namespace cocaine {
 
+class executor_t;
+
 namespace io {
 
 struct control_tag;
@@ -117,6 +119,10 @@ class engine_t {
         void
         erase(const std::string& id, int code, const std::string& reason);
 
+        // Number of the queued sessions plus the ones being processed by the slaves.
+        size_t
+        outstanding();
+
         // App access
 
         io::reactor_t&
@@ -124,6 +130,12 @@ class engine_t {
             return *m_reactor;
         }
 
+        // For the blocking operations, like saving the crashlogs.
+        executor_t&
+        executor() {
+            return *m_executor;
+        }
+
     private:
         void
         on_connection(const std::shared_ptr<io::socket<io::local>>& socket);
@@ -160,6 +172,10 @@ class engine_t {
 
         const std::unique_ptr<logging::log_t> m_log;
 
+        // NOTE: Declared before the slaves, so that it outlives them and the crashlogs they've
+        // posted are still saved on shutdown.
+        const std::unique_ptr<executor_t> m_executor;
+
         // Configuration
 
         const manifest_t& m_manifest;
@@ -0,0 +1,74 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_EXECUTOR_HPP
+#define COCAINE_EXECUTOR_HPP
+
+#include "cocaine/common.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace cocaine {
+
+// NOTE: A fixed pool of threads for the blocking operations, like storage I/O, which shouldn't be
+// run on the reactor threads. The queue is bounded, so that a stalled disk doesn't make the callers
+// pile up an infinite backlog.
+
+class executor_t {
+    COCAINE_DECLARE_NONCOPYABLE(executor_t)
+
+    public:
+        typedef std::function<void()> task_type;
+
+    public:
+        executor_t(unsigned int threads, size_t limit);
+
+        // Runs the remaining queued tasks and joins the threads.
+       ~executor_t();
+
+        // Returns false if the queue is full, in which case the task is dropped. The task must not
+        // throw, as there's no one to catch it.
+        bool
+        post(const task_type& task);
+
+    private:
+        void
+        run();
+
+    private:
+        const size_t m_limit;
+
+        std::deque<task_type> m_queue;
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+
+        bool m_stopped;
+
+        std::vector<std::unique_ptr<std::thread>> m_threads;
+};
+
+} // namespace cocaine
+
+#endif
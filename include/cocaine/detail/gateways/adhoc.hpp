@@ -48,9 +48,23 @@ class adhoc_t:
         void
         cleanup(const std::string& uuid, const std::string& name);
 
+        virtual
+        void
+        report(const std::string& uuid, const std::string& name, uint64_t load);
+
     private:
         const std::unique_ptr<logging::log_t> m_log;
 
+        enum class balancers {
+            // Picks a uniformly random node.
+            random,
+
+            // Picks the least loaded node out of two random ones.
+            load
+        };
+
+        balancers m_balancer;
+
 #if defined(__clang__) || defined(HAVE_GCC46)
         mutable std::default_random_engine m_random_generator;
 #else
@@ -60,11 +74,14 @@ class adhoc_t:
         struct remote_service_t {
             std::string uuid;
             metadata_t  meta;
+
+            // Last reported load, plus the number of clients sent there since the report.
+            mutable uint64_t load;
         };
 
-        typedef std::multimap<
+        typedef std::map<
             std::string,
-            remote_service_t
+            std::vector<remote_service_t>
         > remote_service_map_t;
 
         remote_service_map_t m_remote_services;
@@ -0,0 +1,175 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_FORWARDING_GATEWAY_HPP
+#define COCAINE_FORWARDING_GATEWAY_HPP
+
+#include "cocaine/api/gateway.hpp"
+
+#include "cocaine/asio/reactor.hpp"
+#include "cocaine/asio/tcp.hpp"
+
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace cocaine {
+
+class executor_t;
+
+} // namespace cocaine
+
+namespace cocaine { namespace gateway {
+
+// NOTE: Instead of sending the clients to the remote nodes directly, this gateway resolves remote
+// services to the local proxies, which forward the calls over a small pool of persistent channels to
+// every remote service. Client sessions are multiplexed over these channels using the band field, so
+// the clients never have to connect to the remote nodes themselves. When either side of the relay
+// can't keep up, the sides feeding it are paused until it catches up.
+
+class forwarding_t:
+    public api::gateway_t
+{
+    public:
+        forwarding_t(context_t& context, const std::string& name, const Json::Value& args);
+
+        virtual
+       ~forwarding_t();
+
+        virtual
+        metadata_t
+        resolve(const std::string& name) const;
+
+        virtual
+        void
+        consume(const std::string& uuid, const std::string& name, const metadata_t& info);
+
+        virtual
+        void
+        cleanup(const std::string& uuid, const std::string& name);
+
+    private:
+        struct proxy_t;
+        struct client_t;
+        struct upstream_t;
+
+        // Everything below is only called on the gateway thread.
+
+        void
+        start(const std::shared_ptr<proxy_t>& proxy);
+
+        void
+        stop(const std::shared_ptr<proxy_t>& proxy);
+
+        void
+        on_connection(const std::string& name, const std::shared_ptr<io::socket<io::tcp>>& socket);
+
+        void
+        on_client_message(int fd, const io::message_t& message);
+
+        void
+        on_client_failure(int fd, const std::error_code& ec);
+
+        void
+        on_upstream_connect(int id, const std::shared_ptr<io::socket<io::tcp>>& socket, const std::error_code& ec);
+
+        void
+        on_upstream_message(int id, const io::message_t& message);
+
+        void
+        on_upstream_failure(int id, const std::error_code& ec);
+
+        void
+        on_client_pressure(int fd, bool throttled);
+
+        void
+        on_upstream_pressure(int id, bool throttled);
+
+        void
+        on_resolve(const std::string& key, const std::vector<io::tcp::endpoint>& endpoints,
+                   const std::error_code& ec);
+
+        // Picks a pooled channel to one of the nodes which have the service.
+        int
+        select(const std::string& name);
+
+        // Opens a new pooled channel, which is connected asynchronously.
+        void
+        connect(const std::string& host, uint16_t port);
+
+        void
+        dial(int id);
+
+        // Runs on the resolver thread, the results are posted back to the gateway thread.
+        void
+        lookup(const std::string& key, const std::string& host, uint16_t port);
+
+    private:
+        const std::unique_ptr<logging::log_t> m_log;
+
+        // This node's id, local services are never forwarded.
+        const std::string m_uuid;
+
+        // Proxy endpoint, as advertised to the clients and as bound to.
+        const std::string m_hostname;
+        const std::string m_address;
+
+        // Maximum number of channels to each remote service.
+        const size_t m_pool_limit;
+
+        io::reactor_t m_reactor;
+
+        // Proxies, indexed by service name. Guarded by the mutex, as the gateway interface is used
+        // from the locator thread.
+        std::map<std::string, std::shared_ptr<proxy_t>> m_proxies;
+
+        mutable std::mutex m_mutex;
+
+        // Client connections, indexed by their file descriptors.
+        std::map<int, std::shared_ptr<client_t>> m_clients;
+
+        // Pooled upstream channels, indexed by sequential ids, as they aren't connected right away.
+        std::map<int, std::shared_ptr<upstream_t>> m_upstreams;
+
+        int m_next_upstream;
+
+        struct pool_t {
+            std::vector<int> channels;
+            size_t next;
+        };
+
+        // Channel pools, indexed by remote service endpoints.
+        std::map<std::string, pool_t> m_pools;
+
+        // Resolved remote service endpoints, dropped when a channel to them fails.
+        std::map<std::string, std::vector<io::tcp::endpoint>> m_endpoints;
+
+        // Channels waiting for their remote service endpoints to be resolved.
+        std::map<std::string, std::vector<int>> m_pending;
+
+        // NOTE: Name resolution blocks, so it's done on a separate thread to keep the relay going.
+        std::unique_ptr<executor_t> m_resolver;
+
+        std::unique_ptr<std::thread> m_thread;
+};
+
+}} // namespace cocaine::gateway
+
+#endif
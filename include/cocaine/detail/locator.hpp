@@ -24,11 +24,16 @@
 
 #include "cocaine/common.hpp"
 
+#include "cocaine/asio/tcp.hpp"
+
 #include "cocaine/dispatch.hpp"
 #include "cocaine/messages.hpp"
 
 #include <mutex>
 #include <queue>
+#include <random>
+
+#include <boost/optional.hpp>
 
 namespace ev {
     struct io;
@@ -48,6 +53,11 @@ class locator_t:
     typedef io::event_traits<io::locator::synchronize>::result_type synchronize_result_type;
     typedef io::event_traits<io::locator::reports>::result_type reports_result_type;
     typedef io::event_traits<io::locator::refresh>::result_type refresh_result_type;
+    typedef io::event_traits<io::locator::resolve_if_changed>::result_type resolve_if_changed_result_type;
+    typedef io::event_traits<io::locator::subscribe>::result_type subscribe_result_type;
+    typedef io::event_traits<io::locator::synchronize_delta>::result_type synchronize_delta_result_type;
+
+    typedef std::tuple_element<3, synchronize_delta_result_type>::type load_map_t;
 
     public:
         locator_t(context_t& context, io::reactor_t& reactor);
@@ -69,17 +79,27 @@ class locator_t:
 
     private:
         resolve_result_type
-        resolve(const std::string& name) const;
+        resolve(const std::string& name, const std::string& key) const;
 
         synchronize_result_type
         dump() const;
 
+        load_map_t
+        loads() const;
+
         reports_result_type
         reports() const;
 
         refresh_result_type
         refresh(const std::string& name);
 
+        resolve_if_changed_result_type
+        resolve_if_changed(const std::string& name, uint64_t generation) const;
+
+        // Schedules the subscriber notifications after a routing table update.
+        void
+        notify();
+
         // Cluster I/O
 
         void
@@ -88,6 +108,17 @@ class locator_t:
         void
         on_announce_timer(ev::timer&, int);
 
+        // Hands the newly discovered nodes over to the discovery thread.
+        void
+        on_batch_timer(ev::timer&, int);
+
+        void
+        on_resolve(const key_type& key, const std::vector<io::tcp::endpoint>& endpoints);
+
+        void
+        on_connect(const key_type& key, const std::shared_ptr<io::socket<io::tcp>>& socket,
+                   const std::error_code& ec);
+
         void
         on_message(const key_type& key, const io::message_t& message);
 
@@ -97,6 +128,14 @@ class locator_t:
         void
         on_timeout(const key_type& key);
 
+        // Removes the remote node and its services, deferring the channel destruction.
+        void
+        drop(const key_type& key);
+
+        // Announces the local service list changes to the peers.
+        void
+        announce();
+
     private:
         context_t& m_context;
 
@@ -130,21 +169,61 @@ class locator_t:
         struct remote_t {
             std::shared_ptr<io::channel<io::socket<io::tcp>>> channel;
             std::shared_ptr<io::timeout_t> timeout;
+
+            // Sequence number of the last applied update, if any.
+            boost::optional<uint64_t> sequence;
+
+            // Whether the node doesn't support the incremental synchronization, in which case it's
+            // synchronized using the full dumps instead.
+            bool legacy;
         };
 
         // These are remote channels indexed by endpoint and uuid. The uuid is required to easily
         // disambiguate between different runtime instances on the same host.
         std::map<key_type, remote_t> m_remotes;
 
+        // Nodes which are being resolved and connected to, and the ones waiting for the next batch.
+        std::map<key_type, std::shared_ptr<io::dialer<io::tcp>>> m_pending;
+        std::vector<key_type> m_batch;
+
+        std::unique_ptr<ev::timer> m_batch_timer;
+
+        struct discovery_t;
+
+        // Asynchronous node resolver.
+        std::unique_ptr<discovery_t> m_discovery;
+
         // Announce emitter.
         std::unique_ptr<io::socket<io::udp>> m_announce;
         std::unique_ptr<ev::timer> m_announce_timer;
 
+        // Current announce interval, grows from the initial one up to the steady state one.
+        float m_announce_interval;
+
+#if defined(__clang__) || defined(HAVE_GCC46)
+        std::default_random_engine m_random_generator;
+#else
+        std::minstd_rand0 m_random_generator;
+#endif
+
+        // Pre-encoded announce.
+        std::string m_announce_blob;
+
         struct synchronize_slot_t;
 
         // Synchronizing slot.
         std::shared_ptr<synchronize_slot_t> m_synchronizer;
 
+        struct delta_slot_t;
+
+        // Incremental synchronizing slot.
+        std::shared_ptr<delta_slot_t> m_delta;
+
+        struct subscribe_slot_t;
+
+        // Routing update subscriptions.
+        std::shared_ptr<subscribe_slot_t> m_subscriber;
+
         class router_t;
 
         // Used to resolve service names against service groups based on weights and other metrics.
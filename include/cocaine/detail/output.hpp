@@ -0,0 +1,112 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_ENGINE_OUTPUT_HPP
+#define COCAINE_ENGINE_OUTPUT_HPP
+
+#include "cocaine/common.hpp"
+
+#include <cstring>
+
+#include <boost/circular_buffer.hpp>
+
+namespace cocaine { namespace engine {
+
+// NOTE: Keeps the last lines of the slave output. The lines are stored back to back in an arena
+// of a fixed size, which is allocated once, so capturing the output doesn't allocate anything.
+// When the arena or the line index are full, the oldest lines are evicted.
+
+class output_ring_t {
+    COCAINE_DECLARE_NONCOPYABLE(output_ring_t)
+
+    public:
+        output_ring_t(size_t lines, size_t capacity);
+
+        // Splits the data into lines and stores them, returning the number of bytes consumed. The
+        // trailing incomplete line is left unconsumed, unless it is too long to wait for the rest.
+        template<class LineHandler>
+        size_t
+        consume(const char* data, size_t size, LineHandler handler);
+
+        void
+        push(const char* line, size_t size);
+
+        std::vector<std::string>
+        lines() const;
+
+    public:
+        bool
+        empty() const {
+            return m_index.empty();
+        }
+
+        // Incomplete lines longer than this are stored without waiting for the line break.
+        size_t
+        threshold() const {
+            return m_arena.size();
+        }
+
+    private:
+        struct line_t {
+            size_t offset;
+            size_t size;
+        };
+
+        void
+        evict(size_t offset, size_t size);
+
+    private:
+        std::vector<char> m_arena;
+
+        // Next write position in the arena.
+        size_t m_offset;
+
+        boost::circular_buffer<line_t> m_index;
+};
+
+template<class LineHandler>
+size_t
+output_ring_t::consume(const char* data, size_t size, LineHandler handler) {
+    const char* it  = data;
+    const char* end = data + size;
+
+    while(it != end) {
+        const char* eol = static_cast<const char*>(std::memchr(it, '\n', end - it));
+
+        if(eol == nullptr) {
+            if(static_cast<size_t>(end - it) < threshold()) {
+                break;
+            }
+
+            eol = end;
+        }
+
+        push(it, eol - it);
+        handler(it, eol - it);
+
+        it = eol == end ? end : eol + 1;
+    }
+
+    return it - data;
+}
+
+}} // namespace cocaine::engine
+
+#endif
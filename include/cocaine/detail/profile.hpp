@@ -47,11 +47,20 @@ struct profile_t:
 
     // Limits.
     unsigned long concurrency;
-    unsigned long crashlog_limit;
     unsigned long grow_threshold;
     unsigned long pool_limit;
     unsigned long queue_limit;
 
+    // Number of the last slave output lines kept for the crashlogs, and the memory for them in bytes.
+    // The output is captured into a fixed arena of the latter size, so if the lines are long, fewer of
+    // them are kept. Longer lines are truncated to the arena size.
+    unsigned long crashlog_limit;
+    unsigned long crashlog_size;
+
+    // Capacity of the shared memory rings, for the slaves which support them. Zero disables the
+    // shared memory transport.
+    unsigned long shared_ring_size;
+
     // NOTE: The slave processes are launched in sandboxed environments,
     // called isolates. This one describes the isolate type and arguments.
     config_t::component_t isolate;
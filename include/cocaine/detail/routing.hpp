@@ -0,0 +1,159 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_ROUTING_HPP
+#define COCAINE_ROUTING_HPP
+
+#include "cocaine/common.hpp"
+
+namespace cocaine { namespace routing {
+
+// NOTE: The routing decisions based on these hashes must be the same on every node in the cluster, so
+// std::hash<> won't do.
+
+// FNV-1a, for the routing keys and the node ids.
+inline
+uint64_t
+hash(const std::string& value) {
+    uint64_t result = 0xCBF29CE484222325ULL;
+
+    for(auto it = value.begin(); it != value.end(); ++it) {
+        result ^= static_cast<unsigned char>(*it);
+        result *= 0x100000001B3ULL;
+    }
+
+    return result;
+}
+
+// SplitMix64 finalizer, spreads the hashes and the sequential seeds evenly.
+inline
+uint64_t
+mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+
+    return x ^ (x >> 31);
+}
+
+// NOTE: Walker's alias method, Vose's variant, in exact integer arithmetic. Every service gets a
+// column of height equal to the average weight, which is split between the service itself and its
+// alias, so that a weighted pick takes a random column and a coin toss within it.
+
+struct alias_table_t {
+    alias_table_t(const std::vector<std::string>& services, const std::vector<unsigned int>& weights);
+
+    // Picks a service using two independent uniformly distributed random numbers.
+    const std::string&
+    select(uint64_t column, uint64_t coin) const {
+        const size_t index = column % m_services.size();
+
+        if(coin % m_sum < m_threshold[index]) {
+            return m_services[index];
+        } else {
+            return m_services[m_alias[index]];
+        }
+    }
+
+    bool
+    empty() const {
+        return m_sum == 0;
+    }
+
+    const std::vector<std::string>&
+    services() const {
+        return m_services;
+    }
+
+    const std::vector<unsigned int>&
+    weights() const {
+        return m_weights;
+    }
+
+private:
+    std::vector<std::string> m_services;
+    std::vector<unsigned int> m_weights;
+
+    // Column heights are scaled by the number of services, so that the average weight is the sum.
+    std::vector<uint64_t> m_threshold;
+    std::vector<size_t> m_alias;
+
+    uint64_t m_sum;
+};
+
+inline
+alias_table_t::alias_table_t(const std::vector<std::string>& services, const std::vector<unsigned int>& weights):
+    m_services(services),
+    m_weights(weights),
+    m_threshold(services.size(), 0),
+    m_alias(services.size(), 0),
+    m_sum(0)
+{
+    const size_t size = m_services.size();
+
+    for(size_t i = 0; i < size; ++i) {
+        m_sum += weights[i];
+    }
+
+    if(m_sum == 0) {
+        return;
+    }
+
+    std::vector<size_t> small,
+                        large;
+
+    for(size_t i = 0; i < size; ++i) {
+        m_threshold[i] = static_cast<uint64_t>(weights[i]) * size;
+
+        if(m_threshold[i] < m_sum) {
+            small.push_back(i);
+        } else {
+            large.push_back(i);
+        }
+    }
+
+    while(!small.empty() && !large.empty()) {
+        const size_t lesser = small.back(),
+                     greater = large.back();
+
+        small.pop_back();
+
+        // The lesser column is topped up from the greater one.
+        m_alias[lesser] = greater;
+        m_threshold[greater] -= m_sum - m_threshold[lesser];
+
+        if(m_threshold[greater] < m_sum) {
+            large.pop_back();
+            small.push_back(greater);
+        }
+    }
+
+    // NOTE: With the exact arithmetic, whatever is left is exactly full.
+    for(auto it = large.begin(); it != large.end(); ++it) {
+        m_threshold[*it] = m_sum;
+    }
+
+    for(auto it = small.begin(); it != small.end(); ++it) {
+        m_threshold[*it] = m_sum;
+    }
+}
+
+}} // namespace cocaine::routing
+
+#endif
@@ -22,14 +22,90 @@
 #define COCAINE_STORAGE_SERVICE_HPP
 
 #include "cocaine/api/service.hpp"
+#include "cocaine/api/storage.hpp"
+#include "cocaine/api/stream.hpp"
 
-namespace cocaine { namespace service {
+#include <mutex>
+
+namespace cocaine {
+
+class async_storage_t;
+class executor_t;
+
+namespace service {
+
+// NOTE: Sends an object to the client chunk by chunk, pausing while the client is falling behind,
+// so that only a few chunks are ever buffered on the way, whatever the object size is. The object
+// itself is accessed via a storage reader, so large objects are either mapped into memory or fetched
+// piece by piece instead of being read as a whole.
+
+class read_stream_t:
+    public std::enable_shared_from_this<read_stream_t>
+{
+    public:
+        read_stream_t(const api::category_traits<api::storage_t>::ptr_type& storage, executor_t& executor,
+                      const api::stream_ptr_t& upstream, const std::string& collection, const std::string& key);
+
+        void
+        start();
+
+    private:
+        struct pressure_action_t;
+
+        void
+        on_pressure(bool throttled);
+
+        bool
+        schedule();
+
+        void
+        pump();
+
+        void
+        fail(const std::string& reason);
+
+    private:
+        const api::category_traits<api::storage_t>::ptr_type m_storage;
+        executor_t& m_executor;
+
+        const api::stream_ptr_t m_upstream;
+
+        const std::string m_collection;
+        const std::string m_key;
+
+        // Only touched by the pump, which never runs concurrently with itself.
+        std::unique_ptr<api::object_reader_t> m_reader;
+        api::blob_t m_blob;
+        size_t m_offset;
+
+        std::mutex m_mutex;
+
+        bool m_throttled;
+        bool m_scheduled;
+        bool m_done;
+
+        // NOTE: The pressure handler only holds a weak reference, so that the upstream doesn't keep the
+        // stream alive forever. While throttled, nothing else references the stream, so it's parked
+        // here until the client catches up.
+        std::shared_ptr<read_stream_t> m_parked;
+};
 
 class storage_t:
     public api::service_t
 {
     public:
         storage_t(context_t& context, io::reactor_t& reactor, const std::string& name, const Json::Value& args);
+
+        virtual
+       ~storage_t();
+
+    private:
+        api::category_traits<api::storage_t>::ptr_type m_backend;
+
+        // NOTE: The backend is called on these threads, so that a slow disk doesn't block the
+        // service reactor for all the clients.
+        std::unique_ptr<executor_t> m_executor;
+        std::unique_ptr<async_storage_t> m_storage;
 };
 
 }} // namespace cocaine::service
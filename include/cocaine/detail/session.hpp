@@ -28,6 +28,7 @@
 
 #include "cocaine/asio/reactor.hpp"
 #include "cocaine/asio/local.hpp"
+#include "cocaine/asio/shared.hpp"
 #include "cocaine/asio/socket.hpp"
 #include "cocaine/asio/writable_stream.hpp"
 
@@ -67,6 +68,9 @@ struct session_t {
     void
     attach(const std::shared_ptr<io::writable_stream<io::socket<io::local>>>& downstream);
 
+    void
+    attach(const std::shared_ptr<io::writable_stream<io::shared_ring>>& downstream);
+
     void
     detach();
 
@@ -89,8 +93,18 @@ private:
     send(Args&&... args);
 
 private:
+    // Slave transport, either a socket or a shared memory ring.
+    struct sink_t {
+        template<class Stream>
+        sink_t(const std::shared_ptr<Stream>& stream):
+            write(std::bind(&Stream::write, stream, std::placeholders::_1, std::placeholders::_2))
+        { }
+
+        const std::function<void(const char*, size_t)> write;
+    };
+
     std::unique_ptr<
-        io::encoder<io::writable_stream<io::socket<io::local>>>
+        io::encoder<sink_t>
     > m_encoder;
 
     // Session interlocking.
@@ -26,12 +26,11 @@
 #include "cocaine/api/isolate.hpp"
 
 #include "cocaine/detail/atomic.hpp"
+#include "cocaine/detail/output.hpp"
 #include "cocaine/detail/queue.hpp"
 
 #include <chrono>
 
-#include <boost/circular_buffer.hpp>
-
 namespace ev {
     struct timer;
 }
@@ -40,7 +39,9 @@ namespace cocaine { namespace engine {
 
 struct session_t;
 
-class slave_t {
+class slave_t:
+    public std::enable_shared_from_this<slave_t>
+{
     COCAINE_DECLARE_NONCOPYABLE(slave_t)
 
     enum class states {
@@ -64,6 +65,9 @@ class slave_t {
         void
         bind(const std::shared_ptr<io::channel<io::socket<io::local>>>& channel);
 
+        void
+        bind(const std::shared_ptr<io::shared_segment>& segment);
+
         // Session scheduling
 
         void
@@ -109,6 +113,13 @@ class slave_t {
         void
         on_choke(uint64_t session_id);
 
+        // Flow control
+
+        struct pressure_action_t;
+
+        void
+        on_pressure(bool throttled);
+
         // Health
 
         void
@@ -120,6 +131,9 @@ class slave_t {
         size_t
         on_output(const char* data, size_t size);
 
+        void
+        on_line(const char* line, size_t size);
+
         // Housekeeping
 
         void
@@ -175,12 +189,17 @@ class slave_t {
         struct pipe_t;
 
         std::unique_ptr<io::readable_stream<pipe_t>> m_output_pipe;
-        boost::circular_buffer<std::string> m_output_ring;
+        output_ring_t m_output_ring;
 
         // I/O channel
 
         std::shared_ptr<io::channel<io::socket<io::local>>> m_channel;
 
+        // Shared memory data channel, if negotiated
+
+        std::unique_ptr<io::decoder<io::readable_stream<io::shared_ring>>> m_shared_rd;
+        std::shared_ptr<io::writable_stream<io::shared_ring>> m_shared_wr;
+
         // Active sessions
 
         typedef std::map<
@@ -194,6 +213,10 @@ class slave_t {
 
         session_queue_t m_queue;
 
+        // Number of sessions with throttled clients
+
+        size_t m_throttled;
+
         // Slave interlocking
 
         std::mutex m_mutex;
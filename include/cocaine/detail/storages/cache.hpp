@@ -0,0 +1,124 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_CACHE_STORAGE_HPP
+#define COCAINE_CACHE_STORAGE_HPP
+
+#include "cocaine/api/storage.hpp"
+
+#include <list>
+#include <unordered_map>
+
+namespace cocaine { namespace storage {
+
+// NOTE: Decorates another configured storage with a size-bounded LRU cache of the objects. Writes
+// and removals go straight to the backend and invalidate the cached copies.
+
+class cache_t:
+    public api::storage_t
+{
+    public:
+        cache_t(context_t& context, const std::string& name, const Json::Value& args);
+
+        virtual
+       ~cache_t();
+
+        virtual
+        std::string
+        read(const std::string& collection, const std::string& key);
+
+        virtual
+        void
+        write(const std::string& collection, const std::string& key, const std::string& blob, const std::vector<std::string>& tags);
+
+        virtual
+        void
+        remove(const std::string& collection, const std::string& key);
+
+        virtual
+        std::vector<std::string>
+        find(const std::string& collection, const std::vector<std::string>& tags);
+
+        virtual
+        std::map<std::string, std::string>
+        read_many(const std::string& collection, const std::vector<std::string>& keys);
+
+        virtual
+        void
+        write_many(const std::string& collection, const std::map<std::string, std::string>& objects, const std::vector<std::string>& tags);
+
+        virtual
+        void
+        remove_many(const std::string& collection, const std::vector<std::string>& keys);
+
+        virtual
+        api::blob_t
+        view(const std::string& collection, const std::string& key);
+
+        virtual
+        std::unique_ptr<api::object_writer_t>
+        writer(const std::string& collection, const std::string& key, const std::vector<std::string>& tags);
+
+        virtual
+        std::unique_ptr<api::object_reader_t>
+        reader(const std::string& collection, const std::string& key);
+
+    private:
+        class writer_t;
+
+        // Caches an object fetched from the backend, unless some modification has happened since
+        // the given generation. Must be called under the lock.
+        void
+        store(const std::string& id, const api::blob_t& blob, uint64_t generation);
+
+        void
+        invalidate(const std::string& collection, const std::string& key);
+
+        void
+        invalidate_many(const std::string& collection, const std::vector<std::string>& keys);
+
+    private:
+        const std::unique_ptr<logging::log_t> m_log;
+
+        api::category_traits<api::storage_t>::ptr_type m_backend;
+
+        // Maximum total size of the cached objects, in bytes.
+        const size_t m_limit;
+
+        typedef std::pair<std::string, api::blob_t> entry_type;
+        typedef std::list<entry_type> lru_list_t;
+
+        // Most recently used objects first.
+        lru_list_t m_lru;
+
+        std::unordered_map<std::string, lru_list_t::iterator> m_index;
+
+        size_t m_size;
+
+        // Bumped on every modification, so that the objects read from the backend concurrently with
+        // some modification are not cached, as they might be stale already.
+        uint64_t m_generation;
+
+        std::mutex m_mutex;
+};
+
+}} // namespace cocaine::storage
+
+#endif
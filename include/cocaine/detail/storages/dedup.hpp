@@ -0,0 +1,95 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_DEDUP_STORAGE_HPP
+#define COCAINE_DEDUP_STORAGE_HPP
+
+#include "cocaine/api/storage.hpp"
+
+#include <set>
+
+namespace cocaine { namespace storage {
+
+// NOTE: Content-addressed decorator for another configured storage. Objects are split into chunks
+// at content-defined boundaries, so that an insertion or a removal only affects the chunks around
+// it, and every distinct chunk is stored only once, named after its SHA-256 digest. The objects
+// themselves are replaced with the lists of their chunks. This works best for the objects sharing
+// most of their content, like the uncompressed archives of the consecutive app versions.
+
+class dedup_t:
+    public api::storage_t
+{
+    public:
+        dedup_t(context_t& context, const std::string& name, const Json::Value& args);
+
+        virtual
+       ~dedup_t();
+
+        virtual
+        std::string
+        read(const std::string& collection, const std::string& key);
+
+        virtual
+        void
+        write(const std::string& collection, const std::string& key, const std::string& blob, const std::vector<std::string>& tags);
+
+        virtual
+        void
+        remove(const std::string& collection, const std::string& key);
+
+        virtual
+        std::vector<std::string>
+        find(const std::string& collection, const std::vector<std::string>& tags);
+
+        virtual
+        std::unique_ptr<api::object_writer_t>
+        writer(const std::string& collection, const std::string& key, const std::vector<std::string>& tags);
+
+        virtual
+        std::unique_ptr<api::object_reader_t>
+        reader(const std::string& collection, const std::string& key);
+
+    private:
+        class writer_t;
+        class reader_t;
+
+        // Stores the chunk unless it's known to be stored already, returns its name.
+        std::string
+        store(const char* data, size_t size);
+
+    private:
+        const std::unique_ptr<logging::log_t> m_log;
+
+        api::category_traits<api::storage_t>::ptr_type m_backend;
+
+        // Chunk size limits, the average chunk size is a power of two between them.
+        const size_t m_min_chunk;
+        const size_t m_max_chunk;
+        const uint64_t m_mask;
+
+        // NOTE: Chunks which are already known to be in the backend. The rest are written again even
+        // if they exist, which is harmless as the content is the same.
+        std::set<std::string> m_chunks;
+        std::mutex m_mutex;
+};
+
+}} // namespace cocaine::storage
+
+#endif
@@ -23,6 +23,8 @@
 
 #include "cocaine/api/storage.hpp"
 
+#include <map>
+
 #include <boost/filesystem/path.hpp>
 
 namespace cocaine { namespace storage {
@@ -52,13 +54,63 @@ class files_t:
         std::vector<std::string>
         find(const std::string& collection, const std::vector<std::string>& tags);
 
+        virtual
+        std::map<std::string, std::string>
+        read_many(const std::string& collection, const std::vector<std::string>& keys);
+
+        virtual
+        api::blob_t
+        view(const std::string& collection, const std::string& key);
+
+        virtual
+        std::unique_ptr<api::object_writer_t>
+        writer(const std::string& collection, const std::string& key, const std::vector<std::string>& tags);
+
+    private:
+        class sync_group_t;
+        class writer_t;
+
+        // Makes sure that the collection exists and returns its path.
+        boost::filesystem::path
+        prepare(const std::string& collection);
+
+        // Moves the written temporary file in place of the object and assigns the tags. In the durable
+        // mode, waits until both the object and its new name are on the disk.
+        void
+        publish(const std::string& collection, const std::string& key, const boost::filesystem::path& temp_path,
+                const std::vector<std::string>& tags);
+
+        void
+        install(const std::string& collection, const std::string& key, const boost::filesystem::path& temp_path,
+                const std::vector<std::string>& tags);
+
+        typedef std::map<std::string, std::vector<std::string>> tag_index_t;
+
+        std::mutex&
+        stripe(const std::string& collection, const std::string& key);
+
+        // Returns the tag index of the collection, loading it from disk if needed. Must be called
+        // under the index lock. Dangling tag symlinks found while loading are returned separately.
+        tag_index_t&
+        index(const std::string& collection, std::vector<boost::filesystem::path>& dangling);
+
     private:
         const std::unique_ptr<logging::log_t> m_log;
 
-        // TODO: Drop this, switch to atomic writes.
-        std::mutex m_mutex;
+        // NOTE: Objects are replaced atomically via rename(), so the readers don't lock anything.
+        // Writers and removals of the same object are serialized using one of these, picked by
+        // the object hash, so that the tags are kept consistent.
+        std::mutex m_stripes[64];
+
+        // Tag -> sorted object keys mappings for the collections which have been searched already.
+        // NOTE: Always locked after the stripes, never the other way around.
+        std::mutex m_index_mutex;
+        std::map<std::string, tag_index_t> m_indices;
 
         const boost::filesystem::path m_storage_path;
+
+        // Shared by the concurrent writers in the durable mode, null otherwise.
+        std::unique_ptr<sync_group_t> m_sync;
 };
 
 }} // namespace cocaine::storage
@@ -0,0 +1,186 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_JOURNAL_STORAGE_HPP
+#define COCAINE_JOURNAL_STORAGE_HPP
+
+#include "cocaine/api/storage.hpp"
+
+#include <condition_variable>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+#include <boost/filesystem/path.hpp>
+
+namespace cocaine { namespace storage {
+
+// NOTE: Log-structured storage. All the objects are appended to a sequence of segment files, along
+// with their tags, and the removals are appended as tombstones. An in-memory index, rebuilt from the
+// segments on startup, maps the objects to their latest versions and the tags to the objects, so the
+// reads and the lookups don't touch the filesystem metadata at all. The space taken by the obsolete
+// records is reclaimed in background by moving the live objects out of the mostly dead segments.
+
+class journal_t:
+    public api::storage_t
+{
+    public:
+        journal_t(context_t& context, const std::string& name, const Json::Value& args);
+
+        virtual
+       ~journal_t();
+
+        virtual
+        std::string
+        read(const std::string& collection, const std::string& key);
+
+        virtual
+        void
+        write(const std::string& collection, const std::string& key, const std::string& blob, const std::vector<std::string>& tags);
+
+        virtual
+        void
+        remove(const std::string& collection, const std::string& key);
+
+        virtual
+        std::vector<std::string>
+        find(const std::string& collection, const std::vector<std::string>& tags);
+
+        virtual
+        std::map<std::string, std::string>
+        read_many(const std::string& collection, const std::vector<std::string>& keys);
+
+        virtual
+        void
+        write_many(const std::string& collection, const std::map<std::string, std::string>& objects, const std::vector<std::string>& tags);
+
+        virtual
+        void
+        remove_many(const std::string& collection, const std::vector<std::string>& keys);
+
+        virtual
+        api::blob_t
+        view(const std::string& collection, const std::string& key);
+
+        virtual
+        std::unique_ptr<api::object_writer_t>
+        writer(const std::string& collection, const std::string& key, const std::vector<std::string>& tags);
+
+    private:
+        struct segment_t;
+        class writer_t;
+
+        struct location_t {
+            std::shared_ptr<segment_t> segment;
+
+            // Record offset and size within the segment.
+            uint64_t offset;
+            uint64_t size;
+
+            // Object offset and size within the segment.
+            uint64_t blob_offset;
+            uint64_t blob_size;
+
+            std::vector<std::string> tags;
+        };
+
+        struct collection_t {
+            std::unordered_map<std::string, location_t> objects;
+            std::map<std::string, std::set<std::string>> tags;
+
+            // Segments which still hold any put records of the objects, live or dead. A tombstone can
+            // be dropped once none of the segments before it holds the removed object anymore.
+            std::unordered_map<std::string, std::set<uint32_t>> history;
+        };
+
+        enum record_types: unsigned int {
+            put_record,
+            remove_record
+        };
+
+        // Looks up the object and returns its location, under the lock.
+        location_t
+        locate(const std::string& collection, const std::string& key);
+
+        // Appends a record to the active segment, must be called under the lock.
+        location_t
+        append(record_types type, const std::string& collection, const std::string& key,
+               const std::vector<std::string>& tags, const char* blob, size_t size);
+
+        // Same as above, but the object is copied from the given file block by block, so that it's
+        // never held in memory as a whole.
+        location_t
+        append(const std::string& collection, const std::string& key, const std::vector<std::string>& tags,
+               int fd, uint64_t size);
+
+        // Updates the index after a record has been appended or recovered, must be called under the
+        // lock.
+        void
+        apply(record_types type, const std::string& collection, const std::string& key,
+              const location_t& location);
+
+        void
+        recover(uint32_t id, bool last);
+
+        // Seals the active segment and starts a new one, must be called under the lock.
+        void
+        roll();
+
+        // Compaction
+
+        void
+        run();
+
+        // Picks a segment worth compacting, if any, must be called under the lock.
+        std::shared_ptr<segment_t>
+        pick() const;
+
+        void
+        compact(const std::shared_ptr<segment_t>& segment);
+
+    private:
+        const std::unique_ptr<logging::log_t> m_log;
+
+        const boost::filesystem::path m_storage_path;
+
+        // Segments are sealed and a new one is started once the active one grows past this size.
+        const uint64_t m_segment_size;
+
+        // Sealed segments with the live data ratio below this one are compacted.
+        const double m_compaction_ratio;
+
+        // Guards the index and the active segment.
+        std::mutex m_mutex;
+
+        std::unordered_map<std::string, collection_t> m_collections;
+
+        // All segments, indexed by their ids, the last one is the active one.
+        std::map<uint32_t, std::shared_ptr<segment_t>> m_segments;
+
+        // Compaction thread.
+        std::condition_variable m_condition;
+        bool m_stopped;
+
+        std::unique_ptr<std::thread> m_thread;
+};
+
+}} // namespace cocaine::storage
+
+#endif
@@ -80,6 +80,12 @@ class dispatch_t {
         std::string
         name() const;
 
+        // Amount of the outstanding work, used for the load-aware routing. Dispatches which don't
+        // keep track of their load always report zero.
+        virtual
+        size_t
+        load() const;
+
     private:
         const std::unique_ptr<logging::log_t> m_log;
 
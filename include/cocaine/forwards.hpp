@@ -63,6 +63,9 @@ namespace cocaine {
         template<class>
         struct acceptor;
 
+        struct shared_ring;
+        struct shared_segment;
+
         // I/O privimites
 
         struct reactor_t;
@@ -70,6 +73,9 @@ namespace cocaine {
         template<class>
         struct connector;
 
+        template<class>
+        struct dialer;
+
         template<class>
         struct readable_stream;
 
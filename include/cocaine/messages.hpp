@@ -47,7 +47,10 @@ struct resolve {
 
     typedef boost::mpl::list<
      /* An alias of the service to resolve. */
-        std::string
+        std::string,
+     /* Routing key. Requests with the same key are routed to the same node across the cluster, as
+        long as the cluster doesn't change. */
+        optional<std::string>
     > tuple_type;
 
     typedef boost::mpl::list<
@@ -107,6 +110,69 @@ struct refresh {
     > tuple_type;
 };
 
+struct resolve_if_changed {
+    typedef locator_tag tag;
+
+    static const char* alias() {
+        return "resolve_if_changed";
+    }
+
+    typedef boost::mpl::list<
+     /* An alias of the service to resolve. */
+        std::string,
+     /* Routing table generation of the client's cached resolve result, zero if there's none. */
+        uint64_t
+    > tuple_type;
+
+    typedef boost::mpl::list<
+     /* Current routing table generation. Zero means that the result must not be cached, which is
+        the case for routing groups. */
+        uint64_t,
+     /* Same as the resolve result, or nil if it hasn't been changed since the client's generation. */
+        boost::optional<tuple::fold<resolve::result_type>::type>
+    > result_type;
+};
+
+struct subscribe {
+    typedef locator_tag tag;
+
+    static const char* alias() {
+        return "subscribe";
+    }
+
+    typedef boost::mpl::list<
+     /* An alias of the service to watch. */
+        std::string
+    > tuple_type;
+
+    typedef
+     /* Routing table generation and the resolve result, streamed to the client on every change,
+        starting with the current one. The result is nil while the service is unavailable. */
+        std::tuple<uint64_t, boost::optional<tuple::fold<resolve::result_type>::type>>
+    result_type;
+};
+
+struct synchronize_delta {
+    typedef locator_tag tag;
+
+    static const char* alias() {
+        return "synchronize_delta";
+    }
+
+    typedef std::tuple<
+     /* Update sequence number, incremented by one with every update. A gap means that some of the
+        updates were lost and the receiver has to start over with a new full dump. */
+        uint64_t,
+     /* Services added or changed since the previous update. The first update is a full dump. */
+        synchronize::result_type,
+     /* Services removed since the previous update. */
+        std::vector<std::string>,
+     /* Loads of the services which have changed since the previous update, i.e. the amount of the
+        queued and active requests. Used for the load-aware routing. */
+        std::map<std::string, uint64_t>
+    > result_type;
+};
+
 }
 
 template<>
@@ -119,7 +185,10 @@ struct protocol<locator_tag> {
         locator::resolve,
         locator::synchronize,
         locator::reports,
-        locator::refresh
+        locator::refresh,
+        locator::resolve_if_changed,
+        locator::subscribe,
+        locator::synchronize_delta
     > type;
 };
 
@@ -133,7 +202,8 @@ struct handshake {
     typedef rpc_tag tag;
 
     typedef boost::mpl::list<
-        /* peer id */ std::string
+        /* peer id */   std::string,
+        /* transport */ optional<std::string>
     > tuple_type;
 };
 
@@ -184,6 +254,16 @@ struct choke {
     typedef rpc_tag tag;
 };
 
+struct transport {
+    typedef rpc_tag tag;
+
+    typedef boost::mpl::list<
+     /* Capacity of each of the shared rings. The segment descriptors are attached to this message
+        as SCM_RIGHTS ancillary data, see asio/shared.hpp for the layout. */
+        uint64_t
+    > tuple_type;
+};
+
 }
 
 template<>
@@ -199,7 +279,8 @@ struct protocol<rpc_tag> {
         rpc::invoke,
         rpc::chunk,
         rpc::error,
-        rpc::choke
+        rpc::choke,
+        rpc::transport
     >::type type;
 };
 
@@ -440,6 +521,101 @@ struct find {
     result_type;
 };
 
+struct read_many {
+    typedef storage_tag tag;
+
+    static const char* alias() {
+        return "read_many";
+    }
+
+    typedef boost::mpl::list<
+     /* Key namespace. */
+        std::string,
+     /* Keys. Typically, the ones returned by a find() call. */
+        std::vector<std::string>
+    > tuple_type;
+
+    typedef
+     /* A mapping between the keys and the stored values. Keys which don't exist in the given key
+        namespace are silently omitted. */
+        std::map<std::string, std::string>
+    result_type;
+};
+
+struct write_many {
+    typedef storage_tag tag;
+
+    static const char* alias() {
+        return "write_many";
+    }
+
+    typedef boost::mpl::list<
+     /* Key namespace. */
+        std::string,
+     /* A mapping between the keys and the values to store. */
+        std::map<std::string, std::string>,
+     /* Tag list, assigned to every object. */
+        optional<std::vector<std::string>>
+    > tuple_type;
+};
+
+struct remove_many {
+    typedef storage_tag tag;
+
+    static const char* alias() {
+        return "remove_many";
+    }
+
+    typedef boost::mpl::list<
+     /* Key namespace. */
+        std::string,
+     /* Keys. */
+        std::vector<std::string>
+    > tuple_type;
+};
+
+struct read_stream {
+    typedef storage_tag tag;
+
+    static const char* alias() {
+        return "read_stream";
+    }
+
+    typedef boost::mpl::list<
+     /* Key namespace. */
+        std::string,
+     /* Key. */
+        std::string
+    > tuple_type;
+
+    typedef
+     /* The stored value, streamed back in chunks, so that large objects could be transferred
+        without holding them in memory as a whole. */
+        raw_t
+    result_type;
+};
+
+struct write_stream {
+    typedef storage_tag tag;
+
+    // The value is streamed to the service in chunks, the object is stored once the stream is
+    // closed, and then the upstream is closed too.
+    typedef streaming_tag transition_type;
+
+    static const char* alias() {
+        return "write_stream";
+    }
+
+    typedef boost::mpl::list<
+     /* Key namespace. */
+        std::string,
+     /* Key. */
+        std::string,
+     /* Tag list. */
+        optional<std::vector<std::string>>
+    > tuple_type;
+};
+
 }
 
 template<>
@@ -452,7 +628,12 @@ struct protocol<storage_tag> {
         storage::read,
         storage::write,
         storage::remove,
-        storage::find
+        storage::find,
+        storage::read_many,
+        storage::write_many,
+        storage::remove_many,
+        storage::read_stream,
+        storage::write_stream
     > type;
 };
 
@@ -21,6 +21,7 @@
 #ifndef COCAINE_IO_ENCODER_HPP
 #define COCAINE_IO_ENCODER_HPP
 
+#include "cocaine/rpc/frame.hpp"
 #include "cocaine/rpc/message.hpp"
 
 #include <mutex>
@@ -59,6 +60,12 @@ struct encoder {
         m_stream->bind(error_handler);
     }
 
+    template<class ErrorHandler, class PressureHandler>
+    void
+    bind(ErrorHandler error_handler, PressureHandler pressure_handler) {
+        m_stream->bind(error_handler, pressure_handler);
+    }
+
     void
     unbind() {
         m_stream->unbind();
@@ -67,10 +74,61 @@ struct encoder {
     template<class Event, typename... Args>
     void
     write(uint64_t stream, Args&&... args) {
-        typedef event_traits<Event> traits;
+        typedef typename frame<Event>::template is_static<Args...>::type is_static;
+
+        std::lock_guard<std::mutex> guard(m_mutex);
 
+        pack<Event>(is_static(), stream, std::forward<Args>(args)...);
+    }
+
+    template<class Event>
+    void
+    write(const preencoded<Event>& cached, uint64_t stream) {
         std::lock_guard<std::mutex> guard(m_mutex);
 
+        if(m_frame.size() < cached.size()) {
+            m_frame.resize(cached.size());
+        }
+
+        flush(m_frame.data(), cached.pack(m_frame.data(), stream));
+    }
+
+    // Relays a decoded message as is, but on a different stream.
+    void
+    write(const message_t& message, uint64_t stream) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        m_packer.pack_array(3);
+
+        m_packer.pack_uint32(message.id());
+        m_packer.pack_uint64(stream);
+
+        m_packer << message.args();
+
+        if(m_stream) {
+            m_stream->write(m_buffer.data(), m_buffer.size());
+            m_buffer.clear();
+        }
+    }
+
+private:
+    template<class Event, typename... Args>
+    void
+    pack(std::true_type, uint64_t stream, const Args&... args) {
+        const size_t size = frame<Event>::size(args...);
+
+        if(m_frame.size() < size) {
+            m_frame.resize(size);
+        }
+
+        flush(m_frame.data(), frame<Event>::pack(m_frame.data(), stream, args...));
+    }
+
+    template<class Event, typename... Args>
+    void
+    pack(std::false_type, uint64_t stream, Args&&... args) {
+        typedef event_traits<Event> traits;
+
         // NOTE: Format is [ID, Tag, [Args...]].
         m_packer.pack_array(3);
 
@@ -88,6 +146,15 @@ struct encoder {
         }
     }
 
+    void
+    flush(const char* begin, const char* end) {
+        if(m_stream) {
+            m_stream->write(begin, end - begin);
+        } else {
+            m_buffer.write(begin, end - begin);
+        }
+    }
+
 public:
     std::shared_ptr<stream_type>
     stream() {
@@ -98,6 +165,9 @@ private:
     msgpack::sbuffer m_buffer;
     msgpack::packer<msgpack::sbuffer> m_packer;
 
+    // Scratch space for the statically encoded frames.
+    std::vector<char> m_frame;
+
     // Message buffer interlocking.
     std::mutex m_mutex;
 
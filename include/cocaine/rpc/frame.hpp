@@ -0,0 +1,463 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_IO_FRAME_HPP
+#define COCAINE_IO_FRAME_HPP
+
+#include "cocaine/common.hpp"
+
+#include "cocaine/rpc/protocol.hpp"
+#include "cocaine/rpc/tags.hpp"
+
+#include "cocaine/traits/literal.hpp"
+#include "cocaine/traits/typelist.hpp"
+
+#include <cstring>
+#include <type_traits>
+
+#include <boost/mpl/begin.hpp>
+#include <boost/mpl/count_if.hpp>
+#include <boost/mpl/deref.hpp>
+#include <boost/mpl/lambda.hpp>
+#include <boost/mpl/next.hpp>
+
+namespace cocaine { namespace io {
+
+// NOTE: The following is a specialized packing path for the events whose arguments are all of the
+// simple types below. For such events, the frame layout [ID, Band, [Args...]] is known at compile
+// time up to the band and the argument values, so instead of going through the generic packer and
+// its growing buffer, the frame is written with a few raw stores into a presized memory region.
+//
+// frame<Event>::size(args...) returns an upper bound of the encoded frame size, and
+// frame<Event>::pack(target, band, args...) encodes the frame and returns the end pointer.
+
+namespace detail {
+
+inline
+char*
+store8(char* target, uint8_t value) {
+    *target = static_cast<char>(value);
+    return target + 1;
+}
+
+inline
+char*
+store16(char* target, uint8_t prefix, uint16_t value) {
+    target[0] = static_cast<char>(prefix);
+    target[1] = static_cast<char>(value >> 8);
+    target[2] = static_cast<char>(value);
+    return target + 3;
+}
+
+inline
+char*
+store32(char* target, uint8_t prefix, uint32_t value) {
+    target[0] = static_cast<char>(prefix);
+    target[1] = static_cast<char>(value >> 24);
+    target[2] = static_cast<char>(value >> 16);
+    target[3] = static_cast<char>(value >> 8);
+    target[4] = static_cast<char>(value);
+    return target + 5;
+}
+
+inline
+char*
+store64(char* target, uint8_t prefix, uint64_t value) {
+    target[0] = static_cast<char>(prefix);
+
+    for(int i = 1; i <= 8; ++i) {
+        target[i] = static_cast<char>(value >> (64 - i * 8));
+    }
+
+    return target + 9;
+}
+
+// Same encoding choices as msgpack::packer<T>::pack_uint64() and pack_int64().
+
+inline
+char*
+pack_unsigned(char* target, uint64_t value) {
+    if(value < 128) {
+        return store8(target, static_cast<uint8_t>(value));
+    } else if(value < 256) {
+        return store8(store8(target, 0xCC), static_cast<uint8_t>(value));
+    } else if(value < 65536) {
+        return store16(target, 0xCD, static_cast<uint16_t>(value));
+    } else if(value < 4294967296ULL) {
+        return store32(target, 0xCE, static_cast<uint32_t>(value));
+    } else {
+        return store64(target, 0xCF, value);
+    }
+}
+
+inline
+char*
+pack_signed(char* target, int64_t value) {
+    if(value >= 0) {
+        return pack_unsigned(target, static_cast<uint64_t>(value));
+    } else if(value >= -32) {
+        return store8(target, static_cast<uint8_t>(value));
+    } else if(value >= -128) {
+        return store8(store8(target, 0xD0), static_cast<uint8_t>(value));
+    } else if(value >= -32768) {
+        return store16(target, 0xD1, static_cast<uint16_t>(value));
+    } else if(value >= -2147483648LL) {
+        return store32(target, 0xD2, static_cast<uint32_t>(value));
+    } else {
+        return store64(target, 0xD3, static_cast<uint64_t>(value));
+    }
+}
+
+inline
+char*
+pack_raw(char* target, const char* blob, size_t size) {
+    if(size < 32) {
+        target = store8(target, static_cast<uint8_t>(0xA0 | size));
+    } else if(size < 65536) {
+        target = store16(target, 0xDA, static_cast<uint16_t>(size));
+    } else {
+        target = store32(target, 0xDB, static_cast<uint32_t>(size));
+    }
+
+    std::memcpy(target, blob, size);
+
+    return target + size;
+}
+
+// Simple value encoders
+
+template<class T, class = void>
+struct frame_traits {
+    enum { enabled = false };
+};
+
+template<class T>
+struct frame_traits<
+    T,
+    typename std::enable_if<
+        std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T, bool>::value
+    >::type
+>
+{
+    enum { enabled = true };
+
+    static inline
+    size_t
+    size(const T& /* source */) {
+        return 9;
+    }
+
+    static inline
+    char*
+    pack(char* target, const T& source) {
+        return pack_unsigned(target, source);
+    }
+};
+
+template<class T>
+struct frame_traits<
+    T,
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+>
+{
+    enum { enabled = true };
+
+    static inline
+    size_t
+    size(const T& /* source */) {
+        return 9;
+    }
+
+    static inline
+    char*
+    pack(char* target, const T& source) {
+        return pack_signed(target, source);
+    }
+};
+
+// NOTE: Enumerations are packed as integers, see traits/enum.hpp.
+
+template<class T>
+struct frame_traits<
+    T,
+    typename std::enable_if<std::is_enum<T>::value>::type
+>
+{
+    enum { enabled = true };
+
+    static inline
+    size_t
+    size(const T& /* source */) {
+        return 9;
+    }
+
+    static inline
+    char*
+    pack(char* target, const T& source) {
+        return pack_signed(target, static_cast<int>(source));
+    }
+};
+
+template<>
+struct frame_traits<std::string> {
+    enum { enabled = true };
+
+    static inline
+    size_t
+    size(const std::string& source) {
+        return 5 + source.size();
+    }
+
+    static inline
+    char*
+    pack(char* target, const std::string& source) {
+        return pack_raw(target, source.data(), source.size());
+    }
+};
+
+template<>
+struct frame_traits<literal> {
+    enum { enabled = true };
+
+    static inline
+    size_t
+    size(const literal& source) {
+        return 5 + source.size;
+    }
+
+    static inline
+    char*
+    pack(char* target, const literal& source) {
+        return pack_raw(target, source.blob, source.size);
+    }
+};
+
+// NOTE: String literals drop the trailing zero, same as type_traits<char[N]>.
+
+template<size_t N>
+struct frame_traits<char[N]> {
+    enum { enabled = true };
+
+    static inline
+    size_t
+    size(const char* /* source */) {
+        return 5 + N - 1;
+    }
+
+    static inline
+    char*
+    pack(char* target, const char* source) {
+        return pack_raw(target, source, N - 1);
+    }
+};
+
+template<class T>
+struct strip {
+    typedef typename std::remove_const<
+        typename std::remove_reference<T>::type
+    >::type type;
+};
+
+// Same static checks as in the typelist serialization traits.
+
+template<class It, typename... Args>
+struct check_sequence {
+    enum { value = true };
+};
+
+template<class It, class Head, typename... Tail>
+struct check_sequence<It, Head, Tail...> {
+    static_assert(
+        std::is_convertible<
+            typename strip<Head>::type,
+            typename unwrap_type<typename boost::mpl::deref<It>::type>::type
+        >::value,
+        "sequence element type mismatch"
+    );
+
+    enum { value = check_sequence<typename boost::mpl::next<It>::type, Tail...>::value };
+};
+
+template<typename... Args>
+struct all_enabled;
+
+template<>
+struct all_enabled<> {
+    enum { value = true };
+};
+
+template<class Head, typename... Tail>
+struct all_enabled<Head, Tail...> {
+    enum { value = frame_traits<typename strip<Head>::type>::enabled && all_enabled<Tail...>::value };
+};
+
+inline
+size_t
+frame_size() {
+    return 0;
+}
+
+template<class Head, typename... Tail>
+inline
+size_t
+frame_size(const Head& head, const Tail&... tail) {
+    return frame_traits<typename strip<Head>::type>::size(head) + frame_size(tail...);
+}
+
+inline
+char*
+frame_pack(char* target) {
+    return target;
+}
+
+template<class Head, typename... Tail>
+inline
+char*
+frame_pack(char* target, const Head& head, const Tail&... tail) {
+    return frame_pack(frame_traits<typename strip<Head>::type>::pack(target, head), tail...);
+}
+
+} // namespace detail
+
+template<class Event>
+struct frame {
+    typedef event_traits<Event> traits;
+
+    enum constants {
+        // Maximum size of the [ID, Band, [...]] envelope: fixarray, fixint ID, uint64 band and
+        // the argument array header.
+        envelope = 1 + 1 + 9 + 1
+    };
+
+    enum {
+        minimal = boost::mpl::count_if<
+            typename traits::tuple_type,
+            boost::mpl::lambda<detail::is_required<boost::mpl::arg<1>>>
+        >::value
+    };
+
+    // Tells whether the given argument types can be packed using this path.
+    template<typename... Args>
+    struct is_static {
+        enum {
+            value = traits::id < 128 && sizeof...(Args) < 16 && detail::all_enabled<Args...>::value
+        };
+
+        typedef std::integral_constant<bool, value> type;
+    };
+
+    template<typename... Args>
+    static inline
+    size_t
+    size(const Args&... args) {
+        return envelope + detail::frame_size(args...);
+    }
+
+    template<typename... Args>
+    static inline
+    char*
+    pack(char* target, uint64_t band, const Args&... args) {
+        static_assert(traits::id < 128, "event id doesn't fit into a positive fixint");
+        static_assert(sizeof...(Args) >= minimal, "sequence length mismatch");
+        static_assert(sizeof...(Args) < 16, "sequence is too long for a fixarray");
+
+        static_assert(
+            detail::check_sequence<
+                typename boost::mpl::begin<typename traits::tuple_type>::type,
+                Args...
+            >::value,
+            "sequence element type mismatch"
+        );
+
+        // NOTE: Format is [ID, Band, [Args...]], the first two bytes are constant for the event.
+        target = detail::store8(target, 0x93);
+        target = detail::store8(target, traits::id);
+        target = detail::pack_unsigned(target, band);
+        target = detail::store8(target, 0x90 | sizeof...(Args));
+
+        return detail::frame_pack(target, args...);
+    }
+};
+
+// NOTE: A frame encoded once at construction time, for the events which are sent over and over with
+// the same arguments, like the slave terminate frames. Only the band differs between the copies, so
+// it is patched in place when the frame is emitted. Events without arguments, like heartbeats and
+// chokes, are already just a few stores through the static path above, so they can't be preencoded.
+
+template<class Event>
+struct preencoded {
+    COCAINE_DECLARE_NONCOPYABLE(preencoded)
+
+    typedef event_traits<Event> traits;
+
+    template<typename... Args>
+    explicit
+    preencoded(const Args&... args) {
+        static_assert(traits::id < 128, "event id doesn't fit into a positive fixint");
+        static_assert(sizeof...(Args) > 0, "events without arguments should use the static path");
+
+        msgpack::sbuffer buffer;
+        msgpack::packer<msgpack::sbuffer> packer(buffer);
+
+        // NOTE: Format is [ID, Band, [Args...]], with a zero band which packs into a single byte
+        // at the fixed offset, right after the fixarray and the event id.
+        packer.pack_array(3);
+
+        packer.pack_uint32(traits::id);
+        packer.pack_uint64(0);
+
+        type_traits<typename traits::tuple_type>::pack(packer, args...);
+
+        m_blob.assign(buffer.data(), buffer.size());
+    }
+
+    size_t
+    size() const {
+        // Upper bound, for the band of the maximum width.
+        return m_blob.size() + 8;
+    }
+
+    char*
+    pack(char* target, uint64_t band) const {
+        if(band < 128) {
+            std::memcpy(target, m_blob.data(), m_blob.size());
+
+            // Patch the band in place.
+            target[2] = static_cast<char>(band);
+
+            return target + m_blob.size();
+        }
+
+        std::memcpy(target, m_blob.data(), 2);
+
+        target = detail::pack_unsigned(target + 2, band);
+
+        std::memcpy(target, m_blob.data() + 3, m_blob.size() - 3);
+
+        return target + m_blob.size() - 3;
+    }
+
+private:
+    std::string m_blob;
+};
+
+}} // namespace cocaine::io
+
+#endif
@@ -47,11 +47,17 @@ using namespace cocaine::io;
 
 using namespace std::placeholders;
 
-struct actor_t::session_t {
+struct actor_t::session_t:
+    public std::enable_shared_from_this<actor_t::session_t>
+{
     friend class actor_t;
 
-    session_t(std::unique_ptr<io::channel<io::socket<io::tcp>>>&& ptr_, const std::shared_ptr<dispatch_t>& prototype_):
+    session_t(const std::shared_ptr<reactor_t>& reactor_, std::unique_ptr<io::channel<io::socket<io::tcp>>>&& ptr_,
+              const std::shared_ptr<dispatch_t>& prototype_):
+        reactor(reactor_),
         ptr(std::move(ptr_)),
+        throttled(false),
+        holds(0),
         prototype(prototype_)
     { }
 
@@ -60,6 +66,9 @@ struct actor_t::session_t {
         downstreams.erase(tag);
     }
 
+    void
+    pressure(bool throttled_);
+
 private:
     void
     invoke(const message_t& message) {
@@ -73,7 +82,7 @@ private:
             if(it == downstreams.end()) {
                 std::tie(it, std::ignore) = downstreams.insert({ message.band(), std::make_shared<downstream_t>(
                     prototype,
-                    std::make_shared<actor_t::upstream_t>(*this, message.band())
+                    std::make_shared<actor_t::upstream_t>(shared_from_this(), message.band())
                 )});
             }
 
@@ -91,6 +100,9 @@ private:
     destroy() {
         std::lock_guard<std::mutex> guard(mutex);
 
+        // NOTE: Nobody is going to read the remaining data anyway, so release the producers.
+        release();
+
         // This closes all the downstreams.
         downstreams.clear();
 
@@ -99,10 +111,27 @@ private:
         ptr.reset();
     }
 
+    void
+    release();
+
+    // NOTE: Must be called with the session lock held.
+    void
+    hold(bool paused);
+
+    struct flow_action_t;
+
 private:
+    const std::shared_ptr<reactor_t> reactor;
+
     std::unique_ptr<io::channel<io::socket<io::tcp>>> ptr;
     std::mutex mutex;
 
+    // Whether the client can't keep up with the outgoing data.
+    bool throttled;
+
+    // Number of the upstreams which can't keep up with the incoming data.
+    size_t holds;
+
     // Root dispatch
 
     const std::shared_ptr<dispatch_t> prototype;
@@ -132,47 +161,154 @@ private:
 struct actor_t::upstream_t:
     public api::stream_t
 {
-    upstream_t(session_t& session, uint64_t tag):
+    upstream_t(const std::shared_ptr<session_t>& session, uint64_t tag):
         m_state(state::open),
         m_session(session),
-        m_tag(tag)
+        m_tag(tag),
+        m_throttled(false),
+        m_paused(false)
     { }
 
     virtual
     void
     write(const char* chunk, size_t size) {
-        std::lock_guard<std::mutex> guard(m_session.mutex);
+        const std::shared_ptr<session_t> session = m_session.lock();
+
+        if(!session) {
+            return;
+        }
 
-        if(m_state == state::open && m_session.ptr) {
-            m_session.ptr->wr->write<rpc::chunk>(m_tag, literal { chunk, size });
+        std::lock_guard<std::mutex> guard(session->mutex);
+
+        if(m_state == state::open && session->ptr) {
+            session->ptr->wr->write<rpc::chunk>(m_tag, literal { chunk, size });
         }
     }
 
     virtual
     void
     error(int code, const std::string& reason) {
-        std::lock_guard<std::mutex> guard(m_session.mutex);
+        const std::shared_ptr<session_t> session = m_session.lock();
+
+        if(!session) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(session->mutex);
 
-        if(m_state == state::open && m_session.ptr) {
-            m_session.ptr->wr->write<rpc::error>(m_tag, code, reason);
+        if(m_state == state::open && session->ptr) {
+            session->ptr->wr->write<rpc::error>(m_tag, code, reason);
         }
     }
 
     virtual
     void
     close() {
-        std::lock_guard<std::mutex> guard(m_session.mutex);
+        const std::shared_ptr<session_t> session = m_session.lock();
+
+        if(!session) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(session->mutex);
 
         if(m_state == state::open) {
-            if(m_session.ptr) {
-                m_session.ptr->wr->write<rpc::choke>(m_tag);
+            if(session->ptr) {
+                session->ptr->wr->write<rpc::choke>(m_tag);
             }
 
             // Destroys the session with the given tag in the stream, so that new requests might
             // reuse the tag in the future.
-            m_session.detach(m_tag);
+            session->detach(m_tag);
 
             m_state = state::closed;
+
+            // Nothing will be written here anymore, so the producer must not be left throttled.
+            notify(false);
+
+            m_watcher = nullptr;
+
+            // Neither will anything be read, so the client must not be left paused.
+            if(m_paused) {
+                m_paused = false;
+                session->hold(false);
+            }
+        }
+    }
+
+    virtual
+    void
+    pause() {
+        const std::shared_ptr<session_t> session = m_session.lock();
+
+        if(!session) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(session->mutex);
+
+        if(m_state == state::open && !m_paused) {
+            m_paused = true;
+            session->hold(true);
+        }
+    }
+
+    virtual
+    void
+    resume() {
+        const std::shared_ptr<session_t> session = m_session.lock();
+
+        if(!session) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(session->mutex);
+
+        if(m_paused) {
+            m_paused = false;
+            session->hold(false);
+        }
+    }
+
+    virtual
+    void
+    watch(const pressure_handler_t& handler) {
+        const std::shared_ptr<session_t> session = m_session.lock();
+
+        if(!session) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(session->mutex);
+
+        if(m_state == state::open) {
+            m_watcher = handler;
+
+            // Catch up with the current client state.
+            notify(session->throttled);
+        }
+    }
+
+    virtual
+    bool
+    closed() const {
+        const std::shared_ptr<session_t> session = m_session.lock();
+
+        if(!session) {
+            return true;
+        }
+
+        std::lock_guard<std::mutex> guard(session->mutex);
+
+        return m_state == state::closed || !session->ptr;
+    }
+
+    // NOTE: Must be called with the session lock held.
+    void
+    notify(bool throttled) {
+        if(m_watcher && m_throttled != throttled) {
+            m_throttled = throttled;
+            m_watcher(throttled);
         }
     }
 
@@ -184,10 +320,76 @@ private:
     // Upstream state.
     state::value m_state;
 
-    session_t& m_session;
+    // NOTE: The session is destroyed when the client disconnects, but the upstreams might be kept by
+    // the services for longer, so they must not keep the session alive or touch it afterwards.
+    const std::weak_ptr<session_t> m_session;
     const uint64_t m_tag;
+
+    // Producer backpressure.
+    pressure_handler_t m_watcher;
+    bool m_throttled;
+
+    // Consumer backpressure.
+    bool m_paused;
+};
+
+// NOTE: The session reader can only be touched on the reactor thread, while the upstreams might be
+// paused and resumed from any thread. So the actual state is applied later, whatever it is by then.
+
+struct actor_t::session_t::flow_action_t {
+    void
+    operator()() const {
+        const std::shared_ptr<session_t> session = ptr.lock();
+
+        if(!session) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(session->mutex);
+
+        if(!session->ptr) {
+            return;
+        }
+
+        if(session->holds) {
+            session->ptr->rd->stream()->pause();
+        } else {
+            session->ptr->rd->stream()->resume();
+        }
+    }
+
+    const std::weak_ptr<session_t> ptr;
 };
 
+void
+actor_t::session_t::pressure(bool throttled_) {
+    std::lock_guard<std::mutex> guard(mutex);
+
+    throttled = throttled_;
+
+    for(auto it = downstreams.begin(); it != downstreams.end(); ++it) {
+        it->second->upstream->notify(throttled);
+    }
+}
+
+void
+actor_t::session_t::release() {
+    throttled = false;
+
+    for(auto it = downstreams.begin(); it != downstreams.end(); ++it) {
+        it->second->upstream->notify(false);
+    }
+}
+
+void
+actor_t::session_t::hold(bool paused) {
+    if(paused ? holds++ != 0 : --holds != 0) {
+        return;
+    }
+
+    reactor->post(flow_action_t { shared_from_this() });
+}
+
 void
 actor_t::session_t::downstream_t::invoke(const message_t& message) {
     try {
@@ -335,10 +537,11 @@ actor_t::on_connection(const std::shared_ptr<io::socket<tcp>>& socket_) {
     );
 
     ptr->wr->bind(
-        std::bind(&actor_t::on_failure, this, fd, _1)
+        std::bind(&actor_t::on_failure, this, fd, _1),
+        std::bind(&actor_t::on_pressure, this, fd, _1)
     );
 
-    m_sessions[fd] = std::make_unique<session_t>(std::move(ptr), m_prototype);
+    m_sessions[fd] = std::make_shared<session_t>(m_reactor, std::move(ptr), m_prototype);
 }
 
 void
@@ -350,6 +553,24 @@ actor_t::on_message(int fd, const message_t& message) {
     it->second->invoke(message);
 }
 
+void
+actor_t::on_pressure(int fd, bool throttled) {
+    auto it = m_sessions.find(fd);
+
+    if(it == m_sessions.end()) {
+        // The client has already disconnected.
+        return;
+    }
+
+    if(throttled) {
+        COCAINE_LOG_DEBUG(m_log, "client on fd %d can't keep up, throttling the producers", fd);
+    } else {
+        COCAINE_LOG_DEBUG(m_log, "client on fd %d has caught up, releasing the producers", fd);
+    }
+
+    it->second->pressure(throttled);
+}
+
 void
 actor_t::on_failure(int fd, const std::error_code& ec) {
     auto it = m_sessions.find(fd);
@@ -368,7 +589,7 @@ actor_t::on_failure(int fd, const std::error_code& ec) {
     // This destroys the channel but not the wrapping lockable state.
     it->second->destroy();
 
-    // This doesn't guarantee that the wrapping lockable state will be deleted, as it can be shared
-    // with other threads via upstreams, but it's fine since the channel is destroyed.
+    // This doesn't guarantee that the wrapping lockable state will be deleted, as it can be in use
+    // by other threads via upstreams, but it's fine since the channel is destroyed.
     m_sessions.erase(it);
 }
@@ -133,6 +133,12 @@ struct app_t::service_t:
         on<io::app::info>(std::bind(&app_t::info, std::ref(app)));
     }
 
+    virtual
+    size_t
+    load() const {
+        return app.m_engine->outstanding();
+    }
+
 private:
     std::shared_ptr<dispatch_t>
     enqueue(const api::stream_ptr_t& upstream, const std::string& event, const std::string& tag) {
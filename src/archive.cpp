@@ -23,23 +23,116 @@
 #include "cocaine/context.hpp"
 #include "cocaine/logging.hpp"
 
+#include <cstring>
+
+#include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 
 #include <archive.h>
 #include <archive_entry.h>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace cocaine;
 
 namespace fs = boost::filesystem;
 
+namespace {
+
+// The deployed files are compared with the archive entries in blocks of this size.
+const size_t block_size = 64 * 1024;
+
+struct descriptor_t {
+    COCAINE_DECLARE_NONCOPYABLE(descriptor_t)
+
+    explicit
+    descriptor_t(int fd_):
+        fd(fd_)
+    { }
+
+   ~descriptor_t() {
+        if(fd != -1) {
+            ::close(fd);
+        }
+    }
+
+    const int fd;
+};
+
+// Reads exactly the given number of bytes, returns false on a short read.
+bool
+pread_all(int fd, char* data, size_t size, off_t offset) {
+    while(size) {
+        const ssize_t length = ::pread(fd, data, size, offset);
+
+        if(length == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if(length <= 0) {
+            return false;
+        }
+
+        data += length;
+        size -= length;
+        offset += length;
+    }
+
+    return true;
+}
+
+// Strips the "." components, so that the entry paths can be compared to the ones found on disk.
+fs::path
+normalize(const fs::path& path) {
+    fs::path result;
+
+    for(auto it = path.begin(); it != path.end(); ++it) {
+        if(*it != "." && !it->empty()) {
+            result /= *it;
+        }
+    }
+
+    return result;
+}
+
+}
+
 archive_error_t::archive_error_t(archive* source):
     std::runtime_error(archive_error_string(source))
 { }
 
+archive_error_t::archive_error_t(const std::string& reason):
+    std::runtime_error(reason)
+{ }
+
 archive_t::archive_t(context_t& context, const std::string& archive):
     m_log(new logging::log_t(context, "packaging")),
     m_archive(archive_read_new())
 {
+    open(archive.data(), archive.size());
+}
+
+archive_t::archive_t(context_t& context, const char* data, size_t size):
+    m_log(new logging::log_t(context, "packaging")),
+    m_archive(archive_read_new())
+{
+    open(data, size);
+}
+
+archive_t::~archive_t() {
+    archive_read_close(m_archive);
+
+#if ARCHIVE_VERSION_NUMBER < 3000000
+    archive_read_finish(m_archive);
+#else
+    archive_read_free(m_archive);
+#endif
+}
+
+void
+archive_t::open(const char* data, size_t size) {
 #if ARCHIVE_VERSION_NUMBER < 3000000
     archive_read_support_compression_all(m_archive);
 #else
@@ -50,25 +143,15 @@ archive_t::archive_t(context_t& context, const std::string& archive):
 
     const int rv = archive_read_open_memory(
         m_archive,
-        const_cast<char*>(archive.data()),
-        archive.size()
+        const_cast<char*>(data),
+        size
     );
 
     if(rv != ARCHIVE_OK) {
         throw archive_error_t(m_archive);
     }
 
-    COCAINE_LOG_INFO(m_log, "compression: %s, size: %llu bytes", type(), archive.size());
-}
-
-archive_t::~archive_t() {
-    archive_read_close(m_archive);
-
-#if ARCHIVE_VERSION_NUMBER < 3000000
-    archive_read_finish(m_archive);
-#else
-    archive_read_free(m_archive);
-#endif
+    COCAINE_LOG_INFO(m_log, "compression: %s, size: %llu bytes", type(), size);
 }
 
 void
@@ -80,13 +163,21 @@ archive_t::deploy(const std::string& prefix_) {
 
     int rv = ARCHIVE_OK;
 
+    // NOTE: The existing files are unlinked rather than truncated, so that the changed ones could
+    // still be read while being replaced.
     int flags = ARCHIVE_EXTRACT_TIME |
+                ARCHIVE_EXTRACT_UNLINK |
                 ARCHIVE_EXTRACT_SECURE_SYMLINKS |
                 ARCHIVE_EXTRACT_SECURE_NODOTDOT;
 
     archive_write_disk_set_options(target, flags);
     archive_write_disk_set_standard_lookup(target);
 
+    size_t skipped = 0;
+
+    // Everything else found in the target directory is left from the previous versions.
+    std::set<std::string> deployed;
+
     while(true) {
         rv = archive_read_next_header(m_archive, &entry);
 
@@ -110,20 +201,15 @@ archive_t::deploy(const std::string& prefix_) {
             archive_entry_set_hardlink(entry, hardlink.string().c_str());
         }
 
-        COCAINE_LOG_DEBUG(m_log, "extracting %s", pathname);
-
-        rv = archive_write_header(target, entry);
-
-        if(rv != ARCHIVE_OK) {
-            throw archive_error_t(target);
-        } else if(archive_entry_size(entry) > 0) {
-            extract(m_archive, target);
+        for(fs::path path = normalize(pathname); path != prefix && !path.empty(); path = path.parent_path()) {
+            deployed.insert(path.string());
         }
 
-        rv = archive_write_finish_entry(target);
-
-        if(rv != ARCHIVE_OK) {
-            throw archive_error_t(target);
+        if(!update(m_archive, target, entry, pathname.string())) {
+            COCAINE_LOG_DEBUG(m_log, "skipping %s - unchanged", pathname);
+            ++skipped;
+        } else {
+            COCAINE_LOG_DEBUG(m_log, "extracted %s", pathname);
         }
     }
 
@@ -137,7 +223,161 @@ archive_t::deploy(const std::string& prefix_) {
 
     const size_t count = archive_file_count(m_archive);
 
-    COCAINE_LOG_INFO(m_log, "extracted %d %s", count, count == 1 ? "file" : "files");
+    COCAINE_LOG_INFO(
+        m_log,
+        "extracted %d %s, %d unchanged",
+        count - skipped,
+        count - skipped == 1 ? "file" : "files",
+        skipped
+    );
+
+    prune(normalize(prefix).string(), deployed);
+}
+
+void
+archive_t::prune(const std::string& prefix, const std::set<std::string>& deployed) {
+    std::vector<fs::path> stale;
+
+    size_t removed = 0;
+
+    try {
+        for(fs::recursive_directory_iterator it(prefix), end; it != end; ++it) {
+            if(!deployed.count(it->path().string())) {
+                stale.push_back(it->path());
+            }
+        }
+
+        // NOTE: The stale directories are removed along with their contents, so the paths inside them
+        // might be gone by the time they're reached.
+        for(auto it = stale.begin(); it != stale.end(); ++it) {
+            if(fs::symlink_status(*it).type() != fs::file_not_found) {
+                COCAINE_LOG_DEBUG(m_log, "removing %s - no longer in the archive", *it);
+                fs::remove_all(*it);
+                ++removed;
+            }
+        }
+    } catch(const fs::filesystem_error& e) {
+        throw archive_error_t(cocaine::format("unable to remove the stale files - %s", e.what()));
+    }
+
+    if(removed) {
+        COCAINE_LOG_INFO(m_log, "removed %d stale %s", removed, removed == 1 ? "file" : "files");
+    }
+}
+
+bool
+archive_t::update(archive* source, archive* target, archive_entry* entry, const std::string& pathname) {
+    struct stat info;
+
+    // NOTE: Only the plain files are worth skipping, everything else is cheap to recreate anyway. The
+    // files of a different size or mode are evidently changed, the rest are compared block by block,
+    // as neither the sizes nor the modification times can tell apart the different contents.
+    const bool comparable = archive_entry_filetype(entry) == AE_IFREG &&
+                            !archive_entry_hardlink(entry) &&
+                            ::lstat(pathname.c_str(), &info) == 0 &&
+                            S_ISREG(info.st_mode) &&
+                            archive_entry_size(entry) == info.st_size &&
+                            (archive_entry_perm(entry) & 07777) == (info.st_mode & 07777);
+
+    // NOTE: The existing file is replaced with a new one on extraction, so it's still readable via
+    // this descriptor afterwards.
+    descriptor_t existing(comparable ? ::open(pathname.c_str(), O_RDONLY | O_CLOEXEC) : -1);
+
+    if(existing.fd == -1) {
+        rewrite(target, entry, -1, 0);
+
+        if(archive_entry_size(entry) > 0) {
+            extract(source, target);
+        }
+
+        finish(target);
+
+        return true;
+    }
+
+    std::vector<char> scratch;
+
+    const void* buffer = nullptr;
+    size_t size = 0;
+
+#if ARCHIVE_VERSION_NUMBER < 3000000
+    off_t offset = 0;
+#else
+    int64_t offset = 0;
+#endif
+
+    off_t position = 0;
+
+    while(true) {
+        const int rv = archive_read_data_block(source, &buffer, &size, &offset);
+
+        if(rv == ARCHIVE_EOF) {
+            break;
+        } else if(rv != ARCHIVE_OK) {
+            throw archive_error_t(source);
+        }
+
+        scratch.resize(size);
+
+        if(offset == position &&
+           pread_all(existing.fd, scratch.data(), size, offset) &&
+           std::memcmp(scratch.data(), buffer, size) == 0)
+        {
+            position += size;
+            continue;
+        }
+
+        // The file is changed starting from this position. Everything up to it is the same, so it's
+        // copied over from the existing file, as this part of the entry has already been consumed.
+        rewrite(target, entry, existing.fd, position);
+
+        if(archive_write_data_block(target, buffer, size, offset) != ARCHIVE_OK) {
+            throw archive_error_t(target);
+        }
+
+        extract(source, target);
+        finish(target);
+
+        return true;
+    }
+
+    if(position != archive_entry_size(entry)) {
+        // Sparse entries might end with a hole.
+        rewrite(target, entry, existing.fd, position);
+        finish(target);
+
+        return true;
+    }
+
+    return false;
+}
+
+void
+archive_t::rewrite(archive* target, archive_entry* entry, int fd, off_t size) {
+    if(archive_write_header(target, entry) != ARCHIVE_OK) {
+        throw archive_error_t(target);
+    }
+
+    std::vector<char> block(block_size);
+
+    for(off_t offset = 0; offset < size; offset += block_size) {
+        const size_t length = std::min<off_t>(block_size, size - offset);
+
+        if(!pread_all(fd, block.data(), length, offset)) {
+            throw archive_error_t(cocaine::format("unable to read '%s'", archive_entry_pathname(entry)));
+        }
+
+        if(archive_write_data_block(target, block.data(), length, offset) != ARCHIVE_OK) {
+            throw archive_error_t(target);
+        }
+    }
+}
+
+void
+archive_t::finish(archive* target) {
+    if(archive_write_finish_entry(target) != ARCHIVE_OK) {
+        throw archive_error_t(target);
+    }
 }
 
 void
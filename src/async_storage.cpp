@@ -0,0 +1,114 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/detail/async_storage.hpp"
+
+#include "cocaine/detail/executor.hpp"
+
+using namespace cocaine;
+
+namespace {
+
+template<class R>
+struct complete_action {
+    void
+    operator()() {
+        try {
+            result.write(operation());
+        } catch(const std::exception& e) {
+            result.abort(invocation_error, e.what());
+        }
+    }
+
+    deferred<R> result;
+    std::function<R()> operation;
+};
+
+template<>
+struct complete_action<void> {
+    void
+    operator()() {
+        try {
+            operation();
+        } catch(const std::exception& e) {
+            result.abort(invocation_error, e.what());
+            return;
+        }
+
+        result.close();
+    }
+
+    deferred<void> result;
+    std::function<void()> operation;
+};
+
+}
+
+async_storage_t::async_storage_t(const api::category_traits<api::storage_t>::ptr_type& storage, executor_t& executor):
+    m_storage(storage),
+    m_executor(executor)
+{ }
+
+deferred<std::string>
+async_storage_t::read(const std::string& collection, const std::string& key) {
+    return submit<std::string>(std::bind(&api::storage_t::read, m_storage, collection, key));
+}
+
+deferred<void>
+async_storage_t::write(const std::string& collection, const std::string& key, const std::string& blob, const std::vector<std::string>& tags) {
+    return submit<void>(std::bind(&api::storage_t::write, m_storage, collection, key, blob, tags));
+}
+
+deferred<void>
+async_storage_t::remove(const std::string& collection, const std::string& key) {
+    return submit<void>(std::bind(&api::storage_t::remove, m_storage, collection, key));
+}
+
+deferred<std::vector<std::string>>
+async_storage_t::find(const std::string& collection, const std::vector<std::string>& tags) {
+    return submit<std::vector<std::string>>(std::bind(&api::storage_t::find, m_storage, collection, tags));
+}
+
+deferred<std::map<std::string, std::string>>
+async_storage_t::read_many(const std::string& collection, const std::vector<std::string>& keys) {
+    return submit<std::map<std::string, std::string>>(std::bind(&api::storage_t::read_many, m_storage, collection, keys));
+}
+
+deferred<void>
+async_storage_t::write_many(const std::string& collection, const std::map<std::string, std::string>& objects, const std::vector<std::string>& tags) {
+    return submit<void>(std::bind(&api::storage_t::write_many, m_storage, collection, objects, tags));
+}
+
+deferred<void>
+async_storage_t::remove_many(const std::string& collection, const std::vector<std::string>& keys) {
+    return submit<void>(std::bind(&api::storage_t::remove_many, m_storage, collection, keys));
+}
+
+template<class R>
+deferred<R>
+async_storage_t::submit(const std::function<R()>& operation) {
+    complete_action<R> action = { deferred<R>(), operation };
+
+    if(!m_executor.post(action)) {
+        action.result.abort(invocation_error, "storage is overloaded");
+    }
+
+    return action.result;
+}
@@ -49,9 +49,18 @@ auth_t::auth_t(context_t& context):
         return;
     }
 
+    // NOTE: Fetch all the keys at once, instead of doing a storage round trip for each one.
+    const std::map<std::string, std::string> objects = storage->get_many<std::string>("keys", keys);
+
     for(auto it = keys.cbegin(); it != keys.cend(); ++it) {
-        const std::string identity = *it;
-        const std::string object = storage->get<std::string>("keys", identity);
+        if(!objects.count(*it)) {
+            COCAINE_LOG_ERROR(m_log, "key for user '%s' is missing", *it);
+        }
+    }
+
+    for(auto it = objects.cbegin(); it != objects.cend(); ++it) {
+        const std::string& identity = it->first;
+        const std::string& object = it->second;
 
         if(object.empty()) {
             COCAINE_LOG_ERROR(m_log, "key for user '%s' is malformed", identity);
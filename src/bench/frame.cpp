@@ -0,0 +1,245 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/common.hpp"
+#include "cocaine/messages.hpp"
+
+#include "cocaine/rpc/encoder.hpp"
+#include "cocaine/rpc/frame.hpp"
+
+#include "cocaine/traits/enum.hpp"
+#include "cocaine/traits/typelist.hpp"
+
+#include <chrono>
+#include <iostream>
+
+#include <boost/program_options.hpp>
+
+using namespace cocaine;
+
+namespace po = boost::program_options;
+
+// NOTE: Frame packing benchmark. Encodes the same RPC events over and over into a sink which only
+// counts the bytes, once through the statically generated frame<Event> path and once through the
+// generic msgpack packer, which is what the encoder used for every event before, and prints the time
+// per frame for both. The two paths are checked to produce identical frames first.
+
+namespace {
+
+#if defined(__clang__) || defined(HAVE_GCC47)
+typedef std::chrono::steady_clock clock_type;
+#else
+typedef std::chrono::monotonic_clock clock_type;
+#endif
+
+struct options_t {
+    uint64_t iterations;
+
+    // Size of the chunk and the error message payloads.
+    unsigned int size;
+};
+
+struct null_stream_t {
+    null_stream_t():
+        total(0),
+        capture(false)
+    { }
+
+    void
+    write(const char* data, size_t size) {
+        total += size;
+
+        if(capture) {
+            last.assign(data, size);
+        }
+    }
+
+    uint64_t total;
+
+    // Only used for the verification, to keep the copies out of the measurements.
+    bool capture;
+    std::string last;
+};
+
+template<class Event>
+struct static_path_t {
+    static_path_t():
+        scratch(1024)
+    { }
+
+    template<typename... Args>
+    void
+    operator()(uint64_t band, const Args&... args) {
+        const size_t size = io::frame<Event>::size(args...);
+
+        if(scratch.size() < size) {
+            scratch.resize(size);
+        }
+
+        const char* end = io::frame<Event>::pack(scratch.data(), band, args...);
+
+        sink.write(scratch.data(), end - scratch.data());
+    }
+
+    std::vector<char> scratch;
+    null_stream_t sink;
+};
+
+template<class Event>
+struct dynamic_path_t {
+    typedef io::event_traits<Event> traits;
+
+    dynamic_path_t():
+        packer(buffer)
+    { }
+
+    template<typename... Args>
+    void
+    operator()(uint64_t band, const Args&... args) {
+        // NOTE: Same as the generic path in encoder<Stream>::pack().
+        packer.pack_array(3);
+
+        packer.pack_uint32(traits::id);
+        packer.pack_uint64(band);
+
+        io::type_traits<typename traits::tuple_type>::pack(packer, args...);
+
+        sink.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    msgpack::sbuffer buffer;
+    msgpack::packer<msgpack::sbuffer> packer;
+
+    null_stream_t sink;
+};
+
+template<class Path, typename... Args>
+double
+measure(Path& path, uint64_t iterations, const Args&... args) {
+    const clock_type::time_point start = clock_type::now();
+
+    // NOTE: The band grows, so that all the band widths are covered, as in a real session.
+    for(uint64_t band = 0; band < iterations; ++band) {
+        path(band, args...);
+    }
+
+    const double elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock_type::now() - start
+    ).count();
+
+    return elapsed / iterations;
+}
+
+template<class Event, typename... Args>
+bool
+compare(const std::string& name, const options_t& options, const Args&... args) {
+    static_path_t<Event> fast;
+    dynamic_path_t<Event> slow;
+
+    const uint64_t bands[] = { 0, 127, 128, 65536, 1ULL << 40 };
+
+    fast.sink.capture = slow.sink.capture = true;
+
+    for(size_t i = 0; i < sizeof(bands) / sizeof(bands[0]); ++i) {
+        fast(bands[i], args...);
+        slow(bands[i], args...);
+
+        if(fast.sink.last != slow.sink.last) {
+            std::cerr << cocaine::format("ERROR: '%s' frames differ for band %llu.", name, bands[i]) << std::endl;
+            return false;
+        }
+    }
+
+    fast.sink.capture = slow.sink.capture = false;
+
+    const double fast_ns = measure(fast, options.iterations, args...);
+    const double slow_ns = measure(slow, options.iterations, args...);
+
+    std::cout << cocaine::format(
+        "%-10s static %7.1f ns, dynamic %7.1f ns, speedup %.2fx, %llu bytes",
+        name,
+        fast_ns,
+        slow_ns,
+        slow_ns / fast_ns,
+        fast.sink.total
+    ) << std::endl;
+
+    return true;
+}
+
+int
+run(const options_t& options) {
+    const std::string payload(options.size, 'x');
+
+    std::cout << cocaine::format(
+        "Packing %llu frames of every kind with %d byte payloads",
+        options.iterations,
+        options.size
+    ) << std::endl;
+
+    bool success = true;
+
+    success &= compare<io::rpc::heartbeat>("heartbeat", options);
+    success &= compare<io::rpc::choke>("choke", options);
+    success &= compare<io::rpc::invoke>("invoke", options, std::string("method"));
+    success &= compare<io::rpc::chunk>("chunk", options, payload);
+    success &= compare<io::rpc::error>("error", options, 42, payload);
+    success &= compare<io::rpc::terminate>("terminate", options, io::rpc::terminate::normal, payload);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+}
+
+int
+main(int argc, char* argv[]) {
+    po::options_description general_options("General options");
+    po::variables_map vm;
+
+    options_t options;
+
+    general_options.add_options()
+        ("help,h", "show this message")
+        ("iterations,n", po::value<uint64_t>(&options.iterations)->default_value(10000000),
+            "number of frames of every kind")
+        ("size,s", po::value<unsigned int>(&options.size)->default_value(64), "payload size in bytes");
+
+    try {
+        po::store(po::command_line_parser(argc, argv).options(general_options).run(), vm);
+        po::notify(vm);
+    } catch(const po::error& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(vm.count("help")) {
+        std::cout << cocaine::format("USAGE: %s [options]", argv[0]) << std::endl;
+        std::cout << general_options;
+        return EXIT_SUCCESS;
+    }
+
+    if(!options.iterations) {
+        std::cerr << "ERROR: at least one iteration is required." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return run(options);
+}
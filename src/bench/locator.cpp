@@ -0,0 +1,515 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/common.hpp"
+
+#include "cocaine/api/storage.hpp"
+
+#include "cocaine/asio/socket.hpp"
+#include "cocaine/asio/tcp.hpp"
+
+#include "cocaine/context.hpp"
+#include "cocaine/dispatch.hpp"
+#include "cocaine/memory.hpp"
+#include "cocaine/messages.hpp"
+
+#include "cocaine/detail/actor.hpp"
+
+#include "cocaine/rpc/encoder.hpp"
+#include "cocaine/rpc/message.hpp"
+
+#if defined(__clang__) || defined(HAVE_GCC46)
+    #include <atomic>
+#else
+    #include <cstdatomic>
+#endif
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+using namespace cocaine;
+
+namespace fs = boost::filesystem;
+namespace po = boost::program_options;
+
+// NOTE: Locator benchmark. Starts an in-process runtime with the given number of dummy services and
+// routing groups, then hammers its locator over the loopback interface from a bunch of client threads
+// for a while, and prints the throughput and the latency percentiles.
+
+namespace {
+
+#if defined(__clang__) || defined(HAVE_GCC47)
+typedef std::chrono::steady_clock clock_type;
+#else
+typedef std::chrono::monotonic_clock clock_type;
+#endif
+
+struct options_t {
+    std::string operation;
+
+    unsigned int threads;
+    unsigned int services;
+    unsigned int groups;
+
+    float duration;
+
+    uint16_t port;
+};
+
+// Services
+
+struct dummy_t:
+    public dispatch_t
+{
+    dummy_t(context_t& context, const std::string& name):
+        dispatch_t(context, name)
+    { }
+};
+
+// Clients
+
+struct blocking_stream_t {
+    explicit
+    blocking_stream_t(int fd_):
+        fd(fd_)
+    { }
+
+    void
+    write(const char* data, size_t size) {
+        while(size) {
+            const ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+
+            if(sent == -1) {
+                if(errno == EINTR) {
+                    continue;
+                }
+
+                throw std::system_error(errno, std::system_category(), "unable to send a request");
+            }
+
+            data += sent;
+            size -= sent;
+        }
+    }
+
+    const int fd;
+};
+
+class client_t {
+    COCAINE_DECLARE_NONCOPYABLE(client_t)
+
+    public:
+        explicit
+        client_t(const io::tcp::endpoint& endpoint):
+            m_socket(endpoint),
+            m_band(0),
+            m_offset(0),
+            m_size(0)
+        {
+            // The clients are much simpler when blocking.
+            ::fcntl(m_socket.fd(), F_SETFL, 0);
+
+            m_encoder.attach(std::make_shared<blocking_stream_t>(m_socket.fd()));
+            m_buffer.resize(65536);
+        }
+
+        // Sends the request and waits either for the end of the response, or for its first chunk in
+        // case of the streaming methods.
+        template<class Event, typename... Args>
+        void
+        call(bool streaming, const Args&... args) {
+            const uint64_t band = ++m_band;
+
+            m_encoder.write<Event>(band, args...);
+
+            while(true) {
+                const unsigned int id = next(band);
+
+                if(id == io::event_traits<io::rpc::error>::id) {
+                    throw cocaine::error_t("the locator has responded with an error");
+                }
+
+                if(id == io::event_traits<io::rpc::choke>::id || streaming) {
+                    return;
+                }
+            }
+        }
+
+    private:
+        // Returns the id of the next message on the given band, skipping all the others.
+        unsigned int
+        next(uint64_t band) {
+            while(true) {
+                if(m_offset != m_size) {
+                    msgpack::zone zone;
+                    msgpack::object object;
+
+                    size_t offset = m_offset;
+
+                    const msgpack::unpack_return rv = msgpack::unpack(
+                        m_buffer.data(),
+                        m_size,
+                        &offset,
+                        &zone,
+                        &object
+                    );
+
+                    if(rv == msgpack::UNPACK_PARSE_ERROR) {
+                        throw cocaine::error_t("unable to decode a response");
+                    }
+
+                    if(rv != msgpack::UNPACK_CONTINUE) {
+                        m_offset = offset;
+
+                        const io::message_t message(object);
+
+                        if(message.band() == band) {
+                            return message.id();
+                        }
+
+                        continue;
+                    }
+                }
+
+                // Compact the buffer and read some more.
+                std::copy(m_buffer.begin() + m_offset, m_buffer.begin() + m_size, m_buffer.begin());
+
+                m_size -= m_offset;
+                m_offset = 0;
+
+                if(m_size == m_buffer.size()) {
+                    m_buffer.resize(m_buffer.size() * 2);
+                }
+
+                const ssize_t length = ::recv(m_socket.fd(), m_buffer.data() + m_size, m_buffer.size() - m_size, 0);
+
+                if(length == -1 && errno == EINTR) {
+                    continue;
+                }
+
+                if(length <= 0) {
+                    throw cocaine::error_t("the locator has closed the connection");
+                }
+
+                m_size += length;
+            }
+        }
+
+    private:
+        io::socket<io::tcp> m_socket;
+        io::encoder<blocking_stream_t> m_encoder;
+
+        uint64_t m_band;
+
+        // Receive buffer, with the unparsed data in [m_offset, m_size).
+        std::vector<char> m_buffer;
+
+        size_t m_offset;
+        size_t m_size;
+};
+
+struct worker_t {
+    void
+    operator()() {
+        const io::tcp::endpoint endpoint = {
+            boost::asio::ip::address::from_string("127.0.0.1"),
+            options.port
+        };
+
+        size_t counter = 0;
+
+        try {
+            client_t client(endpoint);
+
+            while(clock_type::now() < deadline) {
+                const clock_type::time_point start = clock_type::now();
+
+                if(options.operation == "resolve") {
+                    client.call<io::locator::resolve>(false, targets[counter++ % targets.size()]);
+                } else if(options.operation == "reports") {
+                    client.call<io::locator::reports>(false);
+                } else {
+                    // NOTE: Synchronization streams never end, so only the initial dump is waited for.
+                    // The locator keeps all of them open, so its memory grows during the run.
+                    client.call<io::locator::synchronize>(true);
+                }
+
+                latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                    clock_type::now() - start
+                ).count());
+            }
+        } catch(const std::exception& e) {
+            std::cerr << cocaine::format("ERROR: client has failed - %s.", e.what()) << std::endl;
+            ++failures;
+        }
+    }
+
+    const options_t& options;
+    const std::vector<std::string>& targets;
+    const clock_type::time_point deadline;
+
+    std::vector<uint64_t>& latencies;
+    std::atomic<unsigned int>& failures;
+};
+
+// Setup
+
+void
+configure(const fs::path& root, const options_t& options, bool cluster) {
+    Json::Value config;
+
+    config["version"] = 2;
+
+    config["paths"]["plugins"] = (root / "plugins").string();
+    config["paths"]["runtime"] = (root / "runtime").string();
+
+    config["locator"]["endpoint"] = "127.0.0.1";
+    config["locator"]["port"] = options.port;
+
+    if(cluster) {
+        // NOTE: Enables the synchronization methods, the gateway is not required for that.
+        config["network"]["group"] = "227.1.1.1";
+    }
+
+    config["loggers"]["core"]["type"] = "files";
+    config["loggers"]["core"]["args"]["path"] = (root / "bench.log").string();
+    config["loggers"]["core"]["args"]["verbosity"] = "warning";
+
+    config["storages"]["core"]["type"] = "files";
+    config["storages"]["core"]["args"]["path"] = (root / "storage").string();
+
+    std::ofstream stream((root / "cocaine.conf").string().c_str());
+
+    stream << Json::StyledWriter().write(config);
+}
+
+std::string
+service_name(unsigned int index) {
+    return cocaine::format("bench-service-%d", index);
+}
+
+std::string
+group_name(unsigned int index) {
+    return cocaine::format("bench-group-%d", index);
+}
+
+void
+populate(const fs::path& root, const options_t& options) {
+    configure(root, options, false);
+
+    // NOTE: The routing groups are loaded by the locator on startup, so they're stored using a
+    // throwaway context first.
+    context_t context(config_t((root / "cocaine.conf").string()), "core");
+
+    auto storage = api::storage(context, "core");
+
+    for(unsigned int i = 0; i < options.groups; ++i) {
+        std::map<std::string, unsigned int> group;
+
+        // Every group spans a few services with different weights.
+        for(unsigned int j = 0; j < std::min(options.services, 3U); ++j) {
+            group[service_name((i + j) % options.services)] = j + 1;
+        }
+
+        storage->put("groups", group_name(i), group, std::vector<std::string>({
+            "group",
+            "active"
+        }));
+    }
+}
+
+uint64_t
+percentile(const std::vector<uint64_t>& sorted, double rank) {
+    if(sorted.empty()) {
+        return 0;
+    }
+
+    return sorted[std::min<size_t>(sorted.size() - 1, rank * sorted.size())];
+}
+
+int
+run(const fs::path& root, const options_t& options) {
+    populate(root, options);
+    configure(root, options, true);
+
+    context_t context(config_t((root / "cocaine.conf").string()), "core");
+
+    std::vector<std::string> targets;
+
+    for(unsigned int i = 0; i < options.services; ++i) {
+        const std::string name = service_name(i);
+
+        context.attach(name, std::make_unique<actor_t>(
+            context,
+            std::make_shared<io::reactor_t>(),
+            std::unique_ptr<dispatch_t>(new dummy_t(context, name))
+        ));
+
+        targets.push_back(name);
+    }
+
+    for(unsigned int i = 0; i < options.groups; ++i) {
+        targets.push_back(group_name(i));
+    }
+
+    std::cout << cocaine::format(
+        "Running '%s' with %d threads for %.1fs against %d services and %d groups",
+        options.operation,
+        options.threads,
+        options.duration,
+        options.services,
+        options.groups
+    ) << std::endl;
+
+    const clock_type::time_point deadline = clock_type::now() + std::chrono::milliseconds(
+        static_cast<long>(options.duration * 1000)
+    );
+
+    std::vector<std::vector<uint64_t>> latencies(options.threads);
+    std::atomic<unsigned int> failures(0);
+
+    std::vector<std::unique_ptr<std::thread>> threads;
+
+    const clock_type::time_point start = clock_type::now();
+
+    for(unsigned int i = 0; i < options.threads; ++i) {
+        threads.emplace_back(new std::thread(worker_t {
+            options,
+            targets,
+            deadline,
+            latencies[i],
+            failures
+        }));
+    }
+
+    for(auto it = threads.begin(); it != threads.end(); ++it) {
+        (*it)->join();
+    }
+
+    const double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        clock_type::now() - start
+    ).count() / 1e6;
+
+    std::vector<uint64_t> merged;
+
+    for(auto it = latencies.begin(); it != latencies.end(); ++it) {
+        merged.insert(merged.end(), it->begin(), it->end());
+    }
+
+    std::sort(merged.begin(), merged.end());
+
+    std::cout << cocaine::format("Requests:   %d in %.2fs, %d failed clients", merged.size(), elapsed,
+        failures.load()) << std::endl;
+    std::cout << cocaine::format("Throughput: %.0f rps", merged.size() / elapsed) << std::endl;
+    std::cout << cocaine::format(
+        "Latency:    p50 %dus, p90 %dus, p99 %dus, p99.9 %dus, max %dus",
+        percentile(merged, 0.5),
+        percentile(merged, 0.9),
+        percentile(merged, 0.99),
+        percentile(merged, 0.999),
+        merged.empty() ? 0 : merged.back()
+    ) << std::endl;
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+}
+
+int
+main(int argc, char* argv[]) {
+    po::options_description general_options("General options");
+    po::variables_map vm;
+
+    options_t options;
+
+    general_options.add_options()
+        ("help,h", "show this message")
+        ("operation,o", po::value<std::string>(&options.operation)->default_value("resolve"),
+            "locator method to benchmark: resolve, synchronize or reports")
+        ("threads,t", po::value<unsigned int>(&options.threads)->default_value(4), "number of client threads")
+        ("services,s", po::value<unsigned int>(&options.services)->default_value(16), "number of dummy services")
+        ("groups,g", po::value<unsigned int>(&options.groups)->default_value(4), "number of routing groups")
+        ("duration,d", po::value<float>(&options.duration)->default_value(10.0f), "benchmark duration in seconds")
+        ("port,p", po::value<uint16_t>(&options.port)->default_value(10153), "locator port");
+
+    try {
+        po::store(po::command_line_parser(argc, argv).options(general_options).run(), vm);
+        po::notify(vm);
+    } catch(const po::error& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(vm.count("help")) {
+        std::cout << cocaine::format("USAGE: %s [options]", argv[0]) << std::endl;
+        std::cout << general_options;
+        return EXIT_SUCCESS;
+    }
+
+    // Validation
+
+    if(options.operation != "resolve" && options.operation != "synchronize" && options.operation != "reports") {
+        std::cerr << cocaine::format("ERROR: unknown operation '%s'.", options.operation) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(!options.threads || !options.services) {
+        std::cerr << "ERROR: at least one thread and one service are required." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Startup
+
+    char pattern[] = "/tmp/cocaine-bench-XXXXXX";
+
+    if(::mkdtemp(pattern) == nullptr) {
+        std::cerr << "ERROR: unable to create a temporary directory." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const fs::path root(pattern);
+
+    fs::create_directory(root / "runtime");
+    fs::create_directory(root / "storage");
+
+    int rv = EXIT_FAILURE;
+
+    try {
+        rv = run(root, options);
+    } catch(const std::system_error& e) {
+        std::cerr << cocaine::format(
+            "ERROR: %s - [%d] %s.",
+            e.what(),
+            e.code().value(),
+            e.code().message()
+        ) << std::endl;
+    } catch(const std::exception& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+    }
+
+    fs::remove_all(root);
+
+    return rv;
+}
@@ -0,0 +1,322 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/common.hpp"
+
+#include "cocaine/detail/output.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include <boost/circular_buffer.hpp>
+#include <boost/program_options.hpp>
+
+#include <unistd.h>
+
+using namespace cocaine;
+using namespace cocaine::engine;
+
+namespace po = boost::program_options;
+
+// NOTE: Slave output benchmark. A writer thread pushes synthetic log lines of random lengths into a
+// pipe as fast as it can, like a chatty slave would, and the reader splits them into lines the same
+// way the slave output handler does, carrying the incomplete lines over to the next read. Prints the
+// capture throughput for the output ring and, for comparison, for the old istringstream-based path.
+
+namespace {
+
+#if defined(__clang__) || defined(HAVE_GCC47)
+typedef std::chrono::steady_clock clock_type;
+#else
+typedef std::chrono::monotonic_clock clock_type;
+#endif
+
+struct options_t {
+    // Total amount of output, in megabytes.
+    unsigned int total;
+
+    // Average line length.
+    unsigned int line;
+
+    // Crashlog limits, see profile_t.
+    unsigned int limit;
+    unsigned int size;
+
+    // Size of a single pipe read.
+    unsigned int chunk;
+
+    bool legacy;
+};
+
+std::string
+generate(const options_t& options) {
+#if defined(__clang__) || defined(HAVE_GCC46)
+    std::default_random_engine generator(42);
+#else
+    std::minstd_rand0 generator(42);
+#endif
+
+    std::string result;
+
+    // A few megabytes of lines, which are then written over and over.
+    while(result.size() < 4 * 1024 * 1024) {
+        const size_t length = generator() % (options.line * 2);
+
+        for(size_t i = 0; i < length; ++i) {
+            result.push_back('a' + generator() % 26);
+        }
+
+        result.push_back('\n');
+    }
+
+    return result;
+}
+
+struct writer_t {
+    void
+    operator()() {
+        uint64_t left = total;
+
+        while(left) {
+            const size_t size = std::min<uint64_t>(left, data.size());
+
+            const char* it = data.data();
+            const char* end = it + size;
+
+            while(it != end) {
+                const ssize_t written = ::write(fd, it, end - it);
+
+                if(written == -1) {
+                    if(errno == EINTR) {
+                        continue;
+                    }
+
+                    std::cerr << "ERROR: unable to write into the pipe." << std::endl;
+
+                    ::close(fd);
+                    return;
+                }
+
+                it += written;
+            }
+
+            left -= size;
+        }
+
+        ::close(fd);
+    }
+
+    const int fd;
+    const std::string& data;
+    const uint64_t total;
+};
+
+struct counter_t {
+    void
+    operator()(const char* /* line */, size_t /* size */) {
+        ++lines;
+    }
+
+    uint64_t& lines;
+};
+
+// The current output handler.
+struct ring_path_t {
+    ring_path_t(const options_t& options):
+        ring(options.limit, options.size),
+        lines(0)
+    { }
+
+    size_t
+    operator()(const char* data, size_t size) {
+        return ring.consume(data, size, counter_t { lines });
+    }
+
+    output_ring_t ring;
+    uint64_t lines;
+};
+
+// The output handler as it was before the output ring, for comparison.
+struct legacy_path_t {
+    legacy_path_t(const options_t& options):
+        ring(options.limit),
+        lines(0)
+    { }
+
+    size_t
+    operator()(const char* data, size_t size) {
+        std::string input(data, size),
+                    line;
+
+        std::istringstream stream(input);
+
+        size_t leftovers = 0;
+
+        while(stream) {
+            if(std::getline(stream, line)) {
+                ring.push_back(line);
+                ++lines;
+            } else {
+                leftovers = line.size();
+            }
+        }
+
+        return size - leftovers;
+    }
+
+    boost::circular_buffer<std::string> ring;
+    uint64_t lines;
+};
+
+template<class Path>
+bool
+measure(const std::string& name, const options_t& options, const std::string& data) {
+    int fds[2];
+
+    if(::pipe(fds) != 0) {
+        std::cerr << "ERROR: unable to create a pipe." << std::endl;
+        return false;
+    }
+
+    const uint64_t total = static_cast<uint64_t>(options.total) * 1024 * 1024;
+
+    Path path(options);
+
+    std::vector<char> buffer(options.chunk);
+
+    // Unconsumed data is in [0, pending), same as in the readable stream.
+    size_t pending = 0;
+    uint64_t received = 0;
+
+    const clock_type::time_point start = clock_type::now();
+
+    std::thread writer(writer_t { fds[1], data, total });
+
+    while(true) {
+        if(pending == buffer.size()) {
+            // Same as the readable stream, which grows its ring for the incomplete lines.
+            buffer.resize(buffer.size() * 2);
+        }
+
+        const ssize_t length = ::read(fds[0], buffer.data() + pending, buffer.size() - pending);
+
+        if(length == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if(length <= 0) {
+            break;
+        }
+
+        received += length;
+        pending += length;
+
+        const size_t consumed = path(buffer.data(), pending);
+
+        std::memmove(buffer.data(), buffer.data() + consumed, pending - consumed);
+
+        pending -= consumed;
+    }
+
+    writer.join();
+
+    ::close(fds[0]);
+
+    const double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        clock_type::now() - start
+    ).count() / 1e6;
+
+    std::cout << cocaine::format(
+        "%-7s %.1f MB in %.2fs, %.1f MB/s, %.0f lines/s",
+        name,
+        received / 1048576.0,
+        elapsed,
+        received / 1048576.0 / elapsed,
+        path.lines / elapsed
+    ) << std::endl;
+
+    return received == total;
+}
+
+int
+run(const options_t& options) {
+    const std::string data = generate(options);
+
+    std::cout << cocaine::format(
+        "Capturing %d MB of output with %d byte lines on average, keeping %d lines in %d bytes",
+        options.total,
+        options.line,
+        options.limit,
+        options.size
+    ) << std::endl;
+
+    bool success = measure<ring_path_t>("ring", options, data);
+
+    if(options.legacy) {
+        success &= measure<legacy_path_t>("legacy", options, data);
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+}
+
+int
+main(int argc, char* argv[]) {
+    po::options_description general_options("General options");
+    po::variables_map vm;
+
+    options_t options;
+
+    general_options.add_options()
+        ("help,h", "show this message")
+        ("total,t", po::value<unsigned int>(&options.total)->default_value(1024), "amount of output in megabytes")
+        ("line,l", po::value<unsigned int>(&options.line)->default_value(80), "average line length")
+        ("limit,n", po::value<unsigned int>(&options.limit)->default_value(50), "crashlog limit in lines")
+        ("size,s", po::value<unsigned int>(&options.size)->default_value(1048576), "crashlog size in bytes")
+        ("chunk,c", po::value<unsigned int>(&options.chunk)->default_value(65536), "pipe read size")
+        ("legacy", "also benchmark the old output handler");
+
+    try {
+        po::store(po::command_line_parser(argc, argv).options(general_options).run(), vm);
+        po::notify(vm);
+    } catch(const po::error& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(vm.count("help")) {
+        std::cout << cocaine::format("USAGE: %s [options]", argv[0]) << std::endl;
+        std::cout << general_options;
+        return EXIT_SUCCESS;
+    }
+
+    options.legacy = vm.count("legacy");
+
+    if(!options.total || !options.line || !options.chunk) {
+        std::cerr << "ERROR: the amount of output, the line length and the read size must be positive." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return run(options);
+}
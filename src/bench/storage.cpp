@@ -0,0 +1,399 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/common.hpp"
+
+#include "cocaine/api/storage.hpp"
+
+#include "cocaine/context.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+using namespace cocaine;
+
+namespace fs = boost::filesystem;
+namespace po = boost::program_options;
+
+// NOTE: Storage benchmark. Hammers the configured storage plugin from a bunch of threads with a mix
+// of reads, writes and tag lookups over a fixed set of objects in a few collections, and prints the
+// throughput and the latency percentiles for every kind of operation. With a non-zero batch size, it
+// also compares reading that many objects one by one against a single read_many() call.
+
+namespace {
+
+#if defined(__clang__) || defined(HAVE_GCC47)
+typedef std::chrono::steady_clock clock_type;
+#else
+typedef std::chrono::monotonic_clock clock_type;
+#endif
+
+struct options_t {
+    std::string type;
+
+    unsigned int threads;
+    unsigned int collections;
+    unsigned int objects;
+    unsigned int size;
+
+    // Operation mix, in percents.
+    unsigned int reads;
+    unsigned int finds;
+
+    float duration;
+
+    // Number of objects per batch in the batched reads comparison, if any.
+    unsigned int batch;
+};
+
+enum operations { read_op, write_op, find_op, operation_count };
+
+const char* describe[] = {
+    "read",
+    "write",
+    "find"
+};
+
+struct latencies_t {
+    std::vector<uint64_t> values[operation_count];
+};
+
+std::string
+collection_name(unsigned int index) {
+    return cocaine::format("bench-collection-%d", index);
+}
+
+std::string
+object_name(unsigned int index) {
+    return cocaine::format("bench-object-%d", index);
+}
+
+std::vector<std::string>
+object_tags(unsigned int index) {
+    // Every object is tagged with a common tag and one of a few smaller ones.
+    return std::vector<std::string>({
+        "bench",
+        cocaine::format("bench-%d", index % 8)
+    });
+}
+
+struct worker_t {
+    void
+    operator()() {
+#if defined(__clang__) || defined(HAVE_GCC46)
+        std::default_random_engine generator(seed);
+#else
+        std::minstd_rand0 generator(seed);
+#endif
+
+        const std::string blob(options.size, 'x');
+
+        try {
+            while(clock_type::now() < deadline) {
+                const unsigned int roll = generator() % 100;
+                const unsigned int index = generator() % options.objects;
+
+                const std::string collection = collection_name(index % options.collections);
+
+                operations operation;
+
+                const clock_type::time_point start = clock_type::now();
+
+                if(roll < options.reads) {
+                    operation = read_op;
+                    storage->read(collection, object_name(index));
+                } else if(roll < options.reads + options.finds) {
+                    operation = find_op;
+                    storage->find(collection, std::vector<std::string>({ cocaine::format("bench-%d", index % 8) }));
+                } else {
+                    operation = write_op;
+                    storage->write(collection, object_name(index), blob, object_tags(index));
+                }
+
+                latencies.values[operation].push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                    clock_type::now() - start
+                ).count());
+            }
+        } catch(const std::exception& e) {
+            std::cerr << cocaine::format("ERROR: worker has failed - %s.", e.what()) << std::endl;
+        }
+    }
+
+    const options_t& options;
+    const api::category_traits<api::storage_t>::ptr_type storage;
+    const clock_type::time_point deadline;
+    const unsigned int seed;
+
+    latencies_t& latencies;
+};
+
+uint64_t
+percentile(const std::vector<uint64_t>& sorted, double rank) {
+    if(sorted.empty()) {
+        return 0;
+    }
+
+    return sorted[std::min<size_t>(sorted.size() - 1, rank * sorted.size())];
+}
+
+uint64_t
+elapsed_since(const clock_type::time_point& start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - start).count();
+}
+
+void
+compare(const api::category_traits<api::storage_t>::ptr_type& storage, const options_t& options) {
+#if defined(__clang__) || defined(HAVE_GCC46)
+    std::default_random_engine generator(42);
+#else
+    std::minstd_rand0 generator(42);
+#endif
+
+    const unsigned int rounds = 256;
+
+    // Objects per collection, see the population loop.
+    const unsigned int objects = std::max(1U, options.objects / options.collections);
+
+    uint64_t single = 0,
+             batched = 0;
+
+    for(unsigned int round = 0; round < rounds; ++round) {
+        const unsigned int collection = round % options.collections;
+
+        std::vector<std::string> keys;
+
+        for(unsigned int i = 0; i < options.batch; ++i) {
+            keys.push_back(object_name(collection + options.collections * (generator() % objects)));
+        }
+
+        clock_type::time_point start = clock_type::now();
+
+        for(auto it = keys.begin(); it != keys.end(); ++it) {
+            storage->read(collection_name(collection), *it);
+        }
+
+        single += elapsed_since(start);
+
+        start = clock_type::now();
+
+        storage->read_many(collection_name(collection), keys);
+
+        batched += elapsed_since(start);
+    }
+
+    std::cout << cocaine::format(
+        "batch of %d: %dus one by one, %dus batched, %.2fx speedup",
+        options.batch,
+        single / rounds,
+        batched / rounds,
+        batched ? static_cast<double>(single) / batched : 0.0
+    ) << std::endl;
+}
+
+int
+run(const fs::path& root, const options_t& options) {
+    Json::Value config;
+
+    config["version"] = 2;
+
+    config["paths"]["plugins"] = (root / "plugins").string();
+    config["paths"]["runtime"] = (root / "runtime").string();
+
+    // NOTE: Don't clash with the locator of a runtime on this host.
+    config["locator"]["endpoint"] = "127.0.0.1";
+    config["locator"]["port"] = 0;
+
+    config["loggers"]["core"]["type"] = "files";
+    config["loggers"]["core"]["args"]["path"] = (root / "bench.log").string();
+    config["loggers"]["core"]["args"]["verbosity"] = "warning";
+
+    config["storages"]["core"]["type"] = options.type;
+    config["storages"]["core"]["args"]["path"] = (root / "storage").string();
+
+    {
+        std::ofstream stream((root / "cocaine.conf").string().c_str());
+        stream << Json::StyledWriter().write(config);
+    }
+
+    context_t context(config_t((root / "cocaine.conf").string()), "core");
+
+    auto storage = api::storage(context, "core");
+
+    // Populate the storage, so that every read hits an existing object.
+    for(unsigned int i = 0; i < options.objects; ++i) {
+        storage->write(collection_name(i % options.collections), object_name(i), std::string(options.size, 'x'),
+            object_tags(i));
+    }
+
+    std::cout << cocaine::format(
+        "Running %d%% reads, %d%% finds and %d%% writes with %d threads for %.1fs over %d objects",
+        options.reads,
+        options.finds,
+        100 - options.reads - options.finds,
+        options.threads,
+        options.duration,
+        options.objects
+    ) << std::endl;
+
+    const clock_type::time_point deadline = clock_type::now() + std::chrono::milliseconds(
+        static_cast<long>(options.duration * 1000)
+    );
+
+    std::vector<latencies_t> latencies(options.threads);
+    std::vector<std::unique_ptr<std::thread>> threads;
+
+    const clock_type::time_point start = clock_type::now();
+
+    for(unsigned int i = 0; i < options.threads; ++i) {
+        threads.emplace_back(new std::thread(worker_t {
+            options,
+            storage,
+            deadline,
+            i + 1,
+            latencies[i]
+        }));
+    }
+
+    for(auto it = threads.begin(); it != threads.end(); ++it) {
+        (*it)->join();
+    }
+
+    const double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        clock_type::now() - start
+    ).count() / 1e6;
+
+    for(int operation = 0; operation < operation_count; ++operation) {
+        std::vector<uint64_t> merged;
+
+        for(auto it = latencies.begin(); it != latencies.end(); ++it) {
+            merged.insert(merged.end(), it->values[operation].begin(), it->values[operation].end());
+        }
+
+        if(merged.empty()) {
+            continue;
+        }
+
+        std::sort(merged.begin(), merged.end());
+
+        std::cout << cocaine::format(
+            "%-5s: %8.0f ops, p50 %dus, p90 %dus, p99 %dus, p99.9 %dus, max %dus",
+            describe[operation],
+            merged.size() / elapsed,
+            percentile(merged, 0.5),
+            percentile(merged, 0.9),
+            percentile(merged, 0.99),
+            percentile(merged, 0.999),
+            merged.back()
+        ) << std::endl;
+    }
+
+    if(options.batch) {
+        compare(storage, options);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+}
+
+int
+main(int argc, char* argv[]) {
+    po::options_description general_options("General options");
+    po::variables_map vm;
+
+    options_t options;
+
+    general_options.add_options()
+        ("help,h", "show this message")
+        ("type", po::value<std::string>(&options.type)->default_value("files"), "storage plugin type")
+        ("threads,t", po::value<unsigned int>(&options.threads)->default_value(4), "number of threads")
+        ("collections,c", po::value<unsigned int>(&options.collections)->default_value(4), "number of collections")
+        ("objects,n", po::value<unsigned int>(&options.objects)->default_value(1024), "number of objects")
+        ("size,s", po::value<unsigned int>(&options.size)->default_value(4096), "object size in bytes")
+        ("reads,r", po::value<unsigned int>(&options.reads)->default_value(80), "percentage of reads")
+        ("finds,f", po::value<unsigned int>(&options.finds)->default_value(5), "percentage of tag lookups")
+        ("duration,d", po::value<float>(&options.duration)->default_value(10.0f), "benchmark duration in seconds")
+        ("batch,b", po::value<unsigned int>(&options.batch)->default_value(0), "batch size for the batched reads comparison");
+
+    try {
+        po::store(po::command_line_parser(argc, argv).options(general_options).run(), vm);
+        po::notify(vm);
+    } catch(const po::error& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(vm.count("help")) {
+        std::cout << cocaine::format("USAGE: %s [options]", argv[0]) << std::endl;
+        std::cout << general_options;
+        return EXIT_SUCCESS;
+    }
+
+    // Validation
+
+    if(options.reads + options.finds > 100) {
+        std::cerr << "ERROR: the operation mix exceeds 100%." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if(!options.threads || !options.collections || !options.objects) {
+        std::cerr << "ERROR: at least one thread, one collection and one object are required." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Startup
+
+    char pattern[] = "/tmp/cocaine-bench-XXXXXX";
+
+    if(::mkdtemp(pattern) == nullptr) {
+        std::cerr << "ERROR: unable to create a temporary directory." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const fs::path root(pattern);
+
+    fs::create_directory(root / "runtime");
+    fs::create_directory(root / "storage");
+
+    int rv = EXIT_FAILURE;
+
+    try {
+        rv = run(root, options);
+    } catch(const std::system_error& e) {
+        std::cerr << cocaine::format(
+            "ERROR: %s - [%d] %s.",
+            e.what(),
+            e.code().value(),
+            e.code().message()
+        ) << std::endl;
+    } catch(const std::exception& e) {
+        std::cerr << cocaine::format("ERROR: %s.", e.what()) << std::endl;
+    }
+
+    fs::remove_all(root);
+
+    return rv;
+}
@@ -52,8 +52,10 @@ const float defaults::startup_timeout        = 10.0f;
 const float defaults::termination_timeout    = 5.0f;
 const unsigned long defaults::concurrency    = 10L;
 const unsigned long defaults::crashlog_limit = 50L;
+const unsigned long defaults::crashlog_size  = 1048576L;
 const unsigned long defaults::pool_limit     = 10L;
 const unsigned long defaults::queue_limit    = 100L;
+const unsigned long defaults::shared_ring_size = 4194304L;
 
 const float defaults::control_timeout        = 5.0f;
 const unsigned defaults::decoder_granularity = 256;
@@ -0,0 +1,130 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <condition_variable>
+#include <thread>
+
+// NOTE: Resolves the newly discovered nodes on a separate thread, so that the DNS lookups don't block
+// the locator reactor. The nodes are processed in batches, and the resolved endpoints are handed back
+// to the reactor thread via reactor_t::post(), where the nodes are then connected to asynchronously.
+
+struct locator_t::discovery_t {
+    COCAINE_DECLARE_NONCOPYABLE(discovery_t)
+
+    discovery_t(locator_t& self);
+   ~discovery_t();
+
+    void
+    enqueue(const std::vector<key_type>& batch);
+
+private:
+    void
+    run();
+
+    void
+    process(const key_type& key);
+
+private:
+    locator_t& self;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    std::vector<key_type> queue;
+    bool stopped;
+
+    std::unique_ptr<std::thread> thread;
+};
+
+locator_t::discovery_t::discovery_t(locator_t& self_):
+    self(self_),
+    stopped(false)
+{
+    thread.reset(new std::thread(std::bind(&discovery_t::run, this)));
+}
+
+locator_t::discovery_t::~discovery_t() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopped = true;
+    }
+
+    condition.notify_one();
+
+    thread->join();
+}
+
+void
+locator_t::discovery_t::enqueue(const std::vector<key_type>& batch) {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        queue.insert(queue.end(), batch.begin(), batch.end());
+    }
+
+    condition.notify_one();
+}
+
+void
+locator_t::discovery_t::run() {
+    std::vector<key_type> batch;
+
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while(queue.empty() && !stopped) {
+                condition.wait(lock);
+            }
+
+            if(stopped) {
+                return;
+            }
+
+            batch.swap(queue);
+        }
+
+        std::for_each(batch.begin(), batch.end(), std::bind(&discovery_t::process, this, _1));
+
+        batch.clear();
+    }
+}
+
+void
+locator_t::discovery_t::process(const key_type& key) {
+    std::string uuid;
+    std::string hostname;
+    uint16_t    port;
+
+    std::tie(uuid, hostname, port) = key;
+
+    std::vector<io::tcp::endpoint> endpoints;
+
+    try {
+        endpoints = io::resolver<io::tcp>::query(hostname, port);
+    } catch(const std::system_error& e) {
+        COCAINE_LOG_ERROR(self.m_log, "unable to resolve node '%s' endpoints - [%d] %s", uuid, e.code().value(),
+            e.code().message());
+    }
+
+    // NOTE: Failures are reported back as well, so that the node could be retried with the next
+    // announce.
+    self.m_reactor.post(std::bind(&locator_t::on_resolve, &self, key, endpoints));
+}
@@ -91,3 +91,8 @@ std::string
 dispatch_t::name() const {
     return m_name;
 }
+
+size_t
+dispatch_t::load() const {
+    return 0;
+}
@@ -27,10 +27,12 @@
 #include "cocaine/asio/connector.hpp"
 #include "cocaine/asio/local.hpp"
 #include "cocaine/asio/reactor.hpp"
+#include "cocaine/asio/shared.hpp"
 #include "cocaine/asio/socket.hpp"
 
 #include "cocaine/context.hpp"
 
+#include "cocaine/detail/executor.hpp"
 #include "cocaine/detail/manifest.hpp"
 #include "cocaine/detail/profile.hpp"
 #include "cocaine/detail/session.hpp"
@@ -76,6 +78,7 @@ engine_t::engine_t(context_t& context,
                    const std::shared_ptr<io::socket<local>>& control):
     m_context(context),
     m_log(new logging::log_t(context, cocaine::format("app/%1%", manifest.name))),
+    m_executor(new executor_t(1, 64)),
     m_manifest(manifest),
     m_profile(profile),
     m_state(states::stopped),
@@ -213,6 +216,22 @@ engine_t::erase(const std::string& id, int code, const std::string& reason) {
     }
 }
 
+size_t
+engine_t::outstanding() {
+    std::lock_guard<std::mutex> pool_guard(m_pool_mutex);
+
+    size_t result = 0;
+
+    for(auto it = m_pool.begin(); it != m_pool.end(); ++it) {
+        result += it->second->load();
+    }
+
+    // NOTE: Same locking order as in pump().
+    std::lock_guard<session_queue_t> queue_guard(m_queue);
+
+    return result + m_queue.size();
+}
+
 void
 engine_t::wake() {
     m_notification->send();
@@ -241,13 +260,20 @@ engine_t::on_connection(const std::shared_ptr<io::socket<local>>& socket_) {
 void
 engine_t::on_handshake(int fd, const message_t& message) {
     std::string id;
+    std::string transport;
+
     backlog_t::mapped_type channel_ = m_backlog[fd];
 
     // Pop the channel.
     m_backlog.erase(fd);
 
     try {
-        message.as<rpc::handshake>(id);
+        // NOTE: Older slaves don't specify the transport at all.
+        if(message.args().via.array.size > 1) {
+            message.as<rpc::handshake>(id, transport);
+        } else {
+            message.as<rpc::handshake>(id);
+        }
     } catch(const std::system_error& e) {
         COCAINE_LOG_WARNING(m_log, "disconnecting an incompatible slave on fd %d", fd);
         return;
@@ -269,6 +295,44 @@ engine_t::on_handshake(int fd, const message_t& message) {
     COCAINE_LOG_DEBUG(m_log, "slave %s connected on fd %d", id, fd);
 
     it->second->bind(channel_);
+
+    if(transport != "shared" || m_profile.shared_ring_size == 0) {
+        return;
+    }
+
+    std::shared_ptr<io::shared_segment> segment;
+
+    try {
+        segment = std::make_shared<io::shared_segment>(m_profile.shared_ring_size);
+
+        // NOTE: Nothing has been sent to the slave yet, so the offer can be written directly to the
+        // socket, with the segment descriptors attached to it.
+        char buffer[frame<rpc::transport>::envelope + 9];
+
+        const char* end = frame<rpc::transport>::pack(
+            buffer,
+            0UL,
+            static_cast<uint64_t>(segment->capacity())
+        );
+
+        io::send_descriptors(fd, buffer, end - buffer, segment->fds(), io::shared_segment::descriptor_count);
+    } catch(const std::system_error& e) {
+        // NOTE: Unless the offer has been partially sent, in which case the socket is shut down and
+        // the slave is reaped as disconnected, it simply continues with the socket transport.
+        COCAINE_LOG_WARNING(
+            m_log,
+            "unable to set up the shared memory transport for slave %s - [%d] %s",
+            id,
+            e.code().value(),
+            e.code().message()
+        );
+
+        return;
+    }
+
+    COCAINE_LOG_DEBUG(m_log, "slave %s is using the shared memory transport", id);
+
+    it->second->bind(segment);
 }
 
 void
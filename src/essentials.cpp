@@ -22,12 +22,19 @@
 #include "cocaine/detail/drivers/time.hpp"
 #include "cocaine/detail/isolates/process.hpp"
 #include "cocaine/detail/gateways/adhoc.hpp"
+#include "cocaine/detail/gateways/forwarding.hpp"
+#include "cocaine/detail/gateways/rendezvous.hpp"
 #include "cocaine/detail/loggers/files.hpp"
 #include "cocaine/detail/loggers/syslog.hpp"
 #include "cocaine/detail/services/logging.hpp"
 #include "cocaine/detail/services/node.hpp"
 #include "cocaine/detail/services/storage.hpp"
+#include "cocaine/detail/storages/cache.hpp"
+#if !defined(__APPLE__)
+    #include "cocaine/detail/storages/dedup.hpp"
+#endif
 #include "cocaine/detail/storages/files.hpp"
+#include "cocaine/detail/storages/journal.hpp"
 
 #include "cocaine/detail/essentials.hpp"
 
@@ -37,10 +44,18 @@ cocaine::essentials::initialize(api::repository_t& repository) {
     repository.insert<driver::recurring_timer_t>("time");
     repository.insert<isolate::process_t>("process");
     repository.insert<gateway::adhoc_t>("adhoc");
+    repository.insert<gateway::forwarding_t>("forwarding");
+    repository.insert<gateway::rendezvous_t>("rendezvous");
     repository.insert<logger::files_t>("files");
     repository.insert<logger::syslog_t>("syslog");
     repository.insert<service::logging_t>("logging");
     repository.insert<service::node_t>("node");
     repository.insert<service::storage_t>("storage");
+    repository.insert<storage::cache_t>("cache");
+#if !defined(__APPLE__)
+    // NOTE: Chunk digests need OpenSSL, which isn't linked on OS X.
+    repository.insert<storage::dedup_t>("dedup");
+#endif
     repository.insert<storage::files_t>("files");
+    repository.insert<storage::journal_t>("journal");
 }
@@ -0,0 +1,91 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/detail/executor.hpp"
+
+using namespace cocaine;
+
+executor_t::executor_t(unsigned int threads, size_t limit):
+    m_limit(limit),
+    m_stopped(false)
+{
+    for(unsigned int i = 0; i < std::max(threads, 1U); ++i) {
+        m_threads.emplace_back(new std::thread(std::bind(&executor_t::run, this)));
+    }
+}
+
+executor_t::~executor_t() {
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stopped = true;
+    }
+
+    m_condition.notify_all();
+
+    for(auto it = m_threads.begin(); it != m_threads.end(); ++it) {
+        (*it)->join();
+    }
+}
+
+bool
+executor_t::post(const task_type& task) {
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        if(m_stopped || m_queue.size() >= m_limit) {
+            return false;
+        }
+
+        m_queue.push_back(task);
+    }
+
+    m_condition.notify_one();
+
+    return true;
+}
+
+void
+executor_t::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while(true) {
+        while(!m_stopped && m_queue.empty()) {
+            m_condition.wait(lock);
+        }
+
+        // NOTE: The queue is drained before stopping, so that the pending writes aren't lost.
+        if(m_queue.empty()) {
+            return;
+        }
+
+        task_type task = std::move(m_queue.front());
+        m_queue.pop_front();
+
+        lock.unlock();
+
+        try {
+            task();
+        } catch(...) {
+            // Tasks are expected to handle their own errors.
+        }
+
+        lock.lock();
+    }
+}
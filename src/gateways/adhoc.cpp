@@ -27,10 +27,37 @@ using namespace cocaine;
 using namespace cocaine::api;
 using namespace cocaine::gateway;
 
+namespace {
+
+// Uniformly distributed index in [0, size).
+template<class Generator>
+size_t
+uniform(Generator& generator, size_t size) {
+#if defined(__clang__) || defined(HAVE_GCC46)
+    std::uniform_int_distribution<size_t> distribution(0, size - 1);
+#else
+    std::uniform_int<size_t> distribution(0, size - 1);
+#endif
+
+    return distribution(generator);
+}
+
+} // namespace
+
 adhoc_t::adhoc_t(context_t& context, const std::string& name, const Json::Value& args):
     category_type(context, name, args),
     m_log(new logging::log_t(context, name))
 {
+    const std::string balancer = args.get("balancer", "random").asString();
+
+    if(balancer == "random") {
+        m_balancer = balancers::random;
+    } else if(balancer == "load") {
+        m_balancer = balancers::load;
+    } else {
+        throw cocaine::error_t("unknown balancer '%s'", balancer);
+    }
+
 #if defined(__clang__) || defined(HAVE_GCC46)
     std::random_device device;
     m_random_generator.seed(device());
@@ -45,44 +72,82 @@ adhoc_t::~adhoc_t() {
 
 auto
 adhoc_t::resolve(const std::string& name) const -> metadata_t {
-    auto it  = m_remote_services.cend(),
-         end = it;
-
-    std::tie(it, end) = m_remote_services.equal_range(name);
+    auto it = m_remote_services.find(name);
 
-    if(it == end) {
+    if(it == m_remote_services.end() || it->second.empty()) {
         throw cocaine::error_t("the specified service is not available in the group");
     }
 
-#if defined(__clang__) || defined(HAVE_GCC46)
-    std::uniform_int_distribution<int> distribution(0, std::distance(it, end) - 1);
-#else
-    std::uniform_int<int> distribution(0, std::distance(it, end) - 1);
-#endif
+    const std::vector<remote_service_t>& candidates = it->second;
 
-    std::advance(it, distribution(m_random_generator));
+    size_t index = uniform(m_random_generator, candidates.size());
 
-    const auto endpoint = std::get<0>(it->second.meta);
+    if(m_balancer == balancers::load && candidates.size() > 1) {
+        // NOTE: Power of two choices. The second candidate is picked from the rest of the nodes, so
+        // that it's always different from the first one.
+        size_t other = uniform(m_random_generator, candidates.size() - 1);
+
+        if(other >= index) {
+            ++other;
+        }
+
+        if(candidates[other].load < candidates[index].load) {
+            index = other;
+        }
+
+        // Account for this client until the next load report arrives, so that the bursts won't all
+        // end up on the same node.
+        candidates[index].load++;
+    }
+
+    const remote_service_t& service = candidates[index];
+    const auto endpoint = std::get<0>(service.meta);
 
     COCAINE_LOG_DEBUG(
         m_log,
         "providing '%s' using remote node '%s' on %s:%d",
         name,
-        it->second.uuid,
+        service.uuid,
         std::get<0>(endpoint),
         std::get<1>(endpoint)
     );
 
-    return it->second.meta;
+    return service.meta;
 }
 
+namespace {
+
+struct match_uuid {
+    template<class T>
+    bool
+    operator()(const T& service) const {
+        return service.uuid == uuid;
+    }
+
+    const std::string& uuid;
+};
+
+} // namespace
+
 void
 adhoc_t::consume(const std::string& uuid, const std::string& name, const metadata_t& meta) {
     COCAINE_LOG_DEBUG(m_log, "consumed node '%s' service '%s'", uuid, name);
 
-    m_remote_services.insert({
-        name,
-        remote_service_t { uuid, meta }
+    std::vector<remote_service_t>& services = m_remote_services[name];
+
+    // NOTE: The same service might be consumed more than once, e.g. when a node is both dumped and
+    // announced, so the existing entry is replaced instead of getting a duplicate.
+    auto it = std::find_if(services.begin(), services.end(), match_uuid { uuid });
+
+    if(it != services.end()) {
+        it->meta = meta;
+        return;
+    }
+
+    services.push_back(remote_service_t {
+        uuid,
+        meta,
+        0
     });
 }
 
@@ -90,15 +155,33 @@ void
 adhoc_t::cleanup(const std::string& uuid, const std::string& name) {
     COCAINE_LOG_DEBUG(m_log, "removing node '%s' service '%s'", uuid, name);
 
-    remote_service_map_t::iterator it, end;
+    auto it = m_remote_services.find(name);
 
-    std::tie(it, end) = m_remote_services.equal_range(name);
+    if(it == m_remote_services.end()) {
+        return;
+    }
 
-    while(it != end) {
-        if(it->second.uuid == uuid) {
-            m_remote_services.erase(it++);
-        } else {
-            ++it;
-        }
+    it->second.erase(
+        std::remove_if(it->second.begin(), it->second.end(), match_uuid { uuid }),
+        it->second.end()
+    );
+
+    if(it->second.empty()) {
+        m_remote_services.erase(it);
+    }
+}
+
+void
+adhoc_t::report(const std::string& uuid, const std::string& name, uint64_t load) {
+    auto it = m_remote_services.find(name);
+
+    if(it == m_remote_services.end()) {
+        return;
+    }
+
+    auto service = std::find_if(it->second.begin(), it->second.end(), match_uuid { uuid });
+
+    if(service != it->second.end()) {
+        service->load = load;
     }
 }
@@ -0,0 +1,736 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/detail/gateways/forwarding.hpp"
+
+#include "cocaine/asio/acceptor.hpp"
+#include "cocaine/asio/connector.hpp"
+#include "cocaine/asio/dialer.hpp"
+#include "cocaine/asio/resolver.hpp"
+#include "cocaine/asio/socket.hpp"
+
+#include "cocaine/context.hpp"
+#include "cocaine/logging.hpp"
+#include "cocaine/messages.hpp"
+
+#include "cocaine/detail/executor.hpp"
+
+#include "cocaine/rpc/channel.hpp"
+
+#if defined(__linux__)
+    #include <sys/prctl.h>
+#endif
+
+using namespace cocaine;
+using namespace cocaine::api;
+using namespace cocaine::gateway;
+using namespace cocaine::io;
+
+using namespace std::placeholders;
+
+struct forwarding_t::proxy_t {
+    const std::string name;
+
+    // Bound synchronously, so that the endpoint is known right away, but watched on the gateway
+    // thread only.
+    std::unique_ptr<acceptor<tcp>> listener;
+    std::unique_ptr<connector<acceptor<tcp>>> watcher;
+
+    const uint16_t port;
+
+    // Guarded by the gateway mutex.
+    metadata_t meta;
+    std::map<std::string, locator::endpoint_tuple_type> targets;
+
+    // Sessions are spread between the targets in a round-robin fashion.
+    size_t next;
+};
+
+typedef std::pair<int, uint64_t> route_t;
+
+struct forwarding_t::client_t {
+    const std::string name;
+    const std::shared_ptr<channel<io::socket<tcp>>> ptr;
+
+    // Client band -> upstream channel and band.
+    std::map<uint64_t, route_t> routes;
+
+    // Whether the client can't keep up with the responses, the upstream channels it has paused and
+    // the number of upstream channels which have paused it.
+    bool throttled;
+    std::set<int> holds;
+    size_t pauses;
+};
+
+struct forwarding_t::upstream_t {
+    const std::string key;
+    const std::shared_ptr<channel<io::socket<tcp>>> ptr;
+
+    // Connects the channel in background, once the endpoints are resolved.
+    std::shared_ptr<dialer<tcp>> dial;
+
+    uint64_t next;
+
+    // Upstream band -> client connection and band.
+    std::map<uint64_t, route_t> routes;
+
+    // Same as for the clients. The channel is considered throttled until it's connected, so that
+    // the clients can't pile up messages in it in the meantime.
+    bool throttled;
+    std::set<int> holds;
+    size_t pauses;
+};
+
+namespace {
+
+template<class Container>
+struct deferred_erase_action {
+    typedef Container container_type;
+    typedef typename container_type::key_type key_type;
+
+    void
+    operator()() {
+        target.erase(key);
+    }
+
+    container_type& target;
+    const key_type  key;
+};
+
+template<class Peer>
+void
+pause(Peer& peer) {
+    if(peer.pauses++ == 0 && peer.ptr->rd->stream()) {
+        peer.ptr->rd->stream()->pause();
+    }
+}
+
+template<class Peer>
+void
+resume(Peer& peer) {
+    BOOST_ASSERT(peer.pauses != 0);
+
+    if(--peer.pauses == 0 && peer.ptr->rd->stream()) {
+        peer.ptr->rd->stream()->resume();
+    }
+}
+
+struct named_runnable {
+    void
+    operator()() const {
+#if defined(__linux__)
+        ::prctl(PR_SET_NAME, "gateway");
+#endif
+
+        reactor.run();
+    }
+
+    reactor_t& reactor;
+};
+
+}
+
+forwarding_t::forwarding_t(context_t& context, const std::string& name, const Json::Value& args):
+    category_type(context, name, args),
+    m_log(new logging::log_t(context, name)),
+    m_uuid(context.config.network.uuid),
+    m_hostname(context.config.network.hostname),
+    m_address(context.config.network.endpoint),
+    m_pool_limit(std::max(args.get("pool-limit", 2U).asUInt(), 1U)),
+    m_next_upstream(0),
+    m_resolver(new executor_t(1, 256))
+{
+    m_thread.reset(new std::thread(named_runnable {
+        m_reactor
+    }));
+}
+
+forwarding_t::~forwarding_t() {
+    // The pending resolves are finished first, as they post their results into the reactor.
+    m_resolver.reset();
+
+    m_reactor.post(std::bind(&reactor_t::stop, &m_reactor));
+
+    m_thread->join();
+    m_thread.reset();
+}
+
+auto
+forwarding_t::resolve(const std::string& name) const -> metadata_t {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto it = m_proxies.find(name);
+
+    if(it == m_proxies.end()) {
+        throw cocaine::error_t("the specified service is not available in the group");
+    }
+
+    const std::shared_ptr<proxy_t>& proxy = it->second;
+
+    COCAINE_LOG_DEBUG(m_log, "providing '%s' using a local proxy on port %d", name, proxy->port);
+
+    return metadata_t(
+        locator::endpoint_tuple_type(m_hostname, proxy->port),
+        std::get<1>(proxy->meta),
+        std::get<2>(proxy->meta)
+    );
+}
+
+void
+forwarding_t::consume(const std::string& uuid, const std::string& name, const metadata_t& meta) {
+    if(uuid == m_uuid) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto it = m_proxies.find(name);
+
+    if(it == m_proxies.end()) {
+        const tcp::endpoint bindpoint = { boost::asio::ip::address::from_string(m_address), 0 };
+
+        std::unique_ptr<acceptor<tcp>> socket;
+
+        try {
+            socket.reset(new acceptor<tcp>(bindpoint));
+        } catch(const std::system_error& e) {
+            COCAINE_LOG_ERROR(m_log, "unable to create a proxy for service '%s' - [%d] %s", name,
+                e.code().value(), e.code().message());
+            return;
+        }
+
+        const uint16_t port = socket->local_endpoint().port();
+
+        auto proxy = std::make_shared<proxy_t>(proxy_t {
+            name,
+            std::move(socket),
+            std::unique_ptr<connector<acceptor<tcp>>>(),
+            port,
+            meta,
+            std::map<std::string, locator::endpoint_tuple_type>(),
+            0
+        });
+
+        COCAINE_LOG_INFO(m_log, "forwarding service '%s' via port %d", name, port);
+
+        std::tie(it, std::ignore) = m_proxies.insert({ name, proxy });
+
+        m_reactor.post(std::bind(&forwarding_t::start, this, proxy));
+    }
+
+    it->second->meta = meta;
+    it->second->targets[uuid] = std::get<0>(meta);
+}
+
+void
+forwarding_t::cleanup(const std::string& uuid, const std::string& name) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto it = m_proxies.find(name);
+
+    if(it == m_proxies.end()) {
+        return;
+    }
+
+    it->second->targets.erase(uuid);
+
+    if(it->second->targets.empty()) {
+        COCAINE_LOG_INFO(m_log, "service '%s' is no longer forwarded", name);
+
+        // NOTE: The sessions in progress are not affected.
+        m_reactor.post(std::bind(&forwarding_t::stop, this, it->second));
+
+        m_proxies.erase(it);
+    }
+}
+
+void
+forwarding_t::start(const std::shared_ptr<proxy_t>& proxy) {
+    proxy->watcher.reset(new connector<acceptor<tcp>>(m_reactor, std::move(proxy->listener)));
+    proxy->watcher->bind(std::bind(&forwarding_t::on_connection, this, proxy->name, _1));
+}
+
+void
+forwarding_t::stop(const std::shared_ptr<proxy_t>& proxy) {
+    proxy->watcher.reset();
+}
+
+void
+forwarding_t::on_connection(const std::string& name, const std::shared_ptr<io::socket<tcp>>& socket) {
+    const int fd = socket->fd();
+
+    COCAINE_LOG_DEBUG(m_log, "accepted a new client for service '%s' on fd %d", name, fd);
+
+    auto channel_ = std::make_shared<channel<io::socket<tcp>>>(m_reactor, socket);
+
+    channel_->rd->bind(
+        std::bind(&forwarding_t::on_client_message, this, fd, _1),
+        std::bind(&forwarding_t::on_client_failure, this, fd, _1)
+    );
+
+    channel_->wr->bind(
+        std::bind(&forwarding_t::on_client_failure, this, fd, _1),
+        std::bind(&forwarding_t::on_client_pressure, this, fd, _1)
+    );
+
+    m_clients[fd] = std::make_shared<client_t>(client_t {
+        name,
+        channel_,
+        std::map<uint64_t, route_t>(),
+        false,
+        std::set<int>(),
+        0
+    });
+}
+
+void
+forwarding_t::on_client_message(int fd, const message_t& message) {
+    auto client_it = m_clients.find(fd);
+
+    if(client_it == m_clients.end()) {
+        return;
+    }
+
+    client_t& client = *client_it->second;
+
+    auto route = client.routes.find(message.band());
+
+    if(route == client.routes.end()) {
+        int target;
+
+        try {
+            target = select(client.name);
+        } catch(const std::exception& e) {
+            client.ptr->wr->write<rpc::error>(message.band(), static_cast<int>(invocation_error), e.what());
+            client.ptr->wr->write<rpc::choke>(message.band());
+            return;
+        }
+
+        upstream_t& upstream = *m_upstreams[target];
+
+        const uint64_t band = upstream.next++;
+
+        upstream.routes[band] = route_t(fd, message.band());
+
+        std::tie(route, std::ignore) = client.routes.insert({
+            message.band(),
+            route_t(target, band)
+        });
+    }
+
+    upstream_t& upstream = *m_upstreams[route->second.first];
+
+    upstream.ptr->wr->write(message, route->second.second);
+
+    // NOTE: The upstream might have been throttled before this client started using it.
+    if(upstream.throttled && upstream.holds.insert(fd).second) {
+        pause(client);
+    }
+}
+
+void
+forwarding_t::on_client_failure(int fd, const std::error_code& /* ec */) {
+    auto client_it = m_clients.find(fd);
+
+    if(client_it == m_clients.end()) {
+        return;
+    }
+
+    COCAINE_LOG_DEBUG(m_log, "client on fd %d has disconnected", fd);
+
+    const auto& routes = client_it->second->routes;
+
+    // NOTE: The remote sessions can't be cancelled, so their responses will be silently dropped.
+    for(auto it = routes.begin(); it != routes.end(); ++it) {
+        auto upstream = m_upstreams.find(it->second.first);
+
+        if(upstream != m_upstreams.end()) {
+            upstream->second->routes.erase(it->second.second);
+        }
+    }
+
+    // Release the upstream channels paused by this client.
+    const auto& holds = client_it->second->holds;
+
+    for(auto it = holds.begin(); it != holds.end(); ++it) {
+        auto upstream = m_upstreams.find(*it);
+
+        if(upstream != m_upstreams.end()) {
+            resume(*upstream->second);
+        }
+    }
+
+    for(auto it = m_upstreams.begin(); it != m_upstreams.end(); ++it) {
+        it->second->holds.erase(fd);
+    }
+
+    client_it->second->holds.clear();
+
+    // NOTE: It is dangerous to remove the channel while the message is still being processed, so
+    // it's deferred via reactor_t::post().
+    m_reactor.post(deferred_erase_action<decltype(m_clients)> {
+        m_clients,
+        fd
+    });
+}
+
+void
+forwarding_t::on_upstream_connect(int id, const std::shared_ptr<io::socket<tcp>>& socket, const std::error_code& ec) {
+    auto upstream_it = m_upstreams.find(id);
+
+    if(upstream_it == m_upstreams.end()) {
+        return;
+    }
+
+    if(!socket) {
+        on_upstream_failure(id, ec);
+        return;
+    }
+
+    const std::shared_ptr<channel<io::socket<tcp>>>& channel_ = upstream_it->second->ptr;
+
+    channel_->attach(m_reactor, socket);
+
+    if(upstream_it->second->pauses != 0) {
+        // Some of the clients can't keep up already.
+        channel_->rd->stream()->pause();
+    }
+
+    channel_->rd->bind(
+        std::bind(&forwarding_t::on_upstream_message, this, id, _1),
+        std::bind(&forwarding_t::on_upstream_failure, this, id, _1)
+    );
+
+    channel_->wr->bind(
+        std::bind(&forwarding_t::on_upstream_failure, this, id, _1),
+        std::bind(&forwarding_t::on_upstream_pressure, this, id, _1)
+    );
+
+    COCAINE_LOG_DEBUG(m_log, "opened a channel to '%s' on fd %d", upstream_it->second->key, socket->fd());
+
+    // Release the clients which were paused while the channel was connecting.
+    on_upstream_pressure(id, false);
+}
+
+void
+forwarding_t::on_upstream_message(int id, const message_t& message) {
+    auto upstream_it = m_upstreams.find(id);
+
+    if(upstream_it == m_upstreams.end()) {
+        return;
+    }
+
+    upstream_t& upstream = *upstream_it->second;
+
+    auto route = upstream.routes.find(message.band());
+
+    if(route == upstream.routes.end()) {
+        return;
+    }
+
+    auto client = m_clients.find(route->second.first);
+
+    if(client != m_clients.end()) {
+        client->second->ptr->wr->write(message, route->second.second);
+
+        // NOTE: The client might have been throttled before this channel started responding to it.
+        if(client->second->throttled && client->second->holds.insert(id).second) {
+            pause(upstream);
+        }
+    }
+
+    if(message.id() == event_traits<rpc::choke>::id) {
+        // The remote session is over.
+        if(client != m_clients.end()) {
+            client->second->routes.erase(route->second.second);
+        }
+
+        upstream.routes.erase(route);
+    }
+}
+
+void
+forwarding_t::on_upstream_failure(int id, const std::error_code& ec) {
+    auto upstream_it = m_upstreams.find(id);
+
+    if(upstream_it == m_upstreams.end()) {
+        return;
+    }
+
+    upstream_t& upstream = *upstream_it->second;
+
+    COCAINE_LOG_WARNING(m_log, "channel to '%s' has been lost - [%d] %s", upstream.key, ec.value(), ec.message());
+
+    for(auto it = upstream.routes.begin(); it != upstream.routes.end(); ++it) {
+        auto client = m_clients.find(it->second.first);
+
+        if(client == m_clients.end()) {
+            continue;
+        }
+
+        client->second->ptr->wr->write<rpc::error>(
+            it->second.second,
+            static_cast<int>(invocation_error),
+            std::string("the remote node has disconnected")
+        );
+
+        client->second->ptr->wr->write<rpc::choke>(it->second.second);
+        client->second->routes.erase(it->second.second);
+    }
+
+    upstream.routes.clear();
+
+    // Release the clients paused by this channel.
+    for(auto it = upstream.holds.begin(); it != upstream.holds.end(); ++it) {
+        auto client = m_clients.find(*it);
+
+        if(client != m_clients.end()) {
+            resume(*client->second);
+        }
+    }
+
+    for(auto it = m_clients.begin(); it != m_clients.end(); ++it) {
+        it->second->holds.erase(id);
+    }
+
+    upstream.holds.clear();
+    upstream.throttled = false;
+
+    // The remote node might have moved, so resolve it again next time.
+    m_endpoints.erase(upstream.key);
+
+    // Remove the channel from its pool, so that it won't be used for new sessions.
+    auto& channels = m_pools[upstream.key].channels;
+
+    channels.erase(std::remove(channels.begin(), channels.end(), id), channels.end());
+
+    m_reactor.post(deferred_erase_action<decltype(m_upstreams)> {
+        m_upstreams,
+        id
+    });
+}
+
+void
+forwarding_t::on_client_pressure(int fd, bool throttled) {
+    auto client_it = m_clients.find(fd);
+
+    if(client_it == m_clients.end()) {
+        return;
+    }
+
+    client_t& client = *client_it->second;
+
+    if(client.throttled == throttled) {
+        return;
+    }
+
+    client.throttled = throttled;
+
+    if(throttled) {
+        COCAINE_LOG_DEBUG(m_log, "client on fd %d can't keep up, pausing its channels", fd);
+
+        // NOTE: The channels are shared with other clients, which will be stalled as well, as there's
+        // no other way to stop the remote node from sending.
+        for(auto it = client.routes.begin(); it != client.routes.end(); ++it) {
+            auto upstream = m_upstreams.find(it->second.first);
+
+            if(upstream != m_upstreams.end() && client.holds.insert(it->second.first).second) {
+                pause(*upstream->second);
+            }
+        }
+    } else {
+        COCAINE_LOG_DEBUG(m_log, "client on fd %d has caught up, resuming its channels", fd);
+
+        for(auto it = client.holds.begin(); it != client.holds.end(); ++it) {
+            auto upstream = m_upstreams.find(*it);
+
+            if(upstream != m_upstreams.end()) {
+                resume(*upstream->second);
+            }
+        }
+
+        client.holds.clear();
+    }
+}
+
+void
+forwarding_t::on_upstream_pressure(int id, bool throttled) {
+    auto upstream_it = m_upstreams.find(id);
+
+    if(upstream_it == m_upstreams.end()) {
+        return;
+    }
+
+    upstream_t& upstream = *upstream_it->second;
+
+    if(upstream.throttled == throttled) {
+        return;
+    }
+
+    upstream.throttled = throttled;
+
+    if(throttled) {
+        COCAINE_LOG_DEBUG(m_log, "channel to '%s' can't keep up, pausing its clients", upstream.key);
+
+        for(auto it = upstream.routes.begin(); it != upstream.routes.end(); ++it) {
+            auto client = m_clients.find(it->second.first);
+
+            if(client != m_clients.end() && upstream.holds.insert(it->second.first).second) {
+                pause(*client->second);
+            }
+        }
+    } else {
+        for(auto it = upstream.holds.begin(); it != upstream.holds.end(); ++it) {
+            auto client = m_clients.find(*it);
+
+            if(client != m_clients.end()) {
+                resume(*client->second);
+            }
+        }
+
+        upstream.holds.clear();
+    }
+}
+
+void
+forwarding_t::on_resolve(const std::string& key, const std::vector<tcp::endpoint>& endpoints,
+                         const std::error_code& ec)
+{
+    auto pending_it = m_pending.find(key);
+
+    if(pending_it == m_pending.end()) {
+        return;
+    }
+
+    const std::vector<int> ids = std::move(pending_it->second);
+
+    m_pending.erase(pending_it);
+
+    if(ec || endpoints.empty()) {
+        COCAINE_LOG_ERROR(m_log, "unable to resolve '%s' - [%d] %s", key, ec.value(), ec.message());
+    } else {
+        m_endpoints[key] = endpoints;
+    }
+
+    for(auto it = ids.begin(); it != ids.end(); ++it) {
+        if(m_endpoints.count(key)) {
+            dial(*it);
+        } else {
+            on_upstream_failure(*it, ec ? ec : std::make_error_code(std::errc::host_unreachable));
+        }
+    }
+}
+
+int
+forwarding_t::select(const std::string& name) {
+    std::string host;
+    uint16_t port;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        auto it = m_proxies.find(name);
+
+        if(it == m_proxies.end() || it->second->targets.empty()) {
+            throw cocaine::error_t("the specified service is not available in the group");
+        }
+
+        const auto& targets = it->second->targets;
+
+        auto target = targets.begin();
+
+        std::advance(target, it->second->next++ % targets.size());
+
+        std::tie(host, port) = target->second;
+    }
+
+    pool_t& pool = m_pools[cocaine::format("%s:%d", host, port)];
+
+    if(pool.channels.size() < m_pool_limit) {
+        connect(host, port);
+    }
+
+    if(pool.channels.empty()) {
+        throw cocaine::error_t("unable to connect to the remote node");
+    }
+
+    return pool.channels[pool.next++ % pool.channels.size()];
+}
+
+void
+forwarding_t::connect(const std::string& host, uint16_t port) {
+    const std::string key = cocaine::format("%s:%d", host, port);
+    const int id = m_next_upstream++;
+
+    m_upstreams[id] = std::make_shared<upstream_t>(upstream_t {
+        key,
+        std::make_shared<channel<io::socket<tcp>>>(),
+        std::shared_ptr<dialer<tcp>>(),
+        1,
+        std::map<uint64_t, route_t>(),
+        true,
+        std::set<int>(),
+        0
+    });
+
+    m_pools[key].channels.push_back(id);
+
+    // NOTE: The channel is usable right away, the messages written into it are sent once connected.
+    if(m_endpoints.count(key)) {
+        dial(id);
+        return;
+    }
+
+    std::vector<int>& pending = m_pending[key];
+
+    pending.push_back(id);
+
+    if(pending.size() > 1) {
+        // The endpoints are already being resolved.
+        return;
+    }
+
+    if(!m_resolver->post(std::bind(&forwarding_t::lookup, this, key, host, port))) {
+        m_pending.erase(key);
+        on_upstream_failure(id, std::make_error_code(std::errc::resource_unavailable_try_again));
+    }
+}
+
+void
+forwarding_t::dial(int id) {
+    upstream_t& upstream = *m_upstreams[id];
+
+    upstream.dial = std::make_shared<dialer<tcp>>(m_reactor, m_endpoints[upstream.key]);
+    upstream.dial->bind(std::bind(&forwarding_t::on_upstream_connect, this, id, _1, _2), 10.0f);
+}
+
+void
+forwarding_t::lookup(const std::string& key, const std::string& host, uint16_t port) {
+    std::vector<tcp::endpoint> endpoints;
+    std::error_code ec;
+
+    try {
+        endpoints = resolver<tcp>::query(host, port);
+    } catch(const std::system_error& e) {
+        ec = e.code();
+    }
+
+    m_reactor.post(std::bind(&forwarding_t::on_resolve, this, key, endpoints, ec));
+}
@@ -0,0 +1,151 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/detail/gateways/rendezvous.hpp"
+#include "cocaine/detail/routing.hpp"
+
+#include "cocaine/context.hpp"
+#include "cocaine/logging.hpp"
+
+using namespace cocaine;
+using namespace cocaine::api;
+using namespace cocaine::gateway;
+
+namespace {
+
+struct match_uuid {
+    template<class T>
+    bool
+    operator()(const T& service) const {
+        return service.uuid == uuid;
+    }
+
+    const std::string& uuid;
+};
+
+} // namespace
+
+rendezvous_t::rendezvous_t(context_t& context, const std::string& name, const Json::Value& args):
+    category_type(context, name, args),
+    m_log(new logging::log_t(context, name))
+{
+#if defined(__clang__) || defined(HAVE_GCC46)
+    std::random_device device;
+    m_random_generator.seed(device());
+#else
+    m_random_generator.seed(static_cast<unsigned long>(::time(nullptr)));
+#endif
+}
+
+rendezvous_t::~rendezvous_t() {
+    // Empty.
+}
+
+auto
+rendezvous_t::resolve(const std::string& name) const -> metadata_t {
+    auto it = m_remote_services.find(name);
+
+    if(it == m_remote_services.end() || it->second.empty()) {
+        throw cocaine::error_t("the specified service is not available in the group");
+    }
+
+    // Requests without a key are not sticky, so any node would do.
+#if defined(__clang__) || defined(HAVE_GCC46)
+    std::uniform_int_distribution<size_t> distribution(0, it->second.size() - 1);
+#else
+    std::uniform_int<size_t> distribution(0, it->second.size() - 1);
+#endif
+
+    const remote_service_t& service = it->second[distribution(m_random_generator)];
+
+    COCAINE_LOG_DEBUG(m_log, "providing '%s' using node '%s'", name, service.uuid);
+
+    return service.meta;
+}
+
+auto
+rendezvous_t::resolve(const std::string& name, const std::string& key) const -> metadata_t {
+    auto it = m_remote_services.find(name);
+
+    if(it == m_remote_services.end() || it->second.empty()) {
+        throw cocaine::error_t("the specified service is not available in the group");
+    }
+
+    const uint64_t hash = routing::hash(key);
+
+    auto winner = it->second.end();
+    uint64_t best = 0;
+
+    for(auto service = it->second.begin(); service != it->second.end(); ++service) {
+        const uint64_t score = routing::mix(hash ^ service->hash);
+
+        // NOTE: Ties are broken by the node id, so that every node makes the same choice.
+        if(winner == it->second.end() || score > best || (score == best && service->uuid < winner->uuid)) {
+            winner = service;
+            best = score;
+        }
+    }
+
+    COCAINE_LOG_DEBUG(m_log, "providing '%s' for key '%s' using node '%s'", name, key, winner->uuid);
+
+    return winner->meta;
+}
+
+void
+rendezvous_t::consume(const std::string& uuid, const std::string& name, const metadata_t& meta) {
+    COCAINE_LOG_DEBUG(m_log, "consumed node '%s' service '%s'", uuid, name);
+
+    std::vector<remote_service_t>& services = m_remote_services[name];
+
+    // NOTE: A duplicate entry would double the share of this node in the requests without a key, so
+    // the existing entry is replaced instead.
+    auto it = std::find_if(services.begin(), services.end(), match_uuid { uuid });
+
+    if(it != services.end()) {
+        it->meta = meta;
+        return;
+    }
+
+    services.push_back(remote_service_t {
+        uuid,
+        meta,
+        routing::hash(uuid)
+    });
+}
+
+void
+rendezvous_t::cleanup(const std::string& uuid, const std::string& name) {
+    COCAINE_LOG_DEBUG(m_log, "removing node '%s' service '%s'", uuid, name);
+
+    auto it = m_remote_services.find(name);
+
+    if(it == m_remote_services.end()) {
+        return;
+    }
+
+    it->second.erase(
+        std::remove_if(it->second.begin(), it->second.end(), match_uuid { uuid }),
+        it->second.end()
+    );
+
+    if(it->second.empty()) {
+        m_remote_services.erase(it);
+    }
+}
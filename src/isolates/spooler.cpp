@@ -31,21 +31,23 @@ using namespace cocaine::isolate;
 
 void
 process_t::spool() {
-    std::string blob;
+    // NOTE: App archives can be quite large, so they're consumed directly from the storage memory,
+    // which is usually a mapping of the archive file.
+    api::blob_t blob;
 
     COCAINE_LOG_INFO(m_log, "deploying the app to '%s'", m_working_directory);
 
     auto storage = api::storage(m_context, "core");
 
     try {
-        blob = storage->get<std::string>("apps", m_name);
+        blob = storage->get_blob("apps", m_name);
     } catch(const storage_error_t& e) {
         COCAINE_LOG_ERROR(m_log, "unable to fetch the app from the storage - %s", e.what());
         throw cocaine::error_t("the '%s' app is not available", m_name);
     }
 
     try {
-        archive_t archive(m_context, blob);
+        archive_t archive(m_context, blob.data(), blob.size());
 
 #if BOOST_VERSION >= 104600
         archive.deploy(m_working_directory.native());
@@ -23,6 +23,7 @@
 
 #include "cocaine/api/gateway.hpp"
 
+#include "cocaine/asio/dialer.hpp"
 #include "cocaine/asio/reactor.hpp"
 #include "cocaine/asio/resolver.hpp"
 #include "cocaine/asio/socket.hpp"
@@ -39,6 +40,7 @@
 
 #include "cocaine/rpc/channel.hpp"
 
+#include "cocaine/traits/optional.hpp"
 #include "cocaine/traits/tree.hpp"
 #include "cocaine/traits/tuple.hpp"
 
@@ -47,14 +49,57 @@ using namespace std::placeholders;
 
 #include "routing.inl"
 #include "synchronization.inl"
+#include "discovery.inl"
+
+namespace {
+
+// Bands of the synchronization requests to the peer locators, the second one is used for the older
+// peers which don't support the incremental synchronization.
+const uint64_t delta_band  = 0;
+const uint64_t legacy_band = 1;
+
+// Announce intervals, in seconds. Nodes announce themselves more often right after the startup, so
+// that they're discovered quickly, and then back off exponentially to the steady state interval.
+const float initial_announce_interval = 0.5f;
+const float maximum_announce_interval = 5.0f;
+
+// Newly discovered nodes are accumulated for this long before being connected to.
+const float discovery_batch_interval = 0.5f;
+
+// Connection attempts to a node, across all of its endpoints, are limited by this timeout.
+const float connect_timeout = 10.0f;
+
+template<class Container>
+struct deferred_erase_action {
+    typedef Container container_type;
+    typedef typename container_type::key_type key_type;
+
+    void
+    operator()() {
+        target.erase(key);
+    }
+
+    container_type& target;
+    const key_type  key;
+};
+
+}
 
 locator_t::locator_t(context_t& context, io::reactor_t& reactor):
     dispatch_t(context, "service/locator"),
     m_context(context),
     m_log(new logging::log_t(context, "service/locator")),
     m_reactor(reactor),
+    m_announce_interval(initial_announce_interval),
     m_router(new router_t(*m_log.get()))
 {
+#if defined(__clang__) || defined(HAVE_GCC46)
+    std::random_device device;
+    m_random_generator.seed(device());
+#else
+    m_random_generator.seed(static_cast<unsigned long>(::time(nullptr)));
+#endif
+
     COCAINE_LOG_INFO(m_log, "this node's id is '%s'", m_context.config.network.uuid);
 
     try {
@@ -70,9 +115,14 @@ locator_t::locator_t(context_t& context, io::reactor_t& reactor):
         throw cocaine::error_t("unable to initialize the routing groups - %s", e.what());
     }
 
-    on<io::locator::resolve>(std::bind(&locator_t::resolve, this, _1));
+    on<io::locator::resolve>(std::bind(&locator_t::resolve, this, _1, _2));
     on<io::locator::reports>(std::bind(&locator_t::reports, this));
     on<io::locator::refresh>(std::bind(&locator_t::refresh, this, _1));
+    on<io::locator::resolve_if_changed>(std::bind(&locator_t::resolve_if_changed, this, _1, _2));
+
+    m_subscriber = std::make_shared<subscribe_slot_t>(*this);
+
+    on<io::locator::subscribe>(m_subscriber);
 
     if(!m_context.config.network.ports) {
         return;
@@ -143,12 +193,24 @@ locator_t::connect() {
         m_sink_watcher->set<locator_t, &locator_t::on_announce_event>(this);
         m_sink_watcher->start(m_sink->fd(), ev::READ);
 
+        m_batch_timer.reset(new ev::timer(m_reactor.native()));
+        m_batch_timer->set<locator_t, &locator_t::on_batch_timer>(this);
+
+        m_discovery.reset(new discovery_t(*this));
+
         m_gateway = m_context.get<api::gateway_t>(
             m_context.config.network.gateway.get().type,
             m_context,
             "service/locator",
             m_context.config.network.gateway.get().args
         );
+
+        // Local services take part in the keyed routing as well.
+        const synchronize_result_type local = dump();
+
+        for(auto it = local.begin(); it != local.end(); ++it) {
+            m_gateway->consume(m_context.config.network.uuid, it->first, it->second);
+        }
     }
 
     endpoint.port(10054);
@@ -165,24 +227,45 @@ locator_t::connect() {
     ::setsockopt(m_announce->fd(), IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
     ::setsockopt(m_announce->fd(), IPPROTO_IP, IP_MULTICAST_TTL,  &life, sizeof(life));
 
+    msgpack::sbuffer buffer;
+    msgpack::packer<msgpack::sbuffer> packer(buffer);
+
+    packer << key_type(
+        m_context.config.network.uuid,
+        m_context.config.network.hostname,
+        m_context.config.network.locator
+    );
+
+    // NOTE: The announce never changes during the node lifetime, so it's encoded only once.
+    m_announce_blob.assign(buffer.data(), buffer.size());
+
     m_announce_timer.reset(new ev::timer(m_reactor.native()));
     m_announce_timer->set<locator_t, &locator_t::on_announce_timer>(this);
-    m_announce_timer->start(0.0f, 5.0f);
+    m_announce_interval = initial_announce_interval;
+
+    // NOTE: The timer is rescheduled on every announce with a jittered interval, see below.
+    m_announce_timer->start(0.0f);
 
     m_synchronizer = std::make_shared<synchronize_slot_t>(*this);
+    m_delta = std::make_shared<delta_slot_t>(*this);
 
     on<io::locator::synchronize>(m_synchronizer);
+    on<io::locator::synchronize_delta>(m_delta);
 }
 
 void
 locator_t::disconnect() {
-    // Disable the synchronize method.
+    // Disable the synchronize methods.
     forget<io::locator::synchronize>();
+    forget<io::locator::synchronize_delta>();
 
     // Disconnect all the clients.
     m_synchronizer->shutdown();
     m_synchronizer.reset();
 
+    m_delta->shutdown();
+    m_delta.reset();
+
     m_announce_timer.reset();
     m_announce.reset();
 
@@ -190,6 +273,13 @@ locator_t::disconnect() {
         // Purge the routing tables.
         m_gateway.reset();
 
+        // Stop the discovery thread, the sockets it might still be connecting are dropped.
+        m_batch_timer.reset();
+        m_discovery.reset();
+
+        m_pending.clear();
+        m_batch.clear();
+
         // Disconnect all the routed peers.
         m_remotes.clear();
 
@@ -216,6 +306,8 @@ void
 locator_t::attach(const std::string& name, std::unique_ptr<actor_t>&& service) {
     uint16_t port = 0;
 
+    resolve_result_type info;
+
     {
         std::lock_guard<std::mutex> guard(m_services_mutex);
 
@@ -245,14 +337,21 @@ locator_t::attach(const std::string& name, std::unique_ptr<actor_t>&& service) {
 
         COCAINE_LOG_INFO(m_log, "service '%s' published on port %d", name, service->location().front().port());
 
+        info = service->metadata();
+
         m_services.emplace_back(name, std::move(service));
     }
 
-    m_router->add_local(name);
+    m_router->add_local(name, info);
 
-    if(m_synchronizer) {
-        m_synchronizer->announce();
+    if(m_gateway) {
+        // NOTE: The gateway is only accessed from the locator thread.
+        m_reactor.post(std::bind(&api::gateway_t::consume, m_gateway.get(), m_context.config.network.uuid,
+            name, info));
     }
+
+    announce();
+    notify();
 }
 
 auto
@@ -286,37 +385,51 @@ locator_t::detach(const std::string& name) -> std::unique_ptr<actor_t> {
 
     m_router->remove_local(name);
 
-    if(m_synchronizer) {
-        m_synchronizer->announce();
+    if(m_gateway) {
+        m_reactor.post(std::bind(&api::gateway_t::cleanup, m_gateway.get(), m_context.config.network.uuid,
+            name));
     }
 
+    announce();
+    notify();
+
     return service;
 }
 
 auto
-locator_t::resolve(const std::string& name) const -> resolve_result_type {
-    std::string target = m_router->select_service(name);
+locator_t::resolve(const std::string& name, const std::string& key) const -> resolve_result_type {
+    std::string target;
+    resolve_result_type info;
 
-    {
-        std::lock_guard<std::mutex> guard(m_services_mutex);
+    const bool local = m_router->resolve(name, key, target, info);
 
-        auto local = std::find_if(m_services.begin(), m_services.end(), match {
-            target
-        });
+    // NOTE: Keyed requests are routed by the key-aware gateways, which know about the local services
+    // too, so that the same key is handled by the same node across the whole cluster.
+    if(local && (key.empty() || !m_gateway || !m_gateway->keyed())) {
+        COCAINE_LOG_DEBUG(m_log, "providing '%s' using local node", name);
 
-        if(local != m_services.end()) {
-            COCAINE_LOG_DEBUG(m_log, "providing '%s' using local node", name);
+        // TODO: Might be a good idea to return an endpoint suitable for the interface
+        // which the client used to connect to the Locator.
+        return info;
+    }
 
-            // TODO: Might be a good idea to return an endpoint suitable for the interface
-            // which the client used to connect to the Locator.
-            return local->second->metadata();
-        }
+    if(!m_gateway) {
+        throw cocaine::error_t("the specified service is not available");
     }
 
-    if(m_gateway) {
+    if(key.empty()) {
         return m_gateway->resolve(target);
-    } else {
-        throw cocaine::error_t("the specified service is not available");
+    }
+
+    try {
+        return m_gateway->resolve(target, key);
+    } catch(const cocaine::error_t&) {
+        if(!local) {
+            throw;
+        }
+
+        // The gateway might not have caught up with the local services yet.
+        return info;
     }
 }
 
@@ -333,6 +446,19 @@ locator_t::dump() const -> synchronize_result_type {
     return result;
 }
 
+auto
+locator_t::loads() const -> load_map_t {
+    std::lock_guard<std::mutex> guard(m_services_mutex);
+
+    load_map_t result;
+
+    for(auto it = m_services.begin(); it != m_services.end(); ++it) {
+        result[it->first] = it->second->dispatch().load();
+    }
+
+    return result;
+}
+
 auto
 locator_t::reports() const -> reports_result_type {
     std::lock_guard<std::mutex> guard(m_services_mutex);
@@ -383,6 +509,41 @@ locator_t::refresh(const std::string& name) {
     } else {
         m_router->remove_group(name);
     }
+
+    notify();
+}
+
+auto
+locator_t::resolve_if_changed(const std::string& name, uint64_t generation) const -> resolve_if_changed_result_type {
+    // NOTE: The generation is read before resolving, so that a concurrent update could only make the
+    // result newer than the advertised generation, but never older.
+    const uint64_t current = m_router->generation(name);
+
+    if(current != 0 && current == generation) {
+        return resolve_if_changed_result_type(current, boost::none);
+    }
+
+    return resolve_if_changed_result_type(current, resolve(name, std::string()));
+}
+
+void
+locator_t::announce() {
+    if(!m_synchronizer) {
+        return;
+    }
+
+    // NOTE: Dump the services once for both kinds of the synchronization peers.
+    const synchronize_result_type dump = this->dump();
+
+    m_synchronizer->announce(dump);
+    m_delta->announce(dump);
+}
+
+void
+locator_t::notify() {
+    // NOTE: Subscriptions are only touched from the locator thread, and the gateway must be updated
+    // first anyway, so the notifications are deferred via reactor_t::post().
+    m_reactor.post(std::bind(&subscribe_slot_t::notify, m_subscriber));
 }
 
 void
@@ -415,6 +576,10 @@ locator_t::on_announce_event(ev::io&, int) {
     }
 
     if(m_remotes.find(key) == m_remotes.end()) {
+        if(m_pending.count(key)) {
+            return;
+        }
+
         std::string uuid;
         std::string hostname;
         uint16_t    port;
@@ -423,107 +588,134 @@ locator_t::on_announce_event(ev::io&, int) {
 
         COCAINE_LOG_INFO(m_log, "discovered node '%s' on '%s:%d'", uuid, hostname, port);
 
-        std::vector<io::tcp::endpoint> endpoints;
-
-        try {
-            endpoints = io::resolver<io::tcp>::query(hostname, port);
-        } catch(const std::system_error& e) {
-            COCAINE_LOG_ERROR(m_log, "unable to resolve node '%s' endpoints - [%d] %s", uuid, e.code().value(),
-                e.code().message());
+        // NOTE: The dialer is created once the node endpoints are resolved.
+        m_pending[key] = nullptr;
+        m_batch.push_back(key);
 
-            return;
+        // NOTE: During a cluster restart lots of nodes are discovered at once, so instead of being
+        // connected one by one they are handed over to the discovery thread in batches.
+        if(!m_batch_timer->is_active()) {
+            m_batch_timer->start(discovery_batch_interval);
         }
 
-        std::shared_ptr<io::channel<io::socket<io::tcp>>> channel;
+        return;
+    }
 
-        for(auto it = endpoints.begin(); it != endpoints.end(); ++it) {
-            try {
-                channel = std::make_shared<io::channel<io::socket<io::tcp>>>(
-                    m_reactor,
-                    std::make_shared<io::socket<io::tcp>>(*it)
-                );
-            } catch(const std::system_error& e) {
-                COCAINE_LOG_WARNING(m_log, "unable to connect to node '%s' via endpoint '%s' - [%d] %s", uuid, *it,
-                    e.code().value(), e.code().message());
+    COCAINE_LOG_DEBUG(m_log, "resetting the heartbeat timeout for node '%s'", std::get<0>(key));
 
-                continue;
-            }
+    m_remotes[key].timeout->stop();
+    m_remotes[key].timeout->start(60.0f);
+}
 
-            break;
-        }
+void
+locator_t::on_announce_timer(ev::timer&, int) {
+    std::error_code ec;
 
-        if(!channel) {
-            COCAINE_LOG_ERROR(m_log, "unable to connect to node '%s'", hostname);
-            return;
+    const ssize_t size = m_announce->write(m_announce_blob.data(), m_announce_blob.size(), ec);
+
+    if(size != static_cast<ssize_t>(m_announce_blob.size())) {
+        if(ec) {
+            COCAINE_LOG_ERROR(m_log, "unable to announce the node - [%d] %s", ec.value(), ec.message());
+        } else {
+            COCAINE_LOG_ERROR(m_log, "unable to announce the node");
         }
+    }
 
-        channel->rd->bind(
-            std::bind(&locator_t::on_message, this, key, _1),
-            std::bind(&locator_t::on_failure, this, key, _1)
-        );
+    const load_map_t current = loads();
 
-        channel->wr->bind(
-            std::bind(&locator_t::on_failure, this, key, _1)
-        );
+    if(m_gateway) {
+        for(auto it = current.begin(); it != current.end(); ++it) {
+            m_gateway->report(m_context.config.network.uuid, it->first, it->second);
+        }
+    }
 
-        auto timeout = std::make_shared<io::timeout_t>(m_reactor);
+    // NOTE: Piggyback the service loads on the announce schedule, the peers only get the changes.
+    m_delta->report(current);
 
-        timeout->bind(
-            std::bind(&locator_t::on_timeout, this, key)
-        );
+    // NOTE: Jitter the interval by 25% either way, so that the nodes which were started at the same
+    // time don't keep announcing themselves in sync.
+    const float jitter = 0.75f + 0.5f * static_cast<float>(m_random_generator() - m_random_generator.min()) /
+        static_cast<float>(m_random_generator.max() - m_random_generator.min());
 
-        m_remotes[key] = remote_t {
-            channel,
-            timeout
-        };
+    m_announce_timer->start(m_announce_interval * jitter);
 
-        channel->wr->write<io::locator::synchronize>(0UL);
-    }
+    m_announce_interval = std::min(m_announce_interval * 2, maximum_announce_interval);
+}
 
-    COCAINE_LOG_DEBUG(m_log, "resetting the heartbeat timeout for node '%s'", std::get<0>(key));
+void
+locator_t::on_batch_timer(ev::timer&, int) {
+    COCAINE_LOG_DEBUG(m_log, "connecting to %llu discovered %s", m_batch.size(), m_batch.size() == 1 ? "node" : "nodes");
 
-    m_remotes[key].timeout->stop();
-    m_remotes[key].timeout->start(60.0f);
+    m_discovery->enqueue(m_batch);
+
+    m_batch.clear();
 }
 
 void
-locator_t::on_announce_timer(ev::timer&, int) {
-    msgpack::sbuffer buffer;
-    msgpack::packer<msgpack::sbuffer> packer(buffer);
+locator_t::on_resolve(const key_type& key, const std::vector<io::tcp::endpoint>& endpoints) {
+    auto it = m_pending.find(key);
 
-    packer << key_type(
-        m_context.config.network.uuid,
-        m_context.config.network.hostname,
-        m_context.config.network.locator
-    );
+    if(it == m_pending.end()) {
+        // The locator has been disconnected in the meantime.
+        return;
+    }
 
-    std::error_code ec;
+    it->second = std::make_shared<io::dialer<io::tcp>>(m_reactor, endpoints);
 
-    if(m_announce->write(buffer.data(), buffer.size(), ec) != static_cast<ssize_t>(buffer.size())) {
-        if(ec) {
-            COCAINE_LOG_ERROR(m_log, "unable to announce the node - [%d] %s", ec.value(), ec.message());
-        } else {
-            COCAINE_LOG_ERROR(m_log, "unable to announce the node");
-        }
-    }
+    // NOTE: Connect to all the node endpoints in parallel, so that an unreachable one doesn't delay
+    // the whole thing until the TCP timeout.
+    it->second->bind(std::bind(&locator_t::on_connect, this, key, _1, _2), connect_timeout);
 }
 
-namespace {
+void
+locator_t::on_connect(const key_type& key, const std::shared_ptr<io::socket<io::tcp>>& socket,
+                      const std::error_code& ec)
+{
+    if(!m_pending.count(key)) {
+        return;
+    }
 
-template<class Container>
-struct deferred_erase_action {
-    typedef Container container_type;
-    typedef typename container_type::key_type key_type;
+    // NOTE: The dialer is still in use, so it's destroyed via reactor_t::post().
+    m_reactor.post(deferred_erase_action<decltype(m_pending)> {
+        m_pending,
+        key
+    });
 
-    void
-    operator()() {
-        target.erase(key);
+    if(!socket) {
+        COCAINE_LOG_ERROR(m_log, "unable to connect to node '%s' - [%d] %s", std::get<0>(key), ec.value(),
+            ec.message());
+        return;
     }
 
-    container_type& target;
-    const key_type  key;
-};
+    auto channel = std::make_shared<io::channel<io::socket<io::tcp>>>(m_reactor, socket);
 
+    channel->rd->bind(
+        std::bind(&locator_t::on_message, this, key, _1),
+        std::bind(&locator_t::on_failure, this, key, _1)
+    );
+
+    channel->wr->bind(
+        std::bind(&locator_t::on_failure, this, key, _1)
+    );
+
+    auto timeout = std::make_shared<io::timeout_t>(m_reactor);
+
+    timeout->bind(
+        std::bind(&locator_t::on_timeout, this, key)
+    );
+
+    m_remotes[key] = remote_t {
+        channel,
+        timeout,
+        boost::none,
+        false
+    };
+
+    // NOTE: Older nodes reject this with an error, and then they are synchronized with the plain
+    // synchronize method instead, on a different band, see on_message().
+    channel->wr->write<io::locator::synchronize_delta>(delta_band);
+
+    timeout->start(60.0f);
 }
 
 void
@@ -532,6 +724,20 @@ locator_t::on_message(const key_type& key, const io::message_t& message) {
 
     std::tie(uuid, std::ignore, std::ignore) = key;
 
+    auto remote_it = m_remotes.find(key);
+
+    if(remote_it == m_remotes.end()) {
+        // The node has already been dropped.
+        return;
+    }
+
+    auto& remote = remote_it->second;
+
+    if(message.band() != (remote.legacy ? legacy_band : delta_band)) {
+        // Leftovers of the rejected incremental synchronization request.
+        return;
+    }
+
     switch(message.id()) {
     case io::event_traits<io::rpc::chunk>::id: {
         std::string chunk;
@@ -541,8 +747,51 @@ locator_t::on_message(const key_type& key, const io::message_t& message) {
         msgpack::unpacked unpacked;
         msgpack::unpack(&unpacked, chunk.data(), chunk.size());
 
-        auto dump = unpacked.get().as<synchronize_result_type>();
-        auto diff = m_router->update_remote(uuid, dump);
+        std::pair<router_t::services_vector_t, router_t::services_vector_t> diff;
+
+        if(remote.legacy) {
+            // Every update is a full dump.
+            diff = m_router->update_remote(uuid, unpacked.get().as<synchronize_result_type>());
+
+            for(auto it = diff.second.begin(); it != diff.second.end(); ++it) {
+                m_gateway->cleanup(uuid, it->first);
+            }
+
+            for(auto it = diff.first.begin(); it != diff.first.end(); ++it) {
+                m_gateway->consume(uuid, it->first, it->second);
+            }
+
+            if(!diff.first.empty() || !diff.second.empty()) {
+                notify();
+            }
+
+            break;
+        }
+
+        uint64_t sequence;
+        synchronize_result_type changed;
+        std::vector<std::string> gone;
+        load_map_t loads;
+
+        std::tie(sequence, changed, gone, loads) = unpacked.get().as<synchronize_delta_result_type>();
+
+        if(!remote.sequence) {
+            // The first update is always a full dump.
+            diff = m_router->update_remote(uuid, changed);
+        } else if(sequence == remote.sequence.get() + 1) {
+            diff = m_router->patch_remote(uuid, changed, gone);
+        } else {
+            COCAINE_LOG_WARNING(m_log, "node '%s' updates are out of sequence, expected %llu, got %llu", uuid,
+                remote.sequence.get() + 1, sequence);
+
+            // NOTE: Drop this node altogether, it will be rediscovered with the next announce and
+            // then synchronized from scratch with a full dump.
+            drop(key);
+
+            return;
+        }
+
+        remote.sequence = sequence;
 
         for(auto it = diff.second.begin(); it != diff.second.end(); ++it) {
             m_gateway->cleanup(uuid, it->first);
@@ -551,24 +800,37 @@ locator_t::on_message(const key_type& key, const io::message_t& message) {
         for(auto it = diff.first.begin(); it != diff.first.end(); ++it) {
             m_gateway->consume(uuid, it->first, it->second);
         }
+
+        for(auto it = loads.begin(); it != loads.end(); ++it) {
+            m_gateway->report(uuid, it->first, it->second);
+        }
+
+        if(!diff.first.empty() || !diff.second.empty()) {
+            notify();
+        }
     } break;
 
     case io::event_traits<io::rpc::error>::id:
-    case io::event_traits<io::rpc::choke>::id: {
-        COCAINE_LOG_INFO(m_log, "node '%s' has been shut down", uuid);
+        if(!remote.legacy && !remote.sequence) {
+            COCAINE_LOG_INFO(m_log, "node '%s' doesn't support the incremental synchronization, "
+                "falling back to the full dumps", uuid);
 
-        auto removed = m_router->remove_remote(uuid);
+            remote.legacy = true;
+            remote.channel->wr->write<io::locator::synchronize>(legacy_band);
 
-        for(auto it = removed.begin(); it != removed.end(); ++it) {
-            m_gateway->cleanup(uuid, it->first);
+            break;
         }
 
-        // NOTE: It is dangerous to remove the channel while the message is still being
-        // processed, so we defer it via reactor_t::post().
-        m_reactor.post(deferred_erase_action<decltype(m_remotes)> {
-            m_remotes,
-            key
-        });
+        COCAINE_LOG_INFO(m_log, "node '%s' has been shut down", uuid);
+
+        drop(key);
+
+        break;
+
+    case io::event_traits<io::rpc::choke>::id: {
+        COCAINE_LOG_INFO(m_log, "node '%s' has been shut down", uuid);
+
+        drop(key);
     } break;
 
     default:
@@ -576,6 +838,30 @@ locator_t::on_message(const key_type& key, const io::message_t& message) {
     }
 }
 
+void
+locator_t::drop(const key_type& key) {
+    std::string uuid;
+
+    std::tie(uuid, std::ignore, std::ignore) = key;
+
+    auto removed = m_router->remove_remote(uuid);
+
+    for(auto it = removed.begin(); it != removed.end(); ++it) {
+        m_gateway->cleanup(uuid, it->first);
+    }
+
+    if(!removed.empty()) {
+        notify();
+    }
+
+    // NOTE: It is dangerous to remove the channel while the message is still being
+    // processed, so we defer it via reactor_t::post().
+    m_reactor.post(deferred_erase_action<decltype(m_remotes)> {
+        m_remotes,
+        key
+    });
+}
+
 void
 locator_t::on_failure(const key_type& key, const std::error_code& ec) {
     std::string uuid;
@@ -594,6 +880,10 @@ locator_t::on_failure(const key_type& key, const std::error_code& ec) {
         m_gateway->cleanup(uuid, it->first);
     }
 
+    if(!removed.empty()) {
+        notify();
+    }
+
     // NOTE: Safe to do since errors are queued up.
     m_remotes.erase(key);
 }
@@ -612,6 +902,10 @@ locator_t::on_timeout(const key_type& key) {
         m_gateway->cleanup(uuid, it->first);
     }
 
+    if(!removed.empty()) {
+        notify();
+    }
+
     // NOTE: Safe to do since timeouts are not related to I/O.
     m_remotes.erase(key);
 }
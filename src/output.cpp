@@ -0,0 +1,92 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/detail/output.hpp"
+
+#include <cstring>
+
+using namespace cocaine::engine;
+
+output_ring_t::output_ring_t(size_t lines, size_t capacity):
+    m_arena(capacity),
+    m_offset(0),
+    m_index(lines)
+{ }
+
+void
+output_ring_t::push(const char* line, size_t size) {
+    if(m_index.capacity() == 0 || m_arena.empty()) {
+        return;
+    }
+
+    // Truncate the lines which don't fit into the arena at all.
+    size = std::min(size, m_arena.size());
+
+    if(m_arena.size() - m_offset < size) {
+        // NOTE: Lines are never split, so the rest of the arena is skipped along with the lines
+        // still stored there, which are the oldest ones.
+        while(!m_index.empty() && m_index.front().offset >= m_offset) {
+            m_index.pop_front();
+        }
+
+        m_offset = 0;
+    }
+
+    evict(m_offset, size);
+
+    std::memcpy(m_arena.data() + m_offset, line, size);
+
+    // NOTE: If the index is full, this implicitly evicts the oldest line.
+    m_index.push_back(line_t { m_offset, size });
+
+    m_offset += size;
+}
+
+std::vector<std::string>
+output_ring_t::lines() const {
+    std::vector<std::string> result;
+
+    result.reserve(m_index.size());
+
+    for(auto it = m_index.begin(); it != m_index.end(); ++it) {
+        result.emplace_back(m_arena.data() + it->offset, it->size);
+    }
+
+    return result;
+}
+
+void
+output_ring_t::evict(size_t offset, size_t size) {
+    // The oldest lines are always the ones right after the write position.
+    while(!m_index.empty()) {
+        const line_t& line = m_index.front();
+
+        // NOTE: Empty lines right at the write position are overwritten as well, even though they
+        // don't take any space, as the lines behind them do.
+        const bool overlaps = line.offset < offset + size &&
+                              (line.offset >= offset || line.offset + line.size > offset);
+
+        if(!overlaps) {
+            break;
+        }
+
+        m_index.pop_front();
+    }
+}
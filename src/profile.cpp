@@ -34,8 +34,10 @@ profile_t::profile_t(context_t& context, const std::string& name_):
     termination_timeout = get("termination-timeout", defaults::termination_timeout).asDouble();
     concurrency         = get("concurrency", static_cast<Json::UInt>(defaults::concurrency)).asUInt();
     crashlog_limit      = get("crashlog-limit", static_cast<Json::UInt>(defaults::crashlog_limit)).asUInt();
+    crashlog_size       = get("crashlog-size", static_cast<Json::UInt>(defaults::crashlog_size)).asUInt();
     pool_limit          = get("pool-limit", static_cast<Json::UInt>(defaults::pool_limit)).asUInt();
     queue_limit         = get("queue-limit", static_cast<Json::UInt>(defaults::queue_limit)).asUInt();
+    shared_ring_size    = get("shared-ring-size", static_cast<Json::UInt>(defaults::shared_ring_size)).asUInt();
 
     unsigned long default_threshold = std::max(1UL, queue_limit / pool_limit / 2);
 
@@ -73,5 +75,9 @@ profile_t::profile_t(context_t& context, const std::string& name_):
     if(concurrency == 0) {
         throw cocaine::error_t("engine concurrency must be positive");
     }
+
+    if(shared_ring_size & (shared_ring_size - 1)) {
+        throw cocaine::error_t("engine shared ring size must be a power of two");
+    }
 }
 
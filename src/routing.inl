@@ -18,17 +18,13 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <random>
+#include "cocaine/detail/atomic.hpp"
+#include "cocaine/detail/routing.hpp"
 
-namespace routing {
+#include <random>
+#include <unordered_map>
 
-#if defined(__clang__) || defined(HAVE_GCC46)
-typedef std::default_random_engine random_generator_t;
-typedef std::uniform_int_distribution<unsigned int> uniform_uint;
-#else
-typedef std::minstd_rand0 random_generator_t;
-typedef std::uniform_int<unsigned int> uniform_uint;
-#endif
+namespace cocaine { namespace routing {
 
 struct group_index_t {
     group_index_t();
@@ -60,14 +56,55 @@ struct group_index_t {
         return m_sum;
     }
 
+    // Built on demand and cached until the next change.
+    std::shared_ptr<const alias_table_t>
+    table() const;
+
 private:
     std::vector<std::string> m_services;
     std::vector<unsigned int> m_weights;
     std::vector<unsigned int> m_used_weights; // = original weight or 0 if there is no such service in the Locator
     unsigned int m_sum;
+
+    mutable std::shared_ptr<const alias_table_t> m_table;
 };
 
-} // namespace routing
+// NOTE: Holds an immutable snapshot, which is replaced as a whole on updates. The spinlock only
+// protects the pointer copy itself, so readers never wait for the writers to rebuild anything.
+
+template<class T>
+struct snapshot_t {
+    snapshot_t() {
+        m_lock.clear();
+    }
+
+    std::shared_ptr<const T>
+    load() const {
+        while(m_lock.test_and_set(std::memory_order_acquire));
+
+        std::shared_ptr<const T> result = m_ptr;
+
+        m_lock.clear(std::memory_order_release);
+
+        return result;
+    }
+
+    void
+    store(std::shared_ptr<const T> value) {
+        while(m_lock.test_and_set(std::memory_order_acquire));
+
+        // The old snapshot is destroyed outside of the critical section.
+        m_ptr.swap(value);
+
+        m_lock.clear(std::memory_order_release);
+    }
+
+private:
+    mutable std::atomic_flag m_lock;
+    std::shared_ptr<const T> m_ptr;
+};
+
+}} // namespace cocaine::routing
 
 using namespace routing;
 
@@ -81,7 +118,7 @@ class locator_t::router_t {
         router_t(logging::log_t& log);
 
         void
-        add_local(const std::string& name);
+        add_local(const std::string& name, const resolve_result_type& info);
 
         void
         remove_local(const std::string& name);
@@ -89,6 +126,11 @@ class locator_t::router_t {
         std::pair<services_vector_t, services_vector_t> // added, removed
         update_remote(const std::string& uuid, const synchronize_result_type& dump);
 
+        // Applies an incremental update, changed services are reported as both removed and added.
+        std::pair<services_vector_t, services_vector_t> // added, removed
+        patch_remote(const std::string& uuid, const synchronize_result_type& changed,
+                     const std::vector<std::string>& gone);
+
         std::map<std::string, resolve_result_type> // services of the removed node
         remove_remote(const std::string& uuid);
 
@@ -101,8 +143,23 @@ class locator_t::router_t {
         void
         remove_group(const std::string& name);
 
-        std::string
-        select_service(const std::string& name) const;
+        // Lock-free, works on the current routing table snapshot. Returns true and fills in the
+        // info if the service the name is routed to is local to this node. Groups are resolved
+        // randomly, unless there's a routing key, in which case the choice is stable.
+        bool
+        resolve(const std::string& name, const std::string& key, std::string& target,
+                resolve_result_type& info) const;
+
+        // Generation of the last routing table update which has changed the given service, or zero
+        // for the unknown services and the routing groups, as their resolve results are randomized
+        // and therefore can't be cached by the clients.
+        uint64_t
+        generation(const std::string& name) const;
+
+        // Describes the routing group by its members with their weights and generations, so that the
+        // group changes can be detected without resolving it. Returns false if it's not a group.
+        bool
+        group_state(const std::string& name, std::string& state) const;
 
     private:
         void
@@ -111,6 +168,16 @@ class locator_t::router_t {
         void
         remove(const std::string& uuid, const std::string& name);
 
+        // Marks the service as changed by the routing table update in progress.
+        void
+        touch(const std::string& name);
+
+        struct table_t;
+
+        // Rebuilds the routing table snapshot. Must be called with the router lock held.
+        void
+        publish();
+
     private:
         typedef std::map<
             std::string,
@@ -138,8 +205,8 @@ class locator_t::router_t {
             void
             remove_service(const std::string& name);
 
-            std::string
-            select_service(const std::string& group_name) const;
+            void
+            populate(table_t& table) const;
 
         private:
             // Maps group name to services.
@@ -155,14 +222,35 @@ class locator_t::router_t {
 
             logging::log_t& m_log;
             const locator_t::router_t& m_router;
-
-            mutable random_generator_t m_generator;
         };
 
         groups_t m_groups;
 
-        // Router interlocking.
-        mutable std::mutex m_mutex;
+        // Router interlocking, for the writers only.
+        std::mutex m_mutex;
+
+        // Bumped on every routing table update.
+        uint64_t m_generation;
+
+        // Service -> generation of the last update which has changed it. Removed services are dropped:
+        // generations only grow, so a service which comes back never gets an old generation again.
+        std::map<std::string, uint64_t> m_generations;
+
+        struct table_t {
+            std::unordered_map<std::string, uint64_t> generations;
+
+            // Unchanged groups share their alias tables with the previous snapshots.
+            std::unordered_map<std::string, std::shared_ptr<const alias_table_t>> groups;
+
+            // Local services.
+            std::unordered_map<std::string, resolve_result_type> local;
+        };
+
+        // Current routing table, swapped on every update.
+        snapshot_t<table_t> m_table;
+
+        // Lock-free random sequence for the weighted selection.
+        mutable std::atomic<uint64_t> m_sequence;
 };
 
 group_index_t::group_index_t() :
@@ -185,24 +273,30 @@ void
 group_index_t::add(size_t service_index) {
     m_sum += m_weights[service_index];
     m_used_weights[service_index] = m_weights[service_index];
+    m_table.reset();
 }
 
 void
 group_index_t::remove(size_t service_index) {
     m_sum -= m_weights[service_index];
     m_used_weights[service_index] = 0;
+    m_table.reset();
+}
+
+std::shared_ptr<const alias_table_t>
+group_index_t::table() const {
+    if(!m_table) {
+        m_table = std::make_shared<alias_table_t>(m_services, m_used_weights);
+    }
+
+    return m_table;
 }
 
 locator_t::router_t::groups_t::groups_t(logging::log_t& log, const router_t& router) :
     m_log(log),
     m_router(router)
 {
-#if defined(__clang__) || defined(HAVE_GCC46)
-    std::random_device device;
-    m_generator.seed(device());
-#else
-    m_generator.seed(static_cast<unsigned long>(::time(nullptr)));
-#endif
+    // Empty.
 }
 
 void
@@ -273,40 +367,35 @@ locator_t::router_t::groups_t::remove_service(const std::string& name) {
     }
 }
 
-std::string
-locator_t::router_t::groups_t::select_service(const std::string& group_name) const {
-    auto group_it = m_groups.find(group_name);
-
-    if(group_it == m_groups.end() || group_it->second.sum() != 0) {
-        return group_name;
-    }
-
-    uniform_uint distribution(1, group_it->second.sum());
-    unsigned int max = distribution(m_generator);
-
-    for(size_t i = 0; i < group_it->second.services().size(); ++i) {
-        if(max <= group_it->second.used_weights()[i]) {
-            return group_it->second.services()[i];
-        } else {
-            max -= group_it->second.used_weights()[i];
-        }
+void
+locator_t::router_t::groups_t::populate(table_t& table) const {
+    for(auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+        table.groups[it->first] = it->second.table();
     }
-
-    return group_name;
 }
 
 locator_t::router_t::router_t(logging::log_t& log):
-    m_groups(log, *this)
+    m_groups(log, *this),
+    m_generation(0)
 {
-    // Empty.
+#if defined(__clang__) || defined(HAVE_GCC46)
+    std::random_device device;
+    m_sequence = (static_cast<uint64_t>(device()) << 32) | device();
+#else
+    m_sequence = static_cast<uint64_t>(::time(nullptr));
+#endif
+
+    publish();
 }
 
 void
-locator_t::router_t::add_local(const std::string& name) {
+locator_t::router_t::add_local(const std::string& name, const resolve_result_type& info) {
     std::lock_guard<std::mutex> guard(m_mutex);
 
     // "local" is a special "uuid" that indicates local services.
-    add("local", name, resolve_result_type());
+    add("local", name, info);
+
+    publish();
 }
 
 void
@@ -315,6 +404,8 @@ locator_t::router_t::remove_local(const std::string& name) {
 
     // "local" is a special "uuid" that indicates local services.
     remove("local", name);
+
+    publish();
 }
 
 auto
@@ -360,6 +451,56 @@ locator_t::router_t::update_remote(const std::string& uuid, const synchronize_re
         }
     }
 
+    if(!added.empty() || !removed.empty()) {
+        publish();
+    }
+
+    return std::make_pair(std::move(added), std::move(removed));
+}
+
+auto
+locator_t::router_t::patch_remote(const std::string& uuid, const synchronize_result_type& changed,
+                                  const std::vector<std::string>& gone)
+    -> std::pair<services_vector_t, services_vector_t>
+{
+    services_vector_t added, removed;
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto uuid_it = m_inverted.find(uuid);
+
+    if(uuid_it != m_inverted.end()) {
+        for(auto it = gone.begin(); it != gone.end(); ++it) {
+            auto service_it = uuid_it->second.find(*it);
+
+            if(service_it != uuid_it->second.end()) {
+                removed.push_back(*service_it);
+            }
+        }
+
+        for(auto it = changed.begin(); it != changed.end(); ++it) {
+            auto service_it = uuid_it->second.find(it->first);
+
+            if(service_it != uuid_it->second.end()) {
+                removed.push_back(*service_it);
+            }
+        }
+    }
+
+    added.assign(changed.begin(), changed.end());
+
+    // NOTE: Removals go first, as they might erase the inverted index entry for this node.
+    for(auto it = removed.begin(); it != removed.end(); ++it) {
+        remove(uuid, it->first);
+    }
+
+    for(auto it = added.begin(); it != added.end(); ++it) {
+        add(uuid, it->first, it->second);
+    }
+
+    if(!added.empty() || !removed.empty()) {
+        publish();
+    }
+
     return std::make_pair(std::move(added), std::move(removed));
 }
 
@@ -387,12 +528,16 @@ locator_t::router_t::remove_remote(const std::string& uuid)
                 m_groups.remove_service(it->first);
             }
         }
+
+        touch(it->first);
     }
 
     removed = std::move(uuid_it->second);
 
     m_inverted.erase(uuid_it);
 
+    publish();
+
     return removed;
 }
 
@@ -405,18 +550,114 @@ void
 locator_t::router_t::add_group(const std::string& name, const std::map<std::string, unsigned int>& group) {
     std::lock_guard<std::mutex> guard(m_mutex);
     m_groups.add_group(name, group);
+    publish();
 }
 
 void
 locator_t::router_t::remove_group(const std::string& name) {
     std::lock_guard<std::mutex> guard(m_mutex);
     m_groups.remove_group(name);
+    publish();
 }
 
-std::string
-locator_t::router_t::select_service(const std::string& name) const {
-    std::lock_guard<std::mutex> guard(m_mutex);
-    return m_groups.select_service(name);
+bool
+locator_t::router_t::resolve(const std::string& name, const std::string& key, std::string& target,
+                             resolve_result_type& info) const
+{
+    const std::shared_ptr<const table_t> table = m_table.load();
+
+    target = name;
+
+    auto group_it = table->groups.find(name);
+
+    if(group_it != table->groups.end() && !group_it->second->empty()) {
+        // NOTE: SplitMix64 over an atomic counter, so that concurrent resolves don't contend on a
+        // shared generator state.
+        const uint64_t seed = key.empty() ? m_sequence.fetch_add(2 * 0x9E3779B97F4A7C15ULL) : hash(key);
+
+        target = group_it->second->select(mix(seed), mix(seed + 0x9E3779B97F4A7C15ULL));
+    }
+
+    auto local_it = table->local.find(target);
+
+    if(local_it == table->local.end()) {
+        return false;
+    }
+
+    info = local_it->second;
+
+    return true;
+}
+
+uint64_t
+locator_t::router_t::generation(const std::string& name) const {
+    const std::shared_ptr<const table_t> table = m_table.load();
+
+    if(table->groups.find(name) != table->groups.end()) {
+        return 0;
+    }
+
+    auto it = table->generations.find(name);
+
+    if(it == table->generations.end()) {
+        return 0;
+    }
+
+    return it->second;
+}
+
+bool
+locator_t::router_t::group_state(const std::string& name, std::string& state) const {
+    const std::shared_ptr<const table_t> table = m_table.load();
+
+    auto group_it = table->groups.find(name);
+
+    if(group_it == table->groups.end()) {
+        return false;
+    }
+
+    const std::vector<std::string>& services = group_it->second->services();
+    const std::vector<unsigned int>& weights = group_it->second->weights();
+
+    // NOTE: Never empty, even for the empty groups.
+    state = "group;";
+
+    for(size_t i = 0; i < services.size(); ++i) {
+        if(weights[i] == 0) {
+            continue;
+        }
+
+        auto it = table->generations.find(services[i]);
+
+        state += cocaine::format(
+            "%d:%s:%d:%d;",
+            services[i].size(),
+            services[i],
+            weights[i],
+            it != table->generations.end() ? it->second : 0
+        );
+    }
+
+    return true;
+}
+
+void
+locator_t::router_t::publish() {
+    auto table = std::make_shared<table_t>();
+
+    ++m_generation;
+
+    table->generations.insert(m_generations.begin(), m_generations.end());
+
+    m_groups.populate(*table);
+
+    auto local_it = m_inverted.find("local");
+
+    if(local_it != m_inverted.end()) {
+        table->local.insert(local_it->second.begin(), local_it->second.end());
+    }
+
+    m_table.store(table);
 }
 
 void
@@ -428,6 +669,8 @@ locator_t::router_t::add(const std::string& uuid, const std::string& name, const
     if(insert_result.second) {
         m_groups.add_service(name);
     }
+
+    touch(name);
 }
 
 void
@@ -452,4 +695,18 @@ locator_t::router_t::remove(const std::string& uuid, const std::string& name) {
             m_groups.remove_service(name);
         }
     }
+
+    touch(name);
+}
+
+void
+locator_t::router_t::touch(const std::string& name) {
+    if(m_services.find(name) == m_services.end()) {
+        // Unknown services report zero, which is never treated as unchanged.
+        m_generations.erase(name);
+        return;
+    }
+
+    // NOTE: Every change is followed by a publish(), which bumps the generation.
+    m_generations[name] = m_generation + 1;
 }
@@ -21,20 +21,494 @@
 #include "cocaine/detail/services/storage.hpp"
 
 #include "cocaine/api/storage.hpp"
+#include "cocaine/api/stream.hpp"
 
 #include "cocaine/context.hpp"
 #include "cocaine/messages.hpp"
 
+#include "cocaine/detail/async_storage.hpp"
+#include "cocaine/detail/executor.hpp"
+
+#include <deque>
+
+using namespace cocaine;
 using namespace cocaine::service;
 using namespace std::placeholders;
 
+namespace {
+
+typedef api::category_traits<api::storage_t>::ptr_type storage_ptr;
+
+// Streamed objects are sent to the clients in chunks of this size.
+const size_t chunk_size = 64 * 1024;
+
+// When this many bytes received from a client are waiting for the storage, the client is paused until
+// the queue is drained down to the low watermark.
+const size_t high_watermark = 1024 * 1024;
+const size_t low_watermark  = 256 * 1024;
+
+// NOTE: Receives an object from the client chunk by chunk and feeds it to a storage writer on the
+// executor, in order. The client is paused while the storage is falling behind, so that only a few
+// chunks are ever queued, whatever the object size is. The object is committed when the client closes
+// the stream, and the result is then reported via the upstream.
+
+struct write_stream_t:
+    public dispatch_t,
+    public std::enable_shared_from_this<write_stream_t>
+{
+    write_stream_t(context_t& context, const std::string& name, const storage_ptr& storage_,
+                   executor_t& executor_, const api::stream_ptr_t& upstream_, const std::string& collection_,
+                   const std::string& key_, const std::vector<std::string>& tags_);
+
+    void
+    push(const std::string& chunk) {
+        enqueue(chunk, false);
+    }
+
+    void
+    close() {
+        enqueue(std::string(), true);
+    }
+
+private:
+    void
+    enqueue(const std::string& chunk, bool last) {
+        bool post = false;
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+
+            if(failed || closed) {
+                return;
+            }
+
+            if(last) {
+                closed = true;
+            } else {
+                queue.push_back(chunk);
+                queued += chunk.size();
+            }
+
+            // NOTE: The upstream is paused and resumed under the lock, so that these can't be reordered.
+            if(!paused && queued >= high_watermark) {
+                paused = true;
+                upstream->pause();
+            }
+
+            if(!scheduled) {
+                scheduled = post = true;
+            }
+        }
+
+        if(post && !executor.post(std::bind(&write_stream_t::drain, shared_from_this()))) {
+            fail("storage is overloaded");
+        }
+    }
+
+    void
+    drain() {
+        while(true) {
+            std::string chunk;
+            bool last = false;
+
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+
+                if(failed) {
+                    return;
+                }
+
+                if(!queue.empty()) {
+                    chunk.swap(queue.front());
+                    queue.pop_front();
+
+                    queued -= chunk.size();
+
+                    if(paused && queued <= low_watermark) {
+                        paused = false;
+                        upstream->resume();
+                    }
+                } else if(closed) {
+                    last = true;
+                } else {
+                    scheduled = false;
+                    return;
+                }
+            }
+
+            try {
+                if(!writer) {
+                    writer = storage->writer(collection, key, tags);
+                }
+
+                if(last) {
+                    writer->commit();
+                } else {
+                    writer->append(chunk.data(), chunk.size());
+                }
+            } catch(const std::exception& e) {
+                fail(e.what());
+                return;
+            }
+
+            if(last) {
+                writer.reset();
+                upstream->close();
+                return;
+            }
+        }
+    }
+
+    void
+    fail(const std::string& reason) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+
+            failed = true;
+            queue.clear();
+            queued = 0;
+        }
+
+        // Discards the partially written object.
+        writer.reset();
+
+        upstream->error(invocation_error, reason);
+        upstream->close();
+    }
+
+private:
+    struct chunk_slot_t:
+        public io::basic_slot<io::streaming::write>
+    {
+        chunk_slot_t(write_stream_t& self_):
+            self(self_)
+        { }
+
+        virtual
+        std::shared_ptr<dispatch_t>
+        operator()(const msgpack::object& unpacked, const api::stream_ptr_t& /* upstream */) {
+            io::detail::invoke<io::event_traits<io::streaming::write>::tuple_type>::apply(
+                std::bind(&write_stream_t::push, &self, _1),
+                unpacked
+            );
+
+            return self.shared_from_this();
+        }
+
+    private:
+        write_stream_t& self;
+    };
+
+    struct close_slot_t:
+        public io::basic_slot<io::streaming::close>
+    {
+        close_slot_t(write_stream_t& self_):
+            self(self_)
+        { }
+
+        virtual
+        std::shared_ptr<dispatch_t>
+        operator()(const msgpack::object& /* unpacked */, const api::stream_ptr_t& /* upstream */) {
+            // NOTE: Unlike the blocking slots, this one doesn't close the upstream right away, as the
+            // outcome is only known once the object is committed.
+            self.close();
+
+            return std::shared_ptr<dispatch_t>();
+        }
+
+    private:
+        write_stream_t& self;
+    };
+
+private:
+    const storage_ptr storage;
+    executor_t& executor;
+
+    const api::stream_ptr_t upstream;
+
+    const std::string collection;
+    const std::string key;
+    const std::vector<std::string> tags;
+
+    // Only touched by the drain, which never runs concurrently with itself.
+    std::unique_ptr<api::object_writer_t> writer;
+
+    std::mutex mutex;
+
+    std::deque<std::string> queue;
+
+    // Total size of the queued chunks.
+    size_t queued;
+
+    bool paused;
+    bool scheduled;
+    bool closed;
+    bool failed;
+};
+
+write_stream_t::write_stream_t(context_t& context, const std::string& name, const storage_ptr& storage_,
+                               executor_t& executor_, const api::stream_ptr_t& upstream_,
+                               const std::string& collection_, const std::string& key_,
+                               const std::vector<std::string>& tags_):
+    dispatch_t(context, name),
+    storage(storage_),
+    executor(executor_),
+    upstream(upstream_),
+    collection(collection_),
+    key(key_),
+    tags(tags_),
+    queued(0),
+    paused(false),
+    scheduled(false),
+    closed(false),
+    failed(false)
+{
+    on<io::streaming::write>(std::make_shared<chunk_slot_t>(*this));
+    on<io::streaming::close>(std::make_shared<close_slot_t>(*this));
+}
+
+struct read_stream_slot_t:
+    public io::basic_slot<io::storage::read_stream>
+{
+    read_stream_slot_t(const storage_ptr& storage_, executor_t& executor_):
+        storage(storage_),
+        executor(executor_)
+    { }
+
+    virtual
+    std::shared_ptr<dispatch_t>
+    operator()(const msgpack::object& unpacked, const api::stream_ptr_t& upstream) {
+        io::detail::invoke<io::event_traits<io::storage::read_stream>::tuple_type>::apply(
+            std::bind(&read_stream_slot_t::start, this, upstream, _1, _2),
+            unpacked
+        );
+
+        // Return an empty protocol dispatch.
+        return std::shared_ptr<dispatch_t>();
+    }
+
+private:
+    void
+    start(const api::stream_ptr_t& upstream, const std::string& collection, const std::string& key) {
+        std::make_shared<read_stream_t>(storage, executor, upstream, collection, key)->start();
+    }
+
+private:
+    const storage_ptr storage;
+    executor_t& executor;
+};
+
+struct write_stream_slot_t:
+    public io::basic_slot<io::storage::write_stream>
+{
+    write_stream_slot_t(context_t& context_, const std::string& name_, const storage_ptr& storage_,
+                        executor_t& executor_):
+        context(context_),
+        name(name_),
+        storage(storage_),
+        executor(executor_)
+    { }
+
+    virtual
+    std::shared_ptr<dispatch_t>
+    operator()(const msgpack::object& unpacked, const api::stream_ptr_t& upstream) {
+        return io::detail::invoke<io::event_traits<io::storage::write_stream>::tuple_type>::apply(
+            std::bind(&write_stream_slot_t::start, this, upstream, _1, _2, _3),
+            unpacked
+        );
+    }
+
+private:
+    std::shared_ptr<dispatch_t>
+    start(const api::stream_ptr_t& upstream, const std::string& collection, const std::string& key,
+          const std::vector<std::string>& tags)
+    {
+        return std::make_shared<write_stream_t>(
+            std::ref(context),
+            name,
+            storage,
+            std::ref(executor),
+            upstream,
+            collection,
+            key,
+            tags
+        );
+    }
+
+private:
+    context_t& context;
+
+    const std::string name;
+    const storage_ptr storage;
+    executor_t& executor;
+};
+
+}
+
+struct read_stream_t::pressure_action_t {
+    void
+    operator()(bool throttled) const {
+        if(auto self = ptr.lock()) {
+            self->on_pressure(throttled);
+        }
+    }
+
+    const std::weak_ptr<read_stream_t> ptr;
+};
+
+read_stream_t::read_stream_t(const storage_ptr& storage, executor_t& executor, const api::stream_ptr_t& upstream,
+                             const std::string& collection, const std::string& key):
+    m_storage(storage),
+    m_executor(executor),
+    m_upstream(upstream),
+    m_collection(collection),
+    m_key(key),
+    m_offset(0),
+    m_throttled(false),
+    m_scheduled(false),
+    m_done(false)
+{ }
+
+void
+read_stream_t::start() {
+    m_upstream->watch(pressure_action_t { shared_from_this() });
+
+    if(!schedule()) {
+        m_upstream->error(invocation_error, "storage is overloaded");
+        m_upstream->close();
+    }
+}
+
+// NOTE: Called with the upstream lock held, so the upstream can't be touched here.
+void
+read_stream_t::on_pressure(bool throttled) {
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_throttled = throttled;
+    }
+
+    if(!throttled && !schedule()) {
+        // If the executor is overloaded, it'll be retried on the next pressure change.
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_parked = shared_from_this();
+    }
+}
+
+bool
+read_stream_t::schedule() {
+    const std::shared_ptr<read_stream_t> self = shared_from_this();
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        if(m_scheduled || m_done) {
+            return true;
+        }
+
+        if(m_throttled) {
+            m_parked = self;
+            return true;
+        }
+
+        m_scheduled = true;
+
+        // NOTE: Unparked under the same lock, as the pump might park it again as soon as it's posted.
+        m_parked.reset();
+    }
+
+    if(!m_executor.post(std::bind(&read_stream_t::pump, self))) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_scheduled = false;
+        return false;
+    }
+
+    return true;
+}
+
+void
+read_stream_t::pump() {
+    while(true) {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            if(m_throttled) {
+                m_scheduled = false;
+                m_parked = shared_from_this();
+                return;
+            }
+        }
+
+        if(m_offset == m_blob.size()) {
+            try {
+                if(!m_reader) {
+                    m_reader = m_storage->reader(m_collection, m_key);
+                }
+
+                m_blob = m_reader->next();
+            } catch(const std::exception& e) {
+                fail(e.what());
+                return;
+            }
+
+            m_offset = 0;
+
+            if(m_blob.size() == 0) {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                m_done = true;
+                break;
+            }
+        }
+
+        const size_t size = std::min(chunk_size, m_blob.size() - m_offset);
+
+        m_upstream->write(m_blob.data() + m_offset, size);
+
+        m_offset += size;
+    }
+
+    m_upstream->close();
+
+    // Release the mapping as soon as possible.
+    m_reader.reset();
+}
+
+void
+read_stream_t::fail(const std::string& reason) {
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_done = true;
+    }
+
+    m_upstream->error(invocation_error, reason);
+    m_upstream->close();
+
+    m_reader.reset();
+    m_blob = api::blob_t();
+}
+
 storage_t::storage_t(context_t& context, io::reactor_t& reactor, const std::string& name, const Json::Value& args):
-    category_type(context, reactor, name, args)
+    category_type(context, reactor, name, args),
+    m_backend(api::storage(context, args.get("backend", "core").asString())),
+    m_executor(new executor_t(args.get("threads", 4).asUInt(), args.get("queue-limit", 1024).asUInt())),
+    m_storage(new async_storage_t(m_backend, *m_executor))
 {
-    auto storage = api::storage(context, args.get("backend", "core").asString());
+    on<io::storage::read>(std::bind(&async_storage_t::read, m_storage.get(), _1, _2));
+    on<io::storage::write>(std::bind(&async_storage_t::write, m_storage.get(), _1, _2, _3, _4));
+    on<io::storage::remove>(std::bind(&async_storage_t::remove, m_storage.get(), _1, _2));
+    on<io::storage::find>(std::bind(&async_storage_t::find, m_storage.get(), _1, _2));
+    on<io::storage::read_many>(std::bind(&async_storage_t::read_many, m_storage.get(), _1, _2));
+    on<io::storage::write_many>(std::bind(&async_storage_t::write_many, m_storage.get(), _1, _2, _3));
+    on<io::storage::remove_many>(std::bind(&async_storage_t::remove_many, m_storage.get(), _1, _2));
+
+    on<io::storage::read_stream>(std::make_shared<read_stream_slot_t>(m_backend, std::ref(*m_executor)));
+    on<io::storage::write_stream>(std::make_shared<write_stream_slot_t>(
+        std::ref(context),
+        name,
+        m_backend,
+        std::ref(*m_executor)
+    ));
+}
 
-    on<io::storage::read>(std::bind(&api::storage_t::read, storage, _1, _2));
-    on<io::storage::write>(std::bind(&api::storage_t::write, storage, _1, _2, _3, _4));
-    on<io::storage::remove>(std::bind(&api::storage_t::remove, storage, _1, _2));
-    on<io::storage::find>(std::bind(&api::storage_t::find, storage, _1, _2));
+storage_t::~storage_t() {
+    // Empty.
 }
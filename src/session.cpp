@@ -33,7 +33,7 @@ session_t::session_t(uint64_t id_, const api::event_t& event_, const api::stream
     upstream(upstream_),
     m_state(state::open)
 {
-    m_encoder.reset(new encoder<writable_stream<io::socket<local>>>());
+    m_encoder.reset(new encoder<sink_t>());
 
     // Cache the invocation command right away.
     send<rpc::invoke>(event.name);
@@ -42,7 +42,12 @@ session_t::session_t(uint64_t id_, const api::event_t& event_, const api::stream
 void
 session_t::attach(const std::shared_ptr<writable_stream<io::socket<local>>>& downstream) {
     // Flush all the cached messages into the downstream.
-    m_encoder->attach(downstream);
+    m_encoder->attach(std::make_shared<sink_t>(downstream));
+}
+
+void
+session_t::attach(const std::shared_ptr<writable_stream<shared_ring>>& downstream) {
+    m_encoder->attach(std::make_shared<sink_t>(downstream));
 }
 
 void
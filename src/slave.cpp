@@ -22,12 +22,15 @@
 
 #include "cocaine/api/event.hpp"
 #include "cocaine/api/stream.hpp"
+#include "cocaine/api/storage.hpp"
 
 #include "cocaine/asio/reactor.hpp"
+#include "cocaine/asio/shared.hpp"
 
 #include "cocaine/context.hpp"
 
 #include "cocaine/detail/engine.hpp"
+#include "cocaine/detail/executor.hpp"
 #include "cocaine/detail/manifest.hpp"
 #include "cocaine/detail/profile.hpp"
 #include "cocaine/detail/session.hpp"
@@ -40,8 +43,6 @@
 #include "cocaine/traits/enum.hpp"
 #include "cocaine/traits/literal.hpp"
 
-#include <sstream>
-
 #include <boost/lexical_cast.hpp>
 
 #include <fcntl.h>
@@ -53,6 +54,16 @@ using namespace cocaine::io;
 
 using namespace std::placeholders;
 
+namespace {
+
+// NOTE: These frames never change, but are sent a lot for every slave of every app, so they are
+// encoded only once. Heartbeats carry no arguments, so they go through the static path instead.
+
+const preencoded<rpc::terminate> shutdown_frame(rpc::terminate::normal, "the engine is shutting down");
+const preencoded<rpc::terminate> idle_frame(rpc::terminate::normal, "slave is idle");
+
+} // namespace
+
 struct slave_t::pipe_t {
     typedef int endpoint_type;
 
@@ -82,6 +93,25 @@ private:
     const endpoint_type m_pipe;
 };
 
+struct slave_t::pressure_action_t {
+    void
+    operator()(bool throttled) const {
+        // NOTE: Upstreams notify from their own threads, so jump over to the slave's reactor.
+        reactor.post(std::bind(&pressure_action_t::apply, slave, throttled));
+    }
+
+    static
+    void
+    apply(const std::weak_ptr<slave_t>& slave, bool throttled) {
+        if(auto ptr = slave.lock()) {
+            ptr->on_pressure(throttled);
+        }
+    }
+
+    const std::weak_ptr<slave_t> slave;
+    reactor_t& reactor;
+};
+
 namespace {
 
 struct ignore {
@@ -109,7 +139,8 @@ slave_t::slave_t(context_t& context, reactor_t& reactor, const manifest_t& manif
 #endif
     m_heartbeat_timer(new ev::timer(reactor.native())),
     m_idle_timer(new ev::timer(reactor.native())),
-    m_output_ring(profile.crashlog_limit)
+    m_output_ring(profile.crashlog_limit, profile.crashlog_size),
+    m_throttled(0)
 {
     reactor.update();
 
@@ -164,6 +195,9 @@ slave_t::~slave_t() {
     // Closes our end of the socket.
     m_channel.reset();
 
+    m_shared_rd.reset();
+    m_shared_wr.reset();
+
     m_handle->terminate();
     m_handle.reset();
 
@@ -187,6 +221,28 @@ slave_t::bind(const std::shared_ptr<channel<io::socket<local>>>& channel_) {
     );
 }
 
+void
+slave_t::bind(const std::shared_ptr<io::shared_segment>& segment) {
+    BOOST_ASSERT(m_channel && !m_shared_rd);
+
+    // NOTE: The socket channel is still used for the control messages, while the sessions are
+    // served over the shared memory rings from now on.
+
+    m_shared_rd.reset(new decoder<readable_stream<shared_ring>>());
+    m_shared_rd->attach(std::make_shared<readable_stream<shared_ring>>(m_reactor, segment->reader()));
+
+    m_shared_rd->bind(
+        std::bind(&slave_t::on_message, this, _1),
+        std::bind(&slave_t::on_failure, this, _1)
+    );
+
+    m_shared_wr = std::make_shared<writable_stream<shared_ring>>(m_reactor, segment->writer());
+
+    m_shared_wr->bind(
+        std::bind(&slave_t::on_failure, this, _1)
+    );
+}
+
 void
 slave_t::assign(const std::shared_ptr<session_t>& session) {
     BOOST_ASSERT(m_state != states::inactive);
@@ -222,7 +278,16 @@ slave_t::assign(const std::shared_ptr<session_t>& session) {
 
     COCAINE_LOG_DEBUG(m_log, "slave %s has started processing session %s", m_id, session->id);
 
-    session->attach(m_channel->wr->stream());
+    session->upstream->watch(pressure_action_t {
+        shared_from_this(),
+        m_reactor
+    });
+
+    if(m_shared_wr) {
+        session->attach(m_shared_wr);
+    } else {
+        session->attach(m_channel->wr->stream());
+    }
 }
 
 void
@@ -231,7 +296,7 @@ slave_t::stop() {
 
     m_state = states::inactive;
 
-    m_channel->wr->write<rpc::terminate>(0UL, rpc::terminate::normal, "the engine is shutting down");
+    m_channel->wr->write(shutdown_frame, 0UL);
 }
 
 void
@@ -460,6 +525,44 @@ slave_t::on_choke(uint64_t session_id) {
     pump();
 }
 
+void
+slave_t::on_pressure(bool throttled) {
+    if(!m_channel) {
+        return;
+    }
+
+    if(throttled) {
+        if(m_throttled++ != 0) {
+            return;
+        }
+
+        COCAINE_LOG_DEBUG(m_log, "slave %s is throttled by a slow client, pausing", m_id);
+
+        // NOTE: The slave will block on its socket, so it won't be able to send heartbeats.
+        m_heartbeat_timer->stop();
+        m_channel->rd->stream()->pause();
+
+        if(m_shared_rd) {
+            m_shared_rd->stream()->pause();
+        }
+    } else {
+        BOOST_ASSERT(m_throttled != 0);
+
+        if(--m_throttled != 0) {
+            return;
+        }
+
+        COCAINE_LOG_DEBUG(m_log, "slave %s is no longer throttled, resuming", m_id);
+
+        m_heartbeat_timer->start(m_profile.heartbeat_timeout);
+        m_channel->rd->stream()->resume();
+
+        if(m_shared_rd) {
+            m_shared_rd->stream()->resume();
+        }
+    }
+}
+
 void
 slave_t::on_timeout(ev::timer&, int) {
     switch(m_state) {
@@ -489,31 +592,19 @@ slave_t::on_idle(ev::timer&, int) {
 
     m_state = states::inactive;
 
-    m_channel->wr->write<rpc::terminate>(0UL, rpc::terminate::normal, "slave is idle");
+    m_channel->wr->write(idle_frame, 0UL);
 }
 
 size_t
 slave_t::on_output(const char* data, size_t size) {
-    std::string input(data, size),
-                line;
-
-    std::istringstream stream(input);
-
-    size_t leftovers = 0;
-
-    while(stream) {
-        if(std::getline(stream, line)) {
-            m_output_ring.push_back(line);
+    return m_output_ring.consume(data, size, std::bind(&slave_t::on_line, this, _1, _2));
+}
 
-            if(m_profile.log_output) {
-                COCAINE_LOG_DEBUG(m_log, "slave %s output: %s", m_id, line);
-            }
-        } else {
-            leftovers = line.size();
-        }
+void
+slave_t::on_line(const char* line, size_t size) {
+    if(m_profile.log_output) {
+        COCAINE_LOG_DEBUG(m_log, "slave %s output: %s", m_id, std::string(line, size));
     }
-
-    return size - leftovers;
 }
 
 void
@@ -545,6 +636,30 @@ slave_t::pump() {
     m_engine.wake();
 }
 
+namespace {
+
+struct dump_action {
+    void
+    operator()() const {
+        try {
+            storage->put("crashlogs", key, lines, tags);
+        } catch(const storage_error_t& e) {
+            COCAINE_LOG_ERROR(log, "slave %s is unable to save the crashlog - %s", id, e.what());
+        }
+    }
+
+    const std::shared_ptr<cocaine::logging::log_t> log;
+    const api::category_traits<api::storage_t>::ptr_type storage;
+
+    const std::string id;
+    const std::string key;
+
+    const std::vector<std::string> lines;
+    const std::vector<std::string> tags;
+};
+
+}
+
 void
 slave_t::dump() {
     if(m_output_ring.empty()) {
@@ -557,15 +672,19 @@ slave_t::dump() {
 
     COCAINE_LOG_INFO(m_log, "slave %s is dumping output to 'crashlogs/%s'", m_id, key);
 
-    std::vector<std::string> dump;
-    std::copy(m_output_ring.begin(), m_output_ring.end(), std::back_inserter(dump));
+    // NOTE: The slave might be gone by the time the crashlog is saved, so the action has its own
+    // copies of everything it needs.
+    const dump_action action = {
+        std::make_shared<cocaine::logging::log_t>(m_context, cocaine::format("app/%s", m_manifest.name)),
+        api::storage(m_context, "core"),
+        m_id,
+        key,
+        m_output_ring.lines(),
+        std::vector<std::string>({ m_manifest.name })
+    };
 
-    try {
-        api::storage(m_context, "core")->put("crashlogs", key, dump, std::vector<std::string> {
-            m_manifest.name
-        });
-    } catch(const storage_error_t& e) {
-        COCAINE_LOG_ERROR(m_log, "slave %s is unable to save the crashlog - %s", m_id, e.what());
+    if(!m_engine.executor().post(action)) {
+        COCAINE_LOG_ERROR(m_log, "slave %s is unable to save the crashlog - too many pending crashlogs", m_id);
     }
 }
 
@@ -0,0 +1,321 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/detail/storages/cache.hpp"
+
+#include "cocaine/context.hpp"
+#include "cocaine/logging.hpp"
+
+using namespace cocaine;
+using namespace cocaine::storage;
+
+namespace {
+
+std::string
+cache_key(const std::string& collection, const std::string& key) {
+    std::string result;
+
+    result.reserve(collection.size() + key.size() + 1);
+
+    // NOTE: Collection names can't contain zeroes, so this is unambiguous.
+    result.append(collection).push_back('\0');
+    result.append(key);
+
+    return result;
+}
+
+}
+
+cache_t::cache_t(context_t& context, const std::string& name, const Json::Value& args):
+    category_type(context, name, args),
+    m_log(new logging::log_t(context, name)),
+    m_limit(args.get("size", 16 * 1024 * 1024).asUInt()),
+    m_size(0),
+    m_generation(0)
+{
+    const std::string backend = args["backend"].asString();
+    const auto it = context.config.storages.find(backend);
+
+    if(it == context.config.storages.end()) {
+        throw storage_error_t("the '%s' storage is not configured", backend);
+    }
+
+    // NOTE: The storage factory is locked while this one is being constructed, so another cache
+    // can't be created from here.
+    if(it->second.type == "cache") {
+        throw storage_error_t("the cached storage can't be a cache itself");
+    }
+
+    m_backend = api::storage(context, backend);
+}
+
+cache_t::~cache_t() {
+    // Empty.
+}
+
+std::string
+cache_t::read(const std::string& collection, const std::string& key) {
+    return view(collection, key).str();
+}
+
+api::blob_t
+cache_t::view(const std::string& collection, const std::string& key) {
+    const std::string id = cache_key(collection, key);
+
+    uint64_t generation;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        auto it = m_index.find(id);
+
+        if(it != m_index.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return it->second->second;
+        }
+
+        generation = m_generation;
+    }
+
+    // NOTE: The backend is accessed without the lock, so that cache hits aren't blocked by misses.
+    const api::blob_t blob = m_backend->view(collection, key);
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    store(id, blob, generation);
+
+    return blob;
+}
+
+std::map<std::string, std::string>
+cache_t::read_many(const std::string& collection, const std::vector<std::string>& keys) {
+    std::map<std::string, std::string> result;
+    std::vector<std::string> misses;
+
+    uint64_t generation;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        for(auto key = keys.begin(); key != keys.end(); ++key) {
+            auto it = m_index.find(cache_key(collection, *key));
+
+            if(it != m_index.end()) {
+                m_lru.splice(m_lru.begin(), m_lru, it->second);
+                result[*key] = it->second->second.str();
+            } else {
+                misses.push_back(*key);
+            }
+        }
+
+        generation = m_generation;
+    }
+
+    if(misses.empty()) {
+        return result;
+    }
+
+    const std::map<std::string, std::string> fetched = m_backend->read_many(collection, misses);
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    for(auto it = fetched.begin(); it != fetched.end(); ++it) {
+        store(cache_key(collection, it->first), api::blob_t(std::string(it->second)), generation);
+        result.insert(*it);
+    }
+
+    return result;
+}
+
+void
+cache_t::write(const std::string& collection, const std::string& key, const std::string& blob, const std::vector<std::string>& tags) {
+    // NOTE: The object might have been partially modified even if the backend has failed, so the
+    // cached copy is dropped anyway.
+    try {
+        m_backend->write(collection, key, blob, tags);
+    } catch(...) {
+        invalidate(collection, key);
+        throw;
+    }
+
+    invalidate(collection, key);
+}
+
+void
+cache_t::remove(const std::string& collection, const std::string& key) {
+    try {
+        m_backend->remove(collection, key);
+    } catch(...) {
+        invalidate(collection, key);
+        throw;
+    }
+
+    invalidate(collection, key);
+}
+
+std::vector<std::string>
+cache_t::find(const std::string& collection, const std::vector<std::string>& tags) {
+    return m_backend->find(collection, tags);
+}
+
+void
+cache_t::write_many(const std::string& collection, const std::map<std::string, std::string>& objects, const std::vector<std::string>& tags) {
+    std::vector<std::string> keys;
+
+    for(auto it = objects.begin(); it != objects.end(); ++it) {
+        keys.push_back(it->first);
+    }
+
+    try {
+        m_backend->write_many(collection, objects, tags);
+    } catch(...) {
+        invalidate_many(collection, keys);
+        throw;
+    }
+
+    invalidate_many(collection, keys);
+}
+
+void
+cache_t::remove_many(const std::string& collection, const std::vector<std::string>& keys) {
+    try {
+        m_backend->remove_many(collection, keys);
+    } catch(...) {
+        invalidate_many(collection, keys);
+        throw;
+    }
+
+    invalidate_many(collection, keys);
+}
+
+class cache_t::writer_t:
+    public api::object_writer_t
+{
+    public:
+        writer_t(cache_t& parent, std::unique_ptr<api::object_writer_t>&& backend, const std::string& collection,
+                 const std::string& key):
+            m_parent(parent),
+            m_backend(std::move(backend)),
+            m_collection(collection),
+            m_key(key)
+        { }
+
+        virtual
+        void
+        append(const char* data, size_t size) {
+            m_backend->append(data, size);
+        }
+
+        virtual
+        void
+        commit() {
+            try {
+                m_backend->commit();
+            } catch(...) {
+                m_parent.invalidate(m_collection, m_key);
+                throw;
+            }
+
+            m_parent.invalidate(m_collection, m_key);
+        }
+
+    private:
+        cache_t& m_parent;
+
+        const std::unique_ptr<api::object_writer_t> m_backend;
+
+        const std::string m_collection;
+        const std::string m_key;
+};
+
+std::unique_ptr<api::object_writer_t>
+cache_t::writer(const std::string& collection, const std::string& key, const std::vector<std::string>& tags) {
+    return std::unique_ptr<api::object_writer_t>(
+        new writer_t(*this, m_backend->writer(collection, key, tags), collection, key)
+    );
+}
+
+std::unique_ptr<api::object_reader_t>
+cache_t::reader(const std::string& collection, const std::string& key) {
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        auto it = m_index.find(cache_key(collection, key));
+
+        if(it != m_index.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+
+            return std::unique_ptr<api::object_reader_t>(new api::detail::blob_reader_t(it->second->second));
+        }
+    }
+
+    // NOTE: Streamed objects aren't cached, as they might not fit in memory, which is why they're
+    // streamed in the first place.
+    return m_backend->reader(collection, key);
+}
+
+void
+cache_t::store(const std::string& id, const api::blob_t& blob, uint64_t generation) {
+    const size_t size = id.size() + blob.size();
+
+    if(size > m_limit || generation != m_generation || m_index.count(id)) {
+        return;
+    }
+
+    m_lru.push_front(entry_type(id, blob));
+    m_index[id] = m_lru.begin();
+    m_size += size;
+
+    while(m_size > m_limit) {
+        const entry_type& victim = m_lru.back();
+
+        m_size -= victim.first.size() + victim.second.size();
+        m_index.erase(victim.first);
+        m_lru.pop_back();
+    }
+}
+
+void
+cache_t::invalidate_many(const std::string& collection, const std::vector<std::string>& keys) {
+    for(auto it = keys.begin(); it != keys.end(); ++it) {
+        invalidate(collection, *it);
+    }
+}
+
+void
+cache_t::invalidate(const std::string& collection, const std::string& key) {
+    const std::string id = cache_key(collection, key);
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    ++m_generation;
+
+    auto it = m_index.find(id);
+
+    if(it == m_index.end()) {
+        return;
+    }
+
+    COCAINE_LOG_DEBUG(m_log, "invalidating object '%s', collection: %s", key, collection);
+
+    m_size -= id.size() + it->second->second.size();
+    m_lru.erase(it->second);
+    m_index.erase(it);
+}
@@ -0,0 +1,426 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/detail/storages/dedup.hpp"
+
+#include "cocaine/context.hpp"
+#include "cocaine/logging.hpp"
+
+#include <openssl/sha.h>
+
+using namespace cocaine;
+using namespace cocaine::storage;
+
+namespace {
+
+// Chunks are stored in this collection of the backend, named after their digests.
+const char chunk_collection[] = ".chunks";
+
+// Marks the chunk lists, so that the objects written before the deduplication was enabled could
+// still be read as is.
+const char recipe_magic[] = "cocaine-dedup";
+
+std::string
+digest(const char* data, size_t size) {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+
+    SHA256(reinterpret_cast<const unsigned char*>(data), size, hash);
+
+    static const char hex[] = "0123456789abcdef";
+
+    std::string result;
+
+    result.reserve(SHA256_DIGEST_LENGTH * 2);
+
+    for(size_t i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
+        result.push_back(hex[hash[i] >> 4]);
+        result.push_back(hex[hash[i] & 0x0F]);
+    }
+
+    return result;
+}
+
+// NOTE: Gear rolling hash, every byte shifts the hash and adds a random value for that byte. So the
+// n-th bit of the hash only depends on the last n + 1 bytes, and a chunk boundary is declared wherever
+// the top bits are all zeroes, as the low ones would only reflect the last few bytes. The table is
+// generated with SplitMix64, so that it's the same on every node.
+
+struct gear_table_t {
+    gear_table_t() {
+        uint64_t state = 0;
+
+        for(size_t i = 0; i < 256; ++i) {
+            uint64_t value = (state += 0x9E3779B97F4A7C15ULL);
+
+            value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+
+            values[i] = value ^ (value >> 31);
+        }
+    }
+
+    uint64_t values[256];
+};
+
+const gear_table_t gear;
+
+// Returns the mask of the top bits to be tested for the given average chunk size.
+uint64_t
+boundary_mask(uint64_t chunk_size) {
+    if(chunk_size < 64 || (chunk_size & (chunk_size - 1)) != 0) {
+        throw storage_error_t("the chunk size must be a power of two, not less than 64 bytes");
+    }
+
+    unsigned int bits = 0;
+
+    while((1ULL << bits) < chunk_size) {
+        ++bits;
+    }
+
+    return (chunk_size - 1) << (64 - bits);
+}
+
+// Splits the incoming data into chunks and hands them over to the given sink, keeping only the
+// current incomplete chunk in memory.
+
+template<class Sink>
+struct chunker_t {
+    chunker_t(Sink sink_, size_t min_, size_t max_, uint64_t mask_):
+        sink(sink_),
+        min(min_),
+        max(max_),
+        mask(mask_),
+        hash(0)
+    { }
+
+    void
+    feed(const char* data, size_t size) {
+        for(size_t i = 0; i < size; ++i) {
+            hash = (hash << 1) + gear.values[static_cast<unsigned char>(data[i])];
+
+            buffer.push_back(data[i]);
+
+            if((buffer.size() >= min && (hash & mask) == 0) || buffer.size() >= max) {
+                flush();
+            }
+        }
+    }
+
+    void
+    flush() {
+        if(!buffer.empty()) {
+            sink(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+
+        hash = 0;
+    }
+
+private:
+    Sink sink;
+
+    const size_t min;
+    const size_t max;
+    const uint64_t mask;
+
+    uint64_t hash;
+    std::string buffer;
+};
+
+// Collects the chunk names of an object being written.
+struct recipe_t {
+    recipe_t():
+        size(0)
+    { }
+
+    std::string
+    pack() const {
+        msgpack::sbuffer buffer;
+        msgpack::packer<msgpack::sbuffer> packer(buffer);
+
+        // NOTE: Format is [Magic, Size, [Chunks...]].
+        packer.pack_array(3);
+        packer.pack_raw(sizeof(recipe_magic) - 1);
+        packer.pack_raw_body(recipe_magic, sizeof(recipe_magic) - 1);
+        packer.pack_uint64(size);
+        packer << chunks;
+
+        return std::string(buffer.data(), buffer.size());
+    }
+
+    // Returns false if the object isn't a recipe.
+    bool
+    unpack(const std::string& blob) {
+        msgpack::zone zone;
+        msgpack::object object;
+
+        size_t offset = 0;
+
+        if(msgpack::unpack(blob.data(), blob.size(), &offset, &zone, &object) != msgpack::UNPACK_SUCCESS) {
+            return false;
+        }
+
+        if(object.type != msgpack::type::ARRAY || object.via.array.size != 3) {
+            return false;
+        }
+
+        const msgpack::object* fields = object.via.array.ptr;
+
+        if(fields[0].type != msgpack::type::RAW ||
+           std::string(fields[0].via.raw.ptr, fields[0].via.raw.size) != recipe_magic)
+        {
+            return false;
+        }
+
+        try {
+            fields[1] >> size;
+            fields[2] >> chunks;
+        } catch(const msgpack::type_error& e) {
+            return false;
+        }
+
+        return true;
+    }
+
+    uint64_t size;
+    std::vector<std::string> chunks;
+};
+
+}
+
+class dedup_t::writer_t:
+    public api::object_writer_t
+{
+    public:
+        writer_t(dedup_t& parent, const std::string& collection, const std::string& key,
+                 const std::vector<std::string>& tags):
+            m_parent(parent),
+            m_collection(collection),
+            m_key(key),
+            m_tags(tags),
+            m_chunker(sink_t(this), parent.m_min_chunk, parent.m_max_chunk, parent.m_mask)
+        { }
+
+        virtual
+        void
+        append(const char* data, size_t size) {
+            m_chunker.feed(data, size);
+        }
+
+        virtual
+        void
+        commit() {
+            m_chunker.flush();
+
+            // NOTE: The recipe is written last, so that it never references missing chunks.
+            m_parent.m_backend->write(m_collection, m_key, m_recipe.pack(), m_tags);
+        }
+
+    private:
+        struct sink_t {
+            explicit
+            sink_t(writer_t* self_):
+                self(self_)
+            { }
+
+            void
+            operator()(const char* data, size_t size) const {
+                self->m_recipe.chunks.push_back(self->m_parent.store(data, size));
+                self->m_recipe.size += size;
+            }
+
+            writer_t* self;
+        };
+
+    private:
+        dedup_t& m_parent;
+
+        const std::string m_collection;
+        const std::string m_key;
+        const std::vector<std::string> m_tags;
+
+        recipe_t m_recipe;
+        chunker_t<sink_t> m_chunker;
+};
+
+// NOTE: Fetches the chunks one by one as the object is being read, so that only the current one is
+// held in memory. The chunks are viewed rather than read, so the backends could map them instead.
+
+class dedup_t::reader_t:
+    public api::object_reader_t
+{
+    public:
+        reader_t(dedup_t& parent, const std::string& collection, const std::string& key):
+            m_parent(parent),
+            m_collection(collection),
+            m_key(key),
+            m_next(0),
+            m_size(0)
+        {
+            std::string blob = parent.m_backend->read(collection, key);
+
+            if(!m_recipe.unpack(blob)) {
+                // Written before the deduplication was enabled.
+                m_legacy = api::blob_t(std::move(blob));
+            }
+        }
+
+        virtual
+        api::blob_t
+        next() {
+            if(m_legacy.size() != 0) {
+                api::blob_t result;
+
+                std::swap(result, m_legacy);
+
+                return result;
+            }
+
+            if(m_next == m_recipe.chunks.size()) {
+                if(m_size != m_recipe.size) {
+                    throw storage_error_t("object '%s' in '%s' is corrupted - size mismatch", m_key, m_collection);
+                }
+
+                return api::blob_t();
+            }
+
+            const std::string& name = m_recipe.chunks[m_next++];
+
+            api::blob_t chunk;
+
+            try {
+                chunk = m_parent.m_backend->view(chunk_collection, name);
+            } catch(const storage_error_t& e) {
+                throw storage_error_t("object '%s' in '%s' is corrupted - chunk %s is missing", m_key, m_collection,
+                    name);
+            }
+
+            // NOTE: An empty chunk would be taken for the end of the object.
+            if(chunk.size() == 0 || (m_size += chunk.size()) > m_recipe.size) {
+                throw storage_error_t("object '%s' in '%s' is corrupted - size mismatch", m_key, m_collection);
+            }
+
+            return chunk;
+        }
+
+    private:
+        dedup_t& m_parent;
+
+        const std::string m_collection;
+        const std::string m_key;
+
+        recipe_t m_recipe;
+        api::blob_t m_legacy;
+
+        size_t m_next;
+        uint64_t m_size;
+};
+
+dedup_t::dedup_t(context_t& context, const std::string& name, const Json::Value& args):
+    category_type(context, name, args),
+    m_log(new logging::log_t(context, name)),
+    m_min_chunk(args.get("chunk-size", 64 * 1024).asUInt() / 4),
+    m_max_chunk(args.get("chunk-size", 64 * 1024).asUInt() * 4),
+    m_mask(boundary_mask(args.get("chunk-size", 64 * 1024).asUInt()))
+{
+    const std::string backend = args["backend"].asString();
+    const auto it = context.config.storages.find(backend);
+
+    if(it == context.config.storages.end()) {
+        throw storage_error_t("the '%s' storage is not configured", backend);
+    }
+
+    // NOTE: The storage factory is locked while this one is being constructed, so another one of
+    // the same type can't be created from here.
+    if(it->second.type == "dedup") {
+        throw storage_error_t("the deduplicated storage can't be deduplicated itself");
+    }
+
+    m_backend = api::storage(context, backend);
+}
+
+dedup_t::~dedup_t() {
+    // Empty.
+}
+
+std::string
+dedup_t::read(const std::string& collection, const std::string& key) {
+    reader_t reader(*this, collection, key);
+
+    std::string result;
+
+    for(api::blob_t piece = reader.next(); piece.size(); piece = reader.next()) {
+        result.append(piece.data(), piece.size());
+    }
+
+    return result;
+}
+
+void
+dedup_t::write(const std::string& collection, const std::string& key, const std::string& blob, const std::vector<std::string>& tags) {
+    writer_t writer(*this, collection, key, tags);
+
+    writer.append(blob.data(), blob.size());
+    writer.commit();
+}
+
+void
+dedup_t::remove(const std::string& collection, const std::string& key) {
+    // NOTE: Chunks might be shared with other objects, so they're left in place.
+    m_backend->remove(collection, key);
+}
+
+std::vector<std::string>
+dedup_t::find(const std::string& collection, const std::vector<std::string>& tags) {
+    return m_backend->find(collection, tags);
+}
+
+std::unique_ptr<api::object_writer_t>
+dedup_t::writer(const std::string& collection, const std::string& key, const std::vector<std::string>& tags) {
+    return std::unique_ptr<api::object_writer_t>(new writer_t(*this, collection, key, tags));
+}
+
+std::unique_ptr<api::object_reader_t>
+dedup_t::reader(const std::string& collection, const std::string& key) {
+    return std::unique_ptr<api::object_reader_t>(new reader_t(*this, collection, key));
+}
+
+std::string
+dedup_t::store(const char* data, size_t size) {
+    const std::string name = digest(data, size);
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        if(m_chunks.count(name)) {
+            return name;
+        }
+    }
+
+    COCAINE_LOG_DEBUG(m_log, "storing chunk %s, size: %llu", name, size);
+
+    m_backend->write(chunk_collection, name, std::string(data, size), std::vector<std::string>());
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    m_chunks.insert(name);
+
+    return name;
+}
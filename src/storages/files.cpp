@@ -23,36 +23,264 @@
 #include "cocaine/context.hpp"
 #include "cocaine/logging.hpp"
 
-#include <numeric>
+#include "cocaine/detail/unique_id.hpp"
+
+#include <functional>
+#include <system_error>
 
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/convenience.hpp>
 
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 using namespace cocaine::storage;
 
 namespace fs = boost::filesystem;
 
+namespace {
+
+void
+make_directory(const fs::path& path) {
+    try {
+        fs::create_directories(path);
+    } catch(const fs::filesystem_error& e) {
+        // Might have been created concurrently.
+        if(!fs::is_directory(path)) {
+            throw;
+        }
+    }
+}
+
+}
+
+// NOTE: Group commit. Instead of syncing every object on its own, the writers wait for a sync of the
+// whole filesystem. The first writer to arrive waits for a short window, so that the others could
+// join it, and then a single syncfs() makes the data of all of them durable at once.
+
+class files_t::sync_group_t {
+    COCAINE_DECLARE_NONCOPYABLE(sync_group_t)
+
+    public:
+        sync_group_t(const fs::path& path, float window):
+            m_fd(::open(path.string().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)),
+            m_window(window * 1000000),
+            m_requested(0),
+            m_completed(0),
+            m_failed(0),
+            m_syncing(false)
+        {
+            if(m_fd == -1) {
+                throw std::system_error(errno, std::system_category(), "unable to open the storage");
+            }
+        }
+
+       ~sync_group_t() {
+            ::close(m_fd);
+        }
+
+        // Returns once everything written before the call is on the disk.
+        void
+        sync() {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            const uint64_t ticket = ++m_requested;
+
+            while(true) {
+                // NOTE: A failed sync might have dropped the dirty pages, so the next successful one
+                // can't vouch for them.
+                if(ticket <= m_failed) {
+                    throw std::system_error(m_error, "unable to sync the storage");
+                }
+
+                if(ticket <= m_completed) {
+                    return;
+                }
+
+                if(m_syncing) {
+                    m_condition.wait(lock);
+                    continue;
+                }
+
+                m_syncing = true;
+
+                lock.unlock();
+
+                if(m_window) {
+                    ::usleep(m_window);
+                }
+
+                lock.lock();
+
+                // Every writer which has arrived by now is covered by this sync.
+                const uint64_t target = m_requested;
+
+                lock.unlock();
+
+#if defined(SYS_syncfs)
+                const int rv = ::syscall(SYS_syncfs, m_fd);
+                const int error = errno;
+#else
+                ::sync();
+                const int rv = 0, error = 0;
+#endif
+
+                lock.lock();
+
+                if(rv != 0) {
+                    m_error = std::error_code(error, std::system_category());
+                    m_failed = target;
+                } else {
+                    m_completed = target;
+                }
+
+                m_syncing = false;
+
+                m_condition.notify_all();
+            }
+        }
+
+    private:
+        const int m_fd;
+        const useconds_t m_window;
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+
+        // Writer tickets, the last issued one and the last ones known to be synced or failed.
+        uint64_t m_requested;
+        uint64_t m_completed;
+        uint64_t m_failed;
+
+        std::error_code m_error;
+
+        bool m_syncing;
+};
+
 files_t::files_t(context_t& context, const std::string& name, const Json::Value& args):
     category_type(context, name, args),
     m_log(new logging::log_t(context, name)),
     m_storage_path(args["path"].asString())
-{ }
+{
+    if(!args.get("durable", false).asBool()) {
+        return;
+    }
+
+    try {
+        make_directory(m_storage_path);
+        m_sync.reset(new sync_group_t(m_storage_path, args.get("sync-window", 0.005).asDouble()));
+    } catch(const std::exception& e) {
+        throw storage_error_t("unable to initialize the storage - %s", e.what());
+    }
+}
 
 files_t::~files_t() {
     // Empty.
 }
 
-std::string
-files_t::read(const std::string& collection, const std::string& key) {
-    std::lock_guard<std::mutex> guard(m_mutex);
+std::mutex&
+files_t::stripe(const std::string& collection, const std::string& key) {
+    const size_t hash = std::hash<std::string>()(collection) * 31 + std::hash<std::string>()(key);
 
-    const fs::path file_path(m_storage_path / collection / key);
+    return m_stripes[hash % (sizeof(m_stripes) / sizeof(m_stripes[0]))];
+}
+
+namespace {
+
+// Objects larger than this are mapped into memory instead of being read.
+const size_t mmap_threshold = 64 * 1024;
+
+// Maximum number of files kept open at once by read_many().
+const size_t batch_size = 64;
+
+struct file_t {
+    COCAINE_DECLARE_NONCOPYABLE(file_t)
+
+    explicit
+    file_t(const fs::path& path):
+        fd(::open(path.string().c_str(), O_RDONLY | O_CLOEXEC))
+    { }
+
+    file_t(const file_t& directory, const std::string& name):
+        fd(::openat(directory.fd, name.c_str(), O_RDONLY | O_CLOEXEC))
+    { }
+
+   ~file_t() {
+        if(fd != -1) ::close(fd);
+    }
+
+    size_t
+    size() const {
+        struct stat info;
+
+        if(::fstat(fd, &info) != 0) {
+            throw std::system_error(errno, std::system_category(), "unable to stat the object");
+        }
+
+        return info.st_size;
+    }
+
+    // Reads the whole file in one go into a presized buffer.
+    std::string
+    read() const {
+        std::string result(size(), '\0');
+
+        size_t offset = 0;
+
+        while(offset < result.size()) {
+            const ssize_t length = ::pread(fd, &result[offset], result.size() - offset, offset);
+
+            if(length == -1 && errno == EINTR) {
+                continue;
+            }
+
+            if(length == -1) {
+                throw std::system_error(errno, std::system_category(), "unable to read the object");
+            }
 
-    if(!fs::exists(file_path)) {
-        throw storage_error_t("object '%s' has not been found in '%s'", key, collection);
+            if(length == 0) {
+                // The file has been truncated in the meantime.
+                result.resize(offset);
+                break;
+            }
+
+            offset += length;
+        }
+
+        return result;
     }
 
+    const int fd;
+};
+
+struct mapping_t {
+    COCAINE_DECLARE_NONCOPYABLE(mapping_t)
+
+    mapping_t(void* base_, size_t size_):
+        base(base_),
+        size(size_)
+    { }
+
+   ~mapping_t() {
+        ::munmap(base, size);
+    }
+
+    void* const base;
+    const size_t size;
+};
+
+}
+
+std::string
+files_t::read(const std::string& collection, const std::string& key) {
+    const fs::path file_path(m_storage_path / collection / key);
+
     COCAINE_LOG_DEBUG(
         m_log,
         "reading object '%s', collection: %s, path: %s",
@@ -61,22 +289,125 @@ files_t::read(const std::string& collection, const std::string& key) {
         file_path
     );
 
-    fs::ifstream stream(file_path, fs::ifstream::in | fs::ifstream::binary);
+    file_t file(file_path);
+
+    if(file.fd == -1) {
+        if(errno == ENOENT) {
+            throw storage_not_found_t("object '%s' has not been found in '%s'", key, collection);
+        }
 
-    if(!stream) {
         throw storage_error_t("unable to access object '%s' in '%s'", key, collection);
     }
 
-    return std::string(
-        std::istreambuf_iterator<char>(stream),
-        std::istreambuf_iterator<char>()
-    );
+    try {
+        return file.read();
+    } catch(const std::system_error& e) {
+        throw storage_error_t("unable to read object '%s' from '%s' - %s", key, collection, e.code().message());
+    }
 }
 
-void
-files_t::write(const std::string& collection, const std::string& key, const std::string& blob, const std::vector<std::string>& tags) {
-    std::lock_guard<std::mutex> guard(m_mutex);
+std::map<std::string, std::string>
+files_t::read_many(const std::string& collection, const std::vector<std::string>& keys) {
+    std::map<std::string, std::string> result;
+
+    COCAINE_LOG_DEBUG(m_log, "reading %llu objects, collection: %s", keys.size(), collection);
+
+    // NOTE: The collection directory is resolved once, and the objects are opened relative to it.
+    const file_t directory(m_storage_path / collection);
+
+    if(directory.fd == -1) {
+        if(errno == ENOENT) {
+            return result;
+        }
+
+        throw storage_error_t("unable to access collection '%s'", collection);
+    }
+
+    for(size_t offset = 0; offset < keys.size(); offset += batch_size) {
+        const size_t count = std::min(batch_size, keys.size() - offset);
+
+        std::vector<std::unique_ptr<file_t>> files;
+
+        // Open the whole batch and tell the kernel that the objects will be needed soon, so that
+        // it could read them from the disk in parallel, while they're consumed one by one below.
+        for(size_t i = offset; i < offset + count; ++i) {
+            files.emplace_back(new file_t(directory, keys[i]));
+
+            if(files.back()->fd == -1) {
+                if(errno != ENOENT) {
+                    throw storage_error_t("unable to access object '%s' in '%s'", keys[i], collection);
+                }
+
+                continue;
+            }
+
+            ::posix_fadvise(files.back()->fd, 0, 0, POSIX_FADV_WILLNEED);
+        }
+
+        for(size_t i = 0; i < count; ++i) {
+            if(files[i]->fd == -1) {
+                continue;
+            }
+
+            try {
+                result[keys[offset + i]] = files[i]->read();
+            } catch(const std::system_error& e) {
+                throw storage_error_t("unable to read object '%s' from '%s' - %s", keys[offset + i], collection,
+                    e.code().message());
+            }
+        }
+    }
+
+    return result;
+}
+
+cocaine::api::blob_t
+files_t::view(const std::string& collection, const std::string& key) {
+    const fs::path file_path(m_storage_path / collection / key);
+
+    COCAINE_LOG_DEBUG(
+        m_log,
+        "mapping object '%s', collection: %s, path: %s",
+        key,
+        collection,
+        file_path
+    );
+
+    file_t file(file_path);
+
+    if(file.fd == -1) {
+        if(errno == ENOENT) {
+            throw storage_not_found_t("object '%s' has not been found in '%s'", key, collection);
+        }
+
+        throw storage_error_t("unable to access object '%s' in '%s'", key, collection);
+    }
+
+    try {
+        const size_t size = file.size();
+
+        if(size < mmap_threshold) {
+            return cocaine::api::blob_t(file.read());
+        }
+
+        // NOTE: The objects are never modified in place, but replaced with rename(), so the mapping
+        // stays intact even if the object is overwritten or removed while it's still being used.
+        void* base = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+
+        if(base == MAP_FAILED) {
+            throw std::system_error(errno, std::system_category(), "unable to map the object");
+        }
+
+        ::madvise(base, size, MADV_SEQUENTIAL);
 
+        return cocaine::api::blob_t(static_cast<const char*>(base), size, std::make_shared<mapping_t>(base, size));
+    } catch(const std::system_error& e) {
+        throw storage_error_t("unable to read object '%s' from '%s' - %s", key, collection, e.code().message());
+    }
+}
+
+fs::path
+files_t::prepare(const std::string& collection) {
     const fs::path store_path(m_storage_path / collection);
     const auto store_status = fs::status(store_path);
 
@@ -84,7 +415,7 @@ files_t::write(const std::string& collection, const std::string& key, const std:
         COCAINE_LOG_INFO(m_log, "creating collection: %s, path: %s", collection, store_path);
 
         try {
-            fs::create_directories(store_path);
+            make_directory(store_path);
         } catch(const fs::filesystem_error& e) {
             throw storage_error_t("unable to create collection '%s'", collection);
         }
@@ -92,6 +423,12 @@ files_t::write(const std::string& collection, const std::string& key, const std:
         throw storage_error_t("collection '%s' is corrupted", collection);
     }
 
+    return store_path;
+}
+
+void
+files_t::write(const std::string& collection, const std::string& key, const std::string& blob, const std::vector<std::string>& tags) {
+    const fs::path store_path(prepare(collection));
     const fs::path file_path(store_path / key);
 
     COCAINE_LOG_DEBUG(
@@ -102,19 +439,77 @@ files_t::write(const std::string& collection, const std::string& key, const std:
         file_path
     );
 
-    fs::ofstream stream(file_path, fs::ofstream::out | fs::ofstream::trunc | fs::ofstream::binary);
+    // NOTE: The object is written into a temporary file first, and then atomically moved in place,
+    // so that the readers see either the old or the new object, but never a partial one.
+    const fs::path temp_path(store_path / cocaine::format(".%s.%s", key, unique_id_t().string()));
+
+    fs::ofstream stream(temp_path, fs::ofstream::out | fs::ofstream::trunc | fs::ofstream::binary);
 
     if(!stream) {
         throw storage_error_t("unable to access object '%s' in '%s'", key, collection);
     }
 
+    stream.write(blob.data(), blob.size());
+    stream.close();
+
+    if(!stream) {
+        fs::remove(temp_path);
+        throw storage_error_t("unable to write object '%s' to '%s'", key, collection);
+    }
+
+    publish(collection, key, temp_path, tags);
+}
+
+void
+files_t::publish(const std::string& collection, const std::string& key, const fs::path& temp_path,
+                 const std::vector<std::string>& tags)
+{
+    if(!m_sync) {
+        install(collection, key, temp_path, tags);
+        return;
+    }
+
+    // NOTE: The object must be on the disk before it's renamed, otherwise a crash might leave an
+    // empty or a partial object in place of the old one.
+    try {
+        m_sync->sync();
+    } catch(const std::system_error& e) {
+        fs::remove(temp_path);
+        throw storage_error_t("unable to write object '%s' to '%s' - %s", key, collection, e.code().message());
+    }
+
+    install(collection, key, temp_path, tags);
+
+    try {
+        m_sync->sync();
+    } catch(const std::system_error& e) {
+        throw storage_error_t("unable to write object '%s' to '%s' - %s", key, collection, e.code().message());
+    }
+}
+
+void
+files_t::install(const std::string& collection, const std::string& key, const fs::path& temp_path,
+                 const std::vector<std::string>& tags)
+{
+    const fs::path store_path(m_storage_path / collection);
+    const fs::path file_path(store_path / key);
+
+    std::lock_guard<std::mutex> guard(stripe(collection, key));
+
+    try {
+        fs::rename(temp_path, file_path);
+    } catch(const fs::filesystem_error& e) {
+        fs::remove(temp_path);
+        throw storage_error_t("unable to write object '%s' to '%s'", key, collection);
+    }
+
     for(auto it = tags.begin(); it != tags.end(); ++it) {
         const auto tag_path = store_path / *it;
         const auto tag_status = fs::status(tag_path);
 
         if(!fs::exists(tag_status)) {
             try {
-                fs::create_directory(tag_path);
+                make_directory(tag_path);
             } catch(const fs::filesystem_error& e) {
                 throw storage_error_t("unable to create tag '%s'", *it);
             }
@@ -133,13 +528,104 @@ files_t::write(const std::string& collection, const std::string& key, const std:
         }
     }
 
-    stream.write(blob.c_str(), blob.size());
-    stream.close();
+    std::lock_guard<std::mutex> index_guard(m_index_mutex);
+
+    auto index = m_indices.find(collection);
+
+    if(index == m_indices.end()) {
+        // Not loaded yet, it'll pick up the new tags from disk later.
+        return;
+    }
+
+    for(auto it = tags.begin(); it != tags.end(); ++it) {
+        std::vector<std::string>& keys = index->second[*it];
+
+        auto position = std::lower_bound(keys.begin(), keys.end(), key);
+
+        if(position == keys.end() || *position != key) {
+            keys.insert(position, key);
+        }
+    }
+}
+
+class files_t::writer_t:
+    public api::object_writer_t
+{
+    public:
+        writer_t(files_t& parent, const std::string& collection, const std::string& key,
+                 const std::vector<std::string>& tags):
+            m_parent(parent),
+            m_collection(collection),
+            m_key(key),
+            m_tags(tags),
+            m_temp_path(parent.prepare(collection) / cocaine::format(".%s.%s", key, unique_id_t().string())),
+            m_stream(m_temp_path, fs::ofstream::out | fs::ofstream::trunc | fs::ofstream::binary),
+            m_committed(false)
+        {
+            if(!m_stream) {
+                throw storage_error_t("unable to access object '%s' in '%s'", key, collection);
+            }
+        }
+
+        virtual
+       ~writer_t() {
+            if(m_committed) {
+                return;
+            }
+
+            m_stream.close();
+
+            try {
+                fs::remove(m_temp_path);
+            } catch(const fs::filesystem_error& e) {
+                // Nothing can be done about it here.
+            }
+        }
+
+        virtual
+        void
+        append(const char* data, size_t size) {
+            if(!m_stream.write(data, size)) {
+                throw storage_error_t("unable to write object '%s' to '%s'", m_key, m_collection);
+            }
+        }
+
+        virtual
+        void
+        commit() {
+            m_stream.close();
+
+            if(!m_stream) {
+                throw storage_error_t("unable to write object '%s' to '%s'", m_key, m_collection);
+            }
+
+            m_parent.publish(m_collection, m_key, m_temp_path, m_tags);
+            m_committed = true;
+        }
+
+    private:
+        files_t& m_parent;
+
+        const std::string m_collection;
+        const std::string m_key;
+        const std::vector<std::string> m_tags;
+
+        const fs::path m_temp_path;
+        fs::ofstream m_stream;
+
+        bool m_committed;
+};
+
+std::unique_ptr<cocaine::api::object_writer_t>
+files_t::writer(const std::string& collection, const std::string& key, const std::vector<std::string>& tags) {
+    COCAINE_LOG_DEBUG(m_log, "streaming object '%s', collection: %s", key, collection);
+
+    return std::unique_ptr<cocaine::api::object_writer_t>(new writer_t(*this, collection, key, tags));
 }
 
 void
 files_t::remove(const std::string& collection, const std::string& key) {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    std::lock_guard<std::mutex> guard(stripe(collection, key));
 
     const auto store_path(m_storage_path / collection);
     const auto file_path(store_path / key);
@@ -159,20 +645,121 @@ files_t::remove(const std::string& collection, const std::string& key) {
             throw storage_error_t("unable to remove object '%s' from '%s'", key, collection);
         }
     }
+
+    std::lock_guard<std::mutex> index_guard(m_index_mutex);
+
+    auto index = m_indices.find(collection);
+
+    if(index == m_indices.end()) {
+        // The dangling tag symlinks will be purged once the index is loaded.
+        return;
+    }
+
+    for(auto it = index->second.begin(); it != index->second.end();) {
+        auto position = std::lower_bound(it->second.begin(), it->second.end(), key);
+
+        if(position == it->second.end() || *position != key) {
+            ++it;
+            continue;
+        }
+
+        it->second.erase(position);
+
+        try {
+            fs::remove(store_path / it->first / key);
+        } catch(const fs::filesystem_error& e) {
+            COCAINE_LOG_WARNING(m_log, "unable to remove tag '%s' of object '%s' in '%s'", it->first, key, collection);
+        }
+
+        if(it->second.empty()) {
+            index->second.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+auto
+files_t::index(const std::string& collection, std::vector<fs::path>& dangling) -> tag_index_t& {
+    auto it = m_indices.find(collection);
+
+    if(it != m_indices.end()) {
+        return it->second;
+    }
+
+    const fs::path store_path(m_storage_path / collection);
+
+    COCAINE_LOG_DEBUG(m_log, "loading the tag index, collection: %s, path: %s", collection, store_path);
+
+    tag_index_t result;
+
+    if(fs::exists(store_path)) {
+        for(fs::directory_iterator tag(store_path), end; tag != end; ++tag) {
+            if(!fs::is_directory(tag->status())) {
+                continue;
+            }
+
+#if BOOST_VERSION >= 104600
+            std::vector<std::string>& keys = result[tag->path().filename().string()];
+#else
+            std::vector<std::string>& keys = result[tag->path().filename()];
+#endif
+
+            for(fs::directory_iterator object(*tag); object != end; ++object) {
+                if(!fs::exists(*object)) {
+                    dangling.push_back(object->path());
+                    continue;
+                }
+
+#if BOOST_VERSION >= 104600
+                keys.push_back(object->path().filename().string());
+#else
+                keys.push_back(object->path().filename());
+#endif
+            }
+
+            std::sort(keys.begin(), keys.end());
+        }
+    }
+
+    it = m_indices.insert(std::make_pair(collection, tag_index_t())).first;
+    it->second.swap(result);
+
+    return it->second;
 }
 
 namespace {
 
-struct intersect {
-    template<class T>
-    T
-    operator()(const T& accumulator, T& keys) const {
-        T result;
+// Past this size ratio, galloping through the larger set is cheaper than a linear merge.
+const size_t gallop_ratio = 16;
 
-        std::sort(keys.begin(), keys.end());
-        std::set_intersection(accumulator.begin(), accumulator.end(), keys.begin(), keys.end(), std::back_inserter(result));
+// Intersects a small sorted range with a much larger one, by probing the latter with exponentially
+// growing steps and then binary searching within the last step.
+void
+gallop(const std::vector<std::string>& small, const std::vector<std::string>& large, std::vector<std::string>& result) {
+    auto lower = large.begin();
 
-        return result;
+    for(auto it = small.begin(); it != small.end() && lower != large.end(); ++it) {
+        ptrdiff_t step = 1;
+
+        while(large.end() - lower > step && *(lower + step) < *it) {
+            lower += step;
+            step *= 2;
+        }
+
+        lower = std::lower_bound(lower, large.end() - lower > step ? lower + step + 1 : large.end(), *it);
+
+        if(lower != large.end() && *lower == *it) {
+            result.push_back(*it);
+            ++lower;
+        }
+    }
+}
+
+struct smaller_t {
+    bool
+    operator()(const std::vector<std::string>* lhs, const std::vector<std::string>* rhs) const {
+        return lhs->size() < rhs->size();
     }
 };
 
@@ -180,57 +767,75 @@ struct intersect {
 
 std::vector<std::string>
 files_t::find(const std::string& collection, const std::vector<std::string>& tags) {
-    std::lock_guard<std::mutex> guard(m_mutex);
-
-    const fs::path store_path(m_storage_path / collection);
-
-    if(!fs::exists(store_path) || tags.empty()) {
+    if(tags.empty()) {
         return std::vector<std::string>();
     }
 
-    std::vector<std::vector<std::string>> result;
+    std::vector<std::string> result;
+    std::vector<fs::path> dangling;
 
-    for(auto tag = tags.begin(); tag != tags.end(); ++tag) {
-        auto tagged = result.insert(result.end(), std::vector<std::string>());
+    {
+        std::lock_guard<std::mutex> guard(m_index_mutex);
 
-        if(!fs::exists(store_path / *tag)) {
-            // If one of the tags doesn't exist, the intersection is evidently empty.
-            return std::vector<std::string>();
-        }
+        const tag_index_t& tagged = index(collection, dangling);
 
-        fs::directory_iterator it(store_path / *tag), end;
+        std::vector<const std::vector<std::string>*> sets;
 
-        while(it != end) {
-#if BOOST_VERSION >= 104600
-            const std::string object = it->path().filename().string();
-#else
-            const std::string object = it->path().filename();
-#endif
+        for(auto tag = tags.begin(); tag != tags.end(); ++tag) {
+            auto it = tagged.find(*tag);
 
-            if(!fs::exists(*it)) {
-                COCAINE_LOG_DEBUG(m_log, "purging object '%s' from tag '%s'", object, *tag);
+            if(it == tagged.end() || it->second.empty()) {
+                // If one of the tags doesn't exist, the intersection is evidently empty.
+                sets.clear();
+                break;
+            }
 
-                // Remove the symlink if the object was removed.
-                fs::remove(*it++);
+            sets.push_back(&it->second);
+        }
 
-                continue;
-            }
+        if(!sets.empty()) {
+            // NOTE: Start with the smallest set, so that the intermediate results stay small.
+            std::sort(sets.begin(), sets.end(), smaller_t());
 
-            tagged->push_back(object);
+            result = *sets.front();
 
-            ++it;
+            for(auto it = sets.begin() + 1; it != sets.end() && !result.empty(); ++it) {
+                std::vector<std::string> intersection;
+
+                if((*it)->size() / result.size() >= gallop_ratio) {
+                    gallop(result, **it, intersection);
+                } else {
+                    std::set_intersection(result.begin(), result.end(), (*it)->begin(), (*it)->end(),
+                        std::back_inserter(intersection));
+                }
+
+                result.swap(intersection);
+            }
         }
     }
 
-    std::vector<std::string> initial = std::move(result.back());
+    // Dangling symlinks are left behind by the objects removed before the index was loaded.
+    for(auto it = dangling.begin(); it != dangling.end(); ++it) {
+#if BOOST_VERSION >= 104600
+        const std::string object = it->filename().string();
+#else
+        const std::string object = it->filename();
+#endif
 
-    // NOTE: Pop the initial accumulator value from the result queue, so that it
-    // won't be intersected with itself later.
-    result.pop_back();
+        std::lock_guard<std::mutex> guard(stripe(collection, object));
 
-    // NOTE: Sort the initial accumulator value here once, because it will always
-    // be kept sorted inside the functor by std::set_intersection().
-    std::sort(initial.begin(), initial.end());
+        // NOTE: Check again under the lock, as the object might have been written again in the
+        // meantime, and then its tag must be kept.
+        if(!fs::exists(*it)) {
+            COCAINE_LOG_DEBUG(m_log, "purging object '%s' from tag '%s'", object, it->parent_path());
+
+            try {
+                fs::remove(*it);
+            } catch(const fs::filesystem_error& e) {
+                // Will be retried after the restart.
+            }
+        }
+    }
 
-    return std::accumulate(result.begin(), result.end(), initial, intersect());
+    return result;
 }
@@ -0,0 +1,1020 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/detail/storages/journal.hpp"
+
+#include "cocaine/context.hpp"
+#include "cocaine/logging.hpp"
+
+#include "cocaine/detail/unique_id.hpp"
+
+#include <system_error>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace cocaine;
+using namespace cocaine::storage;
+
+namespace fs = boost::filesystem;
+
+// NOTE: Every record is a [Size, Checksum] header of two big-endian 32-bit integers followed by the
+// msgpack-encoded [Type, Collection, Key, [Tags...], Object] payload of the given size. The checksum
+// is used to detect the records torn by a crash at the end of the log.
+
+struct journal_t::segment_t {
+    COCAINE_DECLARE_NONCOPYABLE(segment_t)
+
+    segment_t(uint32_t id_, const fs::path& path_, int fd_):
+        id(id_),
+        path(path_),
+        fd(fd_),
+        size(0),
+        live(0),
+        pinned(false)
+    { }
+
+   ~segment_t() {
+        ::close(fd);
+    }
+
+    const uint32_t id;
+    const fs::path path;
+    const int fd;
+
+    // Total size of the records and the size of the live ones, guarded by the storage lock.
+    uint64_t size;
+    uint64_t live;
+
+    // Set if the compaction of this segment has failed, so that it won't be retried endlessly.
+    bool pinned;
+};
+
+namespace {
+
+// Objects larger than this are mapped into memory by view() instead of being read.
+const size_t mmap_threshold = 64 * 1024;
+
+// Streamed objects are copied into the segments in blocks of this size.
+const size_t copy_block = 64 * 1024;
+
+const size_t header_size = 8;
+
+uint32_t
+checksum(const char* data, size_t size, uint32_t hash = 2166136261U) {
+    for(size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619U;
+    }
+
+    return hash;
+}
+
+struct record_t {
+    unsigned int type;
+
+    std::string collection;
+    std::string key;
+    std::vector<std::string> tags;
+
+    const char* blob;
+    size_t blob_size;
+};
+
+// Parses the record at the given offset and advances it. Returns false if there's no complete and
+// intact record at this offset.
+bool
+parse(const char* data, size_t size, uint64_t& offset, record_t& record) {
+    if(size - offset < header_size) {
+        return false;
+    }
+
+    uint32_t length, sum;
+
+    std::memcpy(&length, data + offset, 4);
+    std::memcpy(&sum, data + offset + 4, 4);
+
+    length = ntohl(length);
+    sum = ntohl(sum);
+
+    const char* payload = data + offset + header_size;
+
+    if(size - offset - header_size < length || checksum(payload, length) != sum) {
+        return false;
+    }
+
+    msgpack::zone zone;
+    msgpack::object object;
+
+    size_t position = 0;
+
+    // NOTE: The object blob is left in place by the unpacker, so it references the segment data.
+    const msgpack::unpack_return rv = msgpack::unpack(payload, length, &position, &zone, &object);
+
+    if(rv != msgpack::UNPACK_SUCCESS || object.type != msgpack::type::ARRAY || object.via.array.size != 5) {
+        return false;
+    }
+
+    const msgpack::object* fields = object.via.array.ptr;
+
+    try {
+        fields[0] >> record.type;
+        fields[1] >> record.collection;
+        fields[2] >> record.key;
+        fields[3] >> record.tags;
+    } catch(const msgpack::type_error& e) {
+        return false;
+    }
+
+    if(fields[4].type != msgpack::type::RAW) {
+        return false;
+    }
+
+    record.blob = fields[4].via.raw.ptr;
+    record.blob_size = fields[4].via.raw.size;
+
+    offset += header_size + length;
+
+    return true;
+}
+
+std::string
+pread_all(int fd, uint64_t offset, size_t size) {
+    std::string result(size, '\0');
+
+    size_t done = 0;
+
+    while(done < size) {
+        const ssize_t length = ::pread(fd, &result[done], size - done, offset + done);
+
+        if(length == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if(length == -1) {
+            throw std::system_error(errno, std::system_category(), "unable to read a segment");
+        }
+
+        if(length == 0) {
+            throw std::system_error(EIO, std::system_category(), "unexpected end of a segment");
+        }
+
+        done += length;
+    }
+
+    return result;
+}
+
+void
+writev_all(int fd, iovec* iov, int count) {
+    while(count) {
+        ssize_t length = ::writev(fd, iov, count);
+
+        if(length == -1 && errno == EINTR) {
+            continue;
+        }
+
+        if(length == -1) {
+            throw std::system_error(errno, std::system_category(), "unable to append to a segment");
+        }
+
+        // Skip the fully written buffers and adjust the partially written one.
+        while(count && static_cast<size_t>(length) >= iov->iov_len) {
+            length -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+
+        if(count) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + length;
+            iov->iov_len -= length;
+        }
+    }
+}
+
+// Encodes the record payload up to the object itself, which follows it.
+void
+encode(msgpack::sbuffer& buffer, unsigned int type, const std::string& collection, const std::string& key,
+       const std::vector<std::string>& tags, size_t size)
+{
+    msgpack::packer<msgpack::sbuffer> packer(buffer);
+
+    packer.pack_array(5);
+    packer.pack_uint32(type);
+    packer << collection;
+    packer << key;
+    packer << tags;
+    packer.pack_raw(size);
+}
+
+struct mapping_t {
+    COCAINE_DECLARE_NONCOPYABLE(mapping_t)
+
+    mapping_t(void* base_, size_t size_):
+        base(base_),
+        size(size_)
+    { }
+
+   ~mapping_t() {
+        ::munmap(base, size);
+    }
+
+    void* const base;
+    const size_t size;
+};
+
+struct smaller_set_t {
+    bool
+    operator()(const std::set<std::string>* lhs, const std::set<std::string>* rhs) const {
+        return lhs->size() < rhs->size();
+    }
+};
+
+// Orders the object locations by their position in the log.
+struct log_order_t {
+    template<class T>
+    bool
+    operator()(const T& lhs, const T& rhs) const {
+        if(lhs.second.segment->id != rhs.second.segment->id) {
+            return lhs.second.segment->id < rhs.second.segment->id;
+        }
+
+        return lhs.second.offset < rhs.second.offset;
+    }
+};
+
+std::string
+segment_name(uint32_t id) {
+    return cocaine::format("segment-%08d.log", id);
+}
+
+}
+
+journal_t::journal_t(context_t& context, const std::string& name, const Json::Value& args):
+    category_type(context, name, args),
+    m_log(new logging::log_t(context, name)),
+    m_storage_path(args["path"].asString()),
+    m_segment_size(args.get("segment-size", 64 * 1024 * 1024).asUInt()),
+    m_compaction_ratio(args.get("compaction-ratio", 0.5).asDouble()),
+    m_stopped(false)
+{
+    try {
+        fs::create_directories(m_storage_path);
+    } catch(const fs::filesystem_error& e) {
+        throw storage_error_t("unable to create the storage directory '%s'", m_storage_path.string());
+    }
+
+    std::set<uint32_t> ids;
+
+    for(fs::directory_iterator it(m_storage_path), end; it != end; ++it) {
+#if BOOST_VERSION >= 104600
+        const std::string filename = it->path().filename().string();
+#else
+        const std::string filename = it->path().filename();
+#endif
+
+        unsigned int id;
+        char tail;
+
+        if(std::sscanf(filename.c_str(), "segment-%u.lo%c", &id, &tail) == 2 && tail == 'g') {
+            ids.insert(id);
+        }
+    }
+
+    for(auto it = ids.begin(); it != ids.end(); ++it) {
+        recover(*it, *it == *ids.rbegin());
+    }
+
+    size_t objects = 0;
+
+    for(auto it = m_collections.begin(); it != m_collections.end(); ++it) {
+        objects += it->second.objects.size();
+    }
+
+    COCAINE_LOG_INFO(m_log, "recovered %llu objects from %llu segments", objects, ids.size());
+
+    // NOTE: An empty last segment is reused, so that the restarts don't leave empty segments behind.
+    if(m_segments.empty() || m_segments.rbegin()->second->size != 0) {
+        roll();
+    }
+
+    m_thread.reset(new std::thread(std::bind(&journal_t::run, this)));
+}
+
+journal_t::~journal_t() {
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stopped = true;
+    }
+
+    m_condition.notify_one();
+
+    m_thread->join();
+}
+
+std::string
+journal_t::read(const std::string& collection, const std::string& key) {
+    const location_t location = locate(collection, key);
+
+    try {
+        return pread_all(location.segment->fd, location.blob_offset, location.blob_size);
+    } catch(const std::system_error& e) {
+        throw storage_error_t("unable to read object '%s' from '%s' - %s", key, collection, e.code().message());
+    }
+}
+
+api::blob_t
+journal_t::view(const std::string& collection, const std::string& key) {
+    const location_t location = locate(collection, key);
+
+    if(location.blob_size < mmap_threshold) {
+        return api::blob_t(read(collection, key));
+    }
+
+    static const uint64_t page = ::sysconf(_SC_PAGESIZE);
+
+    // NOTE: Mappings must start at a page boundary.
+    const uint64_t offset = location.blob_offset - location.blob_offset % page;
+    const size_t size = location.blob_offset - offset + location.blob_size;
+
+    void* base = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, location.segment->fd, offset);
+
+    if(base == MAP_FAILED) {
+        throw storage_error_t("unable to read object '%s' from '%s' - %s", key, collection,
+            std::error_code(errno, std::system_category()).message());
+    }
+
+    ::madvise(base, size, MADV_SEQUENTIAL);
+
+    return api::blob_t(
+        static_cast<const char*>(base) + (location.blob_offset - offset),
+        location.blob_size,
+        std::make_shared<mapping_t>(base, size)
+    );
+}
+
+// NOTE: Streamed objects are spooled into an anonymous file first, as the segments are shared by all
+// the writers, and then copied into the active segment as a single record once committed.
+
+class journal_t::writer_t:
+    public api::object_writer_t
+{
+    public:
+        writer_t(journal_t& parent, const std::string& collection, const std::string& key,
+                 const std::vector<std::string>& tags):
+            m_parent(parent),
+            m_collection(collection),
+            m_key(key),
+            m_tags(tags),
+            m_size(0)
+        {
+            const fs::path path(parent.m_storage_path / cocaine::format(".spool-%s", unique_id_t().string()));
+
+            m_fd = ::open(path.string().c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+
+            if(m_fd == -1) {
+                throw storage_error_t("unable to write object '%s' to '%s' - %s", key, collection,
+                    std::error_code(errno, std::system_category()).message());
+            }
+
+            // The spool is gone along with the descriptor, whatever happens to the writer.
+            ::unlink(path.string().c_str());
+        }
+
+        virtual
+       ~writer_t() {
+            ::close(m_fd);
+        }
+
+        virtual
+        void
+        append(const char* data, size_t size) {
+            iovec iov = { const_cast<char*>(data), size };
+
+            try {
+                writev_all(m_fd, &iov, 1);
+            } catch(const std::system_error& e) {
+                throw storage_error_t("unable to write object '%s' to '%s' - %s", m_key, m_collection,
+                    e.code().message());
+            }
+
+            m_size += size;
+        }
+
+        virtual
+        void
+        commit() {
+            std::lock_guard<std::mutex> guard(m_parent.m_mutex);
+
+            m_parent.apply(put_record, m_collection, m_key, m_parent.append(m_collection, m_key, m_tags, m_fd,
+                m_size));
+
+            if(m_parent.m_segments.rbegin()->second->size >= m_parent.m_segment_size) {
+                m_parent.roll();
+            }
+        }
+
+    private:
+        journal_t& m_parent;
+
+        const std::string m_collection;
+        const std::string m_key;
+        const std::vector<std::string> m_tags;
+
+        int m_fd;
+        uint64_t m_size;
+};
+
+std::unique_ptr<api::object_writer_t>
+journal_t::writer(const std::string& collection, const std::string& key, const std::vector<std::string>& tags) {
+    COCAINE_LOG_DEBUG(m_log, "streaming object '%s', collection: %s", key, collection);
+
+    return std::unique_ptr<api::object_writer_t>(new writer_t(*this, collection, key, tags));
+}
+
+void
+journal_t::write(const std::string& collection, const std::string& key, const std::string& blob, const std::vector<std::string>& tags) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    COCAINE_LOG_DEBUG(m_log, "writing object '%s', collection: %s", key, collection);
+
+    apply(put_record, collection, key, append(put_record, collection, key, tags, blob.data(), blob.size()));
+
+    if(m_segments.rbegin()->second->size >= m_segment_size) {
+        roll();
+    }
+}
+
+void
+journal_t::remove(const std::string& collection, const std::string& key) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto it = m_collections.find(collection);
+
+    if(it == m_collections.end() || !it->second.objects.count(key)) {
+        return;
+    }
+
+    COCAINE_LOG_DEBUG(m_log, "removing object '%s', collection: %s", key, collection);
+
+    apply(remove_record, collection, key, append(remove_record, collection, key, std::vector<std::string>(), nullptr, 0));
+
+    if(m_segments.rbegin()->second->size >= m_segment_size) {
+        roll();
+    }
+}
+
+std::vector<std::string>
+journal_t::find(const std::string& collection, const std::vector<std::string>& tags) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto it = m_collections.find(collection);
+
+    if(it == m_collections.end() || tags.empty()) {
+        return std::vector<std::string>();
+    }
+
+    const auto& index = it->second.tags;
+
+    std::vector<const std::set<std::string>*> sets;
+
+    for(auto tag = tags.begin(); tag != tags.end(); ++tag) {
+        auto tagged = index.find(*tag);
+
+        if(tagged == index.end()) {
+            // If one of the tags doesn't exist, the intersection is evidently empty.
+            return std::vector<std::string>();
+        }
+
+        sets.push_back(&tagged->second);
+    }
+
+    // NOTE: Start with the smallest set, so that the least number of lookups is done.
+    std::sort(sets.begin(), sets.end(), smaller_set_t());
+
+    std::vector<std::string> result;
+
+    for(auto key = sets.front()->begin(); key != sets.front()->end(); ++key) {
+        bool matches = true;
+
+        for(auto set = sets.begin() + 1; set != sets.end() && matches; ++set) {
+            matches = (*set)->count(*key) != 0;
+        }
+
+        if(matches) {
+            result.push_back(*key);
+        }
+    }
+
+    return result;
+}
+
+std::map<std::string, std::string>
+journal_t::read_many(const std::string& collection, const std::vector<std::string>& keys) {
+    std::vector<std::pair<std::string, location_t>> locations;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        auto it = m_collections.find(collection);
+
+        if(it == m_collections.end()) {
+            return std::map<std::string, std::string>();
+        }
+
+        for(auto key = keys.begin(); key != keys.end(); ++key) {
+            auto object = it->second.objects.find(*key);
+
+            if(object != it->second.objects.end()) {
+                locations.push_back(std::make_pair(*key, object->second));
+            }
+        }
+    }
+
+    // NOTE: Read the objects in the log order, so that the disk access is as sequential as possible.
+    std::sort(locations.begin(), locations.end(), log_order_t());
+
+    std::map<std::string, std::string> result;
+
+    for(auto it = locations.begin(); it != locations.end(); ++it) {
+        try {
+            result[it->first] = pread_all(it->second.segment->fd, it->second.blob_offset, it->second.blob_size);
+        } catch(const std::system_error& e) {
+            throw storage_error_t("unable to read object '%s' from '%s' - %s", it->first, collection,
+                e.code().message());
+        }
+    }
+
+    return result;
+}
+
+void
+journal_t::write_many(const std::string& collection, const std::map<std::string, std::string>& objects, const std::vector<std::string>& tags) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    COCAINE_LOG_DEBUG(m_log, "writing %llu objects, collection: %s", objects.size(), collection);
+
+    for(auto it = objects.begin(); it != objects.end(); ++it) {
+        apply(put_record, collection, it->first, append(put_record, collection, it->first, tags, it->second.data(),
+            it->second.size()));
+
+        if(m_segments.rbegin()->second->size >= m_segment_size) {
+            roll();
+        }
+    }
+}
+
+void
+journal_t::remove_many(const std::string& collection, const std::vector<std::string>& keys) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto it = m_collections.find(collection);
+
+    if(it == m_collections.end()) {
+        return;
+    }
+
+    for(auto key = keys.begin(); key != keys.end(); ++key) {
+        if(!it->second.objects.count(*key)) {
+            continue;
+        }
+
+        apply(remove_record, collection, *key, append(remove_record, collection, *key, std::vector<std::string>(),
+            nullptr, 0));
+
+        if(m_segments.rbegin()->second->size >= m_segment_size) {
+            roll();
+        }
+    }
+}
+
+auto
+journal_t::locate(const std::string& collection, const std::string& key) -> location_t {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto it = m_collections.find(collection);
+
+    if(it != m_collections.end()) {
+        auto object = it->second.objects.find(key);
+
+        if(object != it->second.objects.end()) {
+            return object->second;
+        }
+    }
+
+    throw storage_not_found_t("object '%s' has not been found in '%s'", key, collection);
+}
+
+auto
+journal_t::append(record_types type, const std::string& collection, const std::string& key,
+                  const std::vector<std::string>& tags, const char* blob, size_t size) -> location_t
+{
+    const std::shared_ptr<segment_t>& segment = m_segments.rbegin()->second;
+
+    msgpack::sbuffer buffer;
+
+    encode(buffer, type, collection, key, tags, size);
+
+    const uint64_t length = buffer.size() + size;
+
+    if(length > std::numeric_limits<uint32_t>::max()) {
+        throw storage_error_t("object '%s' is too large", key);
+    }
+
+    uint32_t header[2] = {
+        htonl(static_cast<uint32_t>(length)),
+        htonl(checksum(blob, size, checksum(buffer.data(), buffer.size())))
+    };
+
+    iovec iov[3] = {
+        { header, header_size },
+        { buffer.data(), buffer.size() },
+        { const_cast<char*>(blob), size }
+    };
+
+    try {
+        writev_all(segment->fd, iov, size ? 3 : 2);
+    } catch(const std::system_error& e) {
+        // Cut off the partially written record, so that the next one isn't appended after garbage.
+        if(::ftruncate(segment->fd, segment->size) != 0 || ::lseek(segment->fd, segment->size, SEEK_SET) == -1) {
+            COCAINE_LOG_ERROR(m_log, "unable to rollback segment %d", segment->id);
+        }
+
+        throw storage_error_t("unable to write object '%s' to '%s' - %s", key, collection, e.code().message());
+    }
+
+    location_t location = {
+        segment,
+        segment->size,
+        header_size + length,
+        segment->size + header_size + buffer.size(),
+        size,
+        tags
+    };
+
+    segment->size += header_size + length;
+
+    return location;
+}
+
+auto
+journal_t::append(const std::string& collection, const std::string& key, const std::vector<std::string>& tags,
+                  int fd, uint64_t size) -> location_t
+{
+    const std::shared_ptr<segment_t>& segment = m_segments.rbegin()->second;
+
+    msgpack::sbuffer buffer;
+
+    encode(buffer, put_record, collection, key, tags, size);
+
+    const uint64_t length = buffer.size() + size;
+
+    if(length > std::numeric_limits<uint32_t>::max()) {
+        throw storage_error_t("object '%s' is too large", key);
+    }
+
+    try {
+        // NOTE: The checksum precedes the object, so it takes a separate pass over the file.
+        uint32_t sum = checksum(buffer.data(), buffer.size());
+
+        for(uint64_t offset = 0; offset < size; offset += copy_block) {
+            const std::string block = pread_all(fd, offset, std::min<uint64_t>(copy_block, size - offset));
+
+            sum = checksum(block.data(), block.size(), sum);
+        }
+
+        uint32_t header[2] = {
+            htonl(static_cast<uint32_t>(length)),
+            htonl(sum)
+        };
+
+        iovec iov[2] = {
+            { header, header_size },
+            { buffer.data(), buffer.size() }
+        };
+
+        writev_all(segment->fd, iov, 2);
+
+        for(uint64_t offset = 0; offset < size; offset += copy_block) {
+            std::string block = pread_all(fd, offset, std::min<uint64_t>(copy_block, size - offset));
+
+            iovec chunk = { &block[0], block.size() };
+
+            writev_all(segment->fd, &chunk, 1);
+        }
+    } catch(const std::system_error& e) {
+        if(::ftruncate(segment->fd, segment->size) != 0 || ::lseek(segment->fd, segment->size, SEEK_SET) == -1) {
+            COCAINE_LOG_ERROR(m_log, "unable to rollback segment %d", segment->id);
+        }
+
+        throw storage_error_t("unable to write object '%s' to '%s' - %s", key, collection, e.code().message());
+    }
+
+    location_t location = {
+        segment,
+        segment->size,
+        header_size + length,
+        segment->size + header_size + buffer.size(),
+        size,
+        tags
+    };
+
+    segment->size += header_size + length;
+
+    return location;
+}
+
+void
+journal_t::apply(record_types type, const std::string& collection, const std::string& key,
+                 const location_t& location)
+{
+    collection_t& target = m_collections[collection];
+
+    auto it = target.objects.find(key);
+
+    if(it != target.objects.end()) {
+        // The previous version of the object is now dead.
+        it->second.segment->live -= it->second.size;
+
+        for(auto tag = it->second.tags.begin(); tag != it->second.tags.end(); ++tag) {
+            auto tagged = target.tags.find(*tag);
+
+            tagged->second.erase(key);
+
+            if(tagged->second.empty()) {
+                target.tags.erase(tagged);
+            }
+        }
+
+        target.objects.erase(it);
+    }
+
+    if(type != put_record) {
+        return;
+    }
+
+    location.segment->live += location.size;
+
+    target.history[key].insert(location.segment->id);
+
+    for(auto tag = location.tags.begin(); tag != location.tags.end(); ++tag) {
+        target.tags[*tag].insert(key);
+    }
+
+    target.objects.insert(std::make_pair(key, location));
+}
+
+void
+journal_t::recover(uint32_t id, bool last) {
+    const fs::path path(m_storage_path / segment_name(id));
+
+    const int fd = ::open(path.string().c_str(), O_RDWR | O_CLOEXEC);
+
+    if(fd == -1) {
+        throw std::system_error(errno, std::system_category(), cocaine::format("unable to open '%s'", path.string()));
+    }
+
+    auto segment = std::make_shared<segment_t>(id, path, fd);
+
+    struct stat info;
+
+    if(::fstat(fd, &info) != 0) {
+        throw std::system_error(errno, std::system_category(), cocaine::format("unable to stat '%s'", path.string()));
+    }
+
+    const std::string data = pread_all(fd, 0, info.st_size);
+
+    m_segments[id] = segment;
+
+    uint64_t offset = 0;
+    record_t record;
+
+    while(offset < data.size()) {
+        const uint64_t start = offset;
+
+        if(!parse(data.data(), data.size(), offset, record)) {
+            break;
+        }
+
+        const location_t location = {
+            segment,
+            start,
+            offset - start,
+            static_cast<uint64_t>(record.blob - data.data()),
+            record.blob_size,
+            record.tags
+        };
+
+        segment->size = offset;
+
+        apply(static_cast<record_types>(record.type), record.collection, record.key, location);
+    }
+
+    if(offset == data.size()) {
+        return;
+    }
+
+    if(last) {
+        // NOTE: A torn record at the end of the log means that the node has crashed while writing it,
+        // so it's safe to discard it.
+        COCAINE_LOG_WARNING(m_log, "discarding %llu trailing bytes of segment %d", data.size() - offset, id);
+
+        if(::ftruncate(fd, offset) != 0) {
+            throw std::system_error(errno, std::system_category(), cocaine::format("unable to truncate '%s'", path.string()));
+        }
+    } else {
+        COCAINE_LOG_ERROR(m_log, "segment %d is corrupted at offset %llu, the rest of it is ignored", id, offset);
+
+        // NOTE: Don't compact it, so that the corrupted data could still be salvaged manually.
+        segment->pinned = true;
+    }
+}
+
+void
+journal_t::roll() {
+    const uint32_t id = m_segments.empty() ? 1 : m_segments.rbegin()->first + 1;
+    const fs::path path(m_storage_path / segment_name(id));
+
+    const int fd = ::open(path.string().c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if(fd == -1) {
+        throw storage_error_t("unable to create segment '%s' - %s", path.string(),
+            std::error_code(errno, std::system_category()).message());
+    }
+
+    COCAINE_LOG_DEBUG(m_log, "starting segment %d", id);
+
+    m_segments[id] = std::make_shared<segment_t>(id, path, fd);
+
+    // The sealed segment might be worth compacting now.
+    m_condition.notify_one();
+}
+
+void
+journal_t::run() {
+    while(true) {
+        std::shared_ptr<segment_t> segment;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            while(!m_stopped && !(segment = pick())) {
+                m_condition.wait(lock);
+            }
+
+            if(m_stopped) {
+                return;
+            }
+        }
+
+        try {
+            compact(segment);
+        } catch(const std::exception& e) {
+            COCAINE_LOG_ERROR(m_log, "unable to compact segment %d - %s", segment->id, e.what());
+
+            std::lock_guard<std::mutex> guard(m_mutex);
+            segment->pinned = true;
+        }
+    }
+}
+
+auto
+journal_t::pick() const -> std::shared_ptr<segment_t> {
+    // NOTE: The active segment is never compacted.
+    for(auto it = m_segments.begin(); it != m_segments.end() && it->first != m_segments.rbegin()->first; ++it) {
+        const segment_t& segment = *it->second;
+
+        // Empty segments have nothing to move, but they're still removed this way.
+        if(!segment.pinned && (segment.size == 0 || segment.live < m_compaction_ratio * segment.size)) {
+            return it->second;
+        }
+    }
+
+    return std::shared_ptr<segment_t>();
+}
+
+void
+journal_t::compact(const std::shared_ptr<segment_t>& segment) {
+    // NOTE: Sealed segments are never modified, so they're read without the lock.
+    const std::string data = pread_all(segment->fd, 0, segment->size);
+
+    uint64_t offset = 0;
+    record_t record;
+
+    size_t moved = 0;
+
+    // The objects which won't have any put records in this segment once it's gone.
+    std::vector<std::pair<std::string, std::string>> puts;
+
+    while(offset < data.size()) {
+        const uint64_t start = offset;
+
+        if(!parse(data.data(), data.size(), offset, record)) {
+            throw cocaine::error_t("segment is corrupted at offset %llu", start);
+        }
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        auto it = m_collections.find(record.collection);
+
+        const location_t* current = nullptr;
+
+        if(it != m_collections.end()) {
+            auto object = it->second.objects.find(record.key);
+
+            if(object != it->second.objects.end()) {
+                current = &object->second;
+            }
+        }
+
+        if(record.type == put_record) {
+            puts.push_back(std::make_pair(record.collection, record.key));
+
+            // Only the latest versions of the objects are moved, the rest are dead.
+            if(!current || current->segment != segment || current->offset != start) {
+                continue;
+            }
+        } else {
+            // NOTE: Tombstones are only needed while the older segments still contain the removed objects,
+            // and only if the objects haven't been written again since.
+            bool shadowing = false;
+
+            if(it != m_collections.end()) {
+                auto history = it->second.history.find(record.key);
+
+                shadowing = history != it->second.history.end() && *history->second.begin() < segment->id;
+            }
+
+            if(current || !shadowing) {
+                continue;
+            }
+        }
+
+        apply(
+            static_cast<record_types>(record.type),
+            record.collection,
+            record.key,
+            append(static_cast<record_types>(record.type), record.collection, record.key, record.tags,
+                record.blob, record.blob_size)
+        );
+
+        ++moved;
+
+        if(m_segments.rbegin()->second->size >= m_segment_size) {
+            roll();
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    // NOTE: Make sure that the moved records are persisted before their originals are gone.
+    for(auto it = m_segments.upper_bound(segment->id); it != m_segments.end(); ++it) {
+        ::fdatasync(it->second->fd);
+    }
+
+    m_segments.erase(segment->id);
+
+    for(auto it = puts.begin(); it != puts.end(); ++it) {
+        auto& history = m_collections[it->first].history;
+        auto object = history.find(it->second);
+
+        if(object == history.end()) {
+            continue;
+        }
+
+        object->second.erase(segment->id);
+
+        if(object->second.empty()) {
+            history.erase(object);
+        }
+    }
+
+    // NOTE: The readers which are still holding the segment can keep using it, as it's not closed
+    // until the last reference to it is gone.
+    ::unlink(segment->path.string().c_str());
+
+    COCAINE_LOG_INFO(m_log, "compacted segment %d, moved %llu records, reclaimed %llu bytes", segment->id, moved,
+        segment->size - segment->live);
+}
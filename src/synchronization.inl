@@ -18,6 +18,36 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+
+namespace {
+
+// NOTE: The streaming slots below keep the upstreams until the locator shuts down, so the ones whose
+// clients have disconnected are dropped on the next update.
+
+struct closed_upstream_t {
+    bool
+    operator()(const api::stream_ptr_t& upstream) const {
+        return upstream->closed();
+    }
+
+    template<class T>
+    bool
+    operator()(const T& subscription) const {
+        return subscription.upstream->closed();
+    }
+};
+
+template<class Container>
+void
+prune(Container& upstreams) {
+    upstreams.erase(
+        std::remove_if(upstreams.begin(), upstreams.end(), closed_upstream_t()),
+        upstreams.end()
+    );
+}
+
+} // namespace
+
 struct locator_t::synchronize_slot_t:
     public io::basic_slot<io::locator::synchronize>
 {
@@ -28,13 +58,13 @@ struct locator_t::synchronize_slot_t:
     operator()(const msgpack::object& unpacked, const api::stream_ptr_t& upstream);
 
     void
-    announce();
+    announce(const synchronize_result_type& dump);
 
     void
     shutdown();
 
 private:
-    bool
+    void
     dump(const api::stream_ptr_t& upstream);
 
 private:
@@ -43,6 +73,9 @@ private:
 
     locator_t& self;
 
+    // Announces come from the service threads.
+    std::mutex mutex;
+
     std::vector<api::stream_ptr_t> upstreams;
 };
 
@@ -53,6 +86,8 @@ locator_t::synchronize_slot_t::synchronize_slot_t(locator_t& self_):
 
 std::shared_ptr<dispatch_t>
 locator_t::synchronize_slot_t::operator()(const msgpack::object& unpacked, const api::stream_ptr_t& upstream) {
+    std::lock_guard<std::mutex> guard(mutex);
+
     io::detail::invoke<io::event_traits<io::locator::synchronize>::tuple_type>::apply(
         std::bind(&synchronize_slot_t::dump, this, upstream),
         unpacked
@@ -66,18 +101,29 @@ locator_t::synchronize_slot_t::operator()(const msgpack::object& unpacked, const
 }
 
 void
-locator_t::synchronize_slot_t::announce() {
-    auto disconnected = std::partition(
-        upstreams.begin(),
-        upstreams.end(),
-        std::bind(&synchronize_slot_t::dump, this, _1)
-    );
+locator_t::synchronize_slot_t::announce(const synchronize_result_type& dump) {
+    std::lock_guard<std::mutex> guard(mutex);
+
+    prune(upstreams);
+
+    if(upstreams.empty()) {
+        return;
+    }
+
+    // NOTE: The dump is the same for every upstream, so it's encoded only once.
+    buffer.clear();
 
-    upstreams.erase(disconnected, upstreams.end());
+    io::type_traits<synchronize_result_type>::pack(packer, dump);
+
+    for(auto it = upstreams.begin(); it != upstreams.end(); ++it) {
+        (*it)->write(buffer.data(), buffer.size());
+    }
 }
 
 void
 locator_t::synchronize_slot_t::shutdown() {
+    std::lock_guard<std::mutex> guard(mutex);
+
     std::for_each(
         upstreams.begin(),
         upstreams.end(),
@@ -87,7 +133,7 @@ locator_t::synchronize_slot_t::shutdown() {
     upstreams.clear();
 }
 
-bool
+void
 locator_t::synchronize_slot_t::dump(const api::stream_ptr_t& upstream) {
     buffer.clear();
 
@@ -97,6 +143,328 @@ locator_t::synchronize_slot_t::dump(const api::stream_ptr_t& upstream) {
     );
 
     upstream->write(buffer.data(), buffer.size());
+}
+
+// NOTE: Incremental synchronization between the locators. Each peer gets a full dump first, and then
+// only the sequence-numbered differences between the consecutive dumps, encoded once per announce.
+
+struct locator_t::delta_slot_t:
+    public io::basic_slot<io::locator::synchronize_delta>
+{
+    delta_slot_t(locator_t& self);
+
+    virtual
+    std::shared_ptr<dispatch_t>
+    operator()(const msgpack::object& unpacked, const api::stream_ptr_t& upstream);
+
+    void
+    announce(const synchronize_result_type& dump);
+
+    // Sends the loads which have changed since the last report.
+    void
+    report(const load_map_t& current);
+
+    void
+    shutdown();
+
+private:
+    void
+    dump(const api::stream_ptr_t& upstream);
+
+    void
+    send(const synchronize_result_type& added, const std::vector<std::string>& removed,
+         const load_map_t& changed);
+
+private:
+    msgpack::sbuffer buffer;
+    msgpack::packer<msgpack::sbuffer> packer;
+
+    // Announces come from the service threads.
+    std::mutex mutex;
+
+    uint64_t sequence;
+
+    // Last announced dump and loads.
+    synchronize_result_type snapshot;
+    load_map_t loads;
+
+    // Encoded full dump of the snapshot for the new peers, rebuilt on demand.
+    std::string encoded;
+
+    std::vector<api::stream_ptr_t> upstreams;
+};
+
+locator_t::delta_slot_t::delta_slot_t(locator_t& self):
+    packer(buffer),
+    sequence(0),
+    snapshot(self.dump())
+{ }
+
+std::shared_ptr<dispatch_t>
+locator_t::delta_slot_t::operator()(const msgpack::object& unpacked, const api::stream_ptr_t& upstream) {
+    std::lock_guard<std::mutex> guard(mutex);
+
+    io::detail::invoke<io::event_traits<io::locator::synchronize_delta>::tuple_type>::apply(
+        std::bind(&delta_slot_t::dump, this, upstream),
+        unpacked
+    );
+
+    // Save this upstream for the future notifications.
+    upstreams.push_back(upstream);
+
+    // Return an empty protocol dispatch.
+    return std::shared_ptr<dispatch_t>();
+}
+
+void
+locator_t::delta_slot_t::announce(const synchronize_result_type& dump) {
+    std::lock_guard<std::mutex> guard(mutex);
+
+    synchronize_result_type added;
+    std::vector<std::string> removed;
+
+    // Both maps are sorted by the service name, so the difference is found in a single pass.
+    auto lhs = snapshot.begin();
+    auto rhs = dump.begin();
+
+    while(lhs != snapshot.end() || rhs != dump.end()) {
+        if(rhs == dump.end() || (lhs != snapshot.end() && lhs->first < rhs->first)) {
+            removed.push_back(lhs->first);
+            ++lhs;
+        } else if(lhs == snapshot.end() || rhs->first < lhs->first) {
+            added.insert(*rhs);
+            ++rhs;
+        } else {
+            // NOTE: Services might be restarted between the announces, so the metadata is compared
+            // as well, and the changed ones are sent over again.
+            if(!(lhs->second == rhs->second)) {
+                added.insert(*rhs);
+            }
+
+            ++lhs;
+            ++rhs;
+        }
+    }
+
+    if(added.empty() && removed.empty()) {
+        return;
+    }
+
+    snapshot = dump;
+
+    send(added, removed, load_map_t());
+}
+
+void
+locator_t::delta_slot_t::report(const load_map_t& current) {
+    std::lock_guard<std::mutex> guard(mutex);
+
+    load_map_t changed;
+
+    for(auto it = current.begin(); it != current.end(); ++it) {
+        auto previous = loads.find(it->first);
+
+        if(previous == loads.end() || previous->second != it->second) {
+            changed.insert(*it);
+        }
+    }
+
+    loads = current;
+
+    if(changed.empty()) {
+        return;
+    }
+
+    send(synchronize_result_type(), std::vector<std::string>(), changed);
+}
+
+void
+locator_t::delta_slot_t::shutdown() {
+    std::lock_guard<std::mutex> guard(mutex);
+
+    std::for_each(
+        upstreams.begin(),
+        upstreams.end(),
+        std::bind(&api::stream_t::close, _1)
+    );
+
+    upstreams.clear();
+}
+
+void
+locator_t::delta_slot_t::dump(const api::stream_ptr_t& upstream) {
+    if(encoded.empty()) {
+        buffer.clear();
+
+        io::type_traits<synchronize_delta_result_type>::pack(
+            packer,
+            synchronize_delta_result_type(sequence, snapshot, std::vector<std::string>(), loads)
+        );
+
+        encoded.assign(buffer.data(), buffer.size());
+    }
+
+    upstream->write(encoded.data(), encoded.size());
+}
+
+void
+locator_t::delta_slot_t::send(const synchronize_result_type& added, const std::vector<std::string>& removed,
+                              const load_map_t& changed)
+{
+    encoded.clear();
+
+    ++sequence;
+
+    prune(upstreams);
+
+    if(upstreams.empty()) {
+        return;
+    }
+
+    // NOTE: The update is the same for every upstream, so it's encoded only once.
+    buffer.clear();
+
+    io::type_traits<synchronize_delta_result_type>::pack(
+        packer,
+        synchronize_delta_result_type(sequence, added, removed, changed)
+    );
+
+    for(auto it = upstreams.begin(); it != upstreams.end(); ++it) {
+        (*it)->write(buffer.data(), buffer.size());
+    }
+}
+
+// NOTE: Pushes the resolve results to the subscribed clients whenever the routing table changes, so
+// that they don't have to poll the locator to keep their caches fresh. Only the actual changes are
+// pushed, detected by comparing the encoded results, or the group states for the routing groups.
+
+struct locator_t::subscribe_slot_t:
+    public io::basic_slot<io::locator::subscribe>
+{
+    subscribe_slot_t(locator_t& self);
+
+    virtual
+    std::shared_ptr<dispatch_t>
+    operator()(const msgpack::object& unpacked, const api::stream_ptr_t& upstream);
+
+    void
+    notify();
+
+    void
+    shutdown();
+
+private:
+    struct subscription_t {
+        std::string name;
+        api::stream_ptr_t upstream;
+
+        // Encoded result or group state the client has last been notified with.
+        std::string state;
+    };
+
+    void
+    subscribe(const api::stream_ptr_t& upstream, const std::string& name);
+
+    void
+    update(subscription_t& subscription);
+
+private:
+    msgpack::sbuffer buffer;
+    msgpack::packer<msgpack::sbuffer> packer;
+
+    locator_t& self;
+
+    std::vector<subscription_t> subscriptions;
+};
+
+locator_t::subscribe_slot_t::subscribe_slot_t(locator_t& self_):
+    packer(buffer),
+    self(self_)
+{ }
+
+std::shared_ptr<dispatch_t>
+locator_t::subscribe_slot_t::operator()(const msgpack::object& unpacked, const api::stream_ptr_t& upstream) {
+    io::detail::invoke<io::event_traits<io::locator::subscribe>::tuple_type>::apply(
+        std::bind(&subscribe_slot_t::subscribe, this, upstream, _1),
+        unpacked
+    );
+
+    // Return an empty protocol dispatch.
+    return std::shared_ptr<dispatch_t>();
+}
+
+void
+locator_t::subscribe_slot_t::notify() {
+    prune(subscriptions);
+
+    std::for_each(
+        subscriptions.begin(),
+        subscriptions.end(),
+        std::bind(&subscribe_slot_t::update, this, _1)
+    );
+}
+
+void
+locator_t::subscribe_slot_t::shutdown() {
+    for(auto it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+        it->upstream->close();
+    }
+
+    subscriptions.clear();
+}
+
+void
+locator_t::subscribe_slot_t::subscribe(const api::stream_ptr_t& upstream, const std::string& name) {
+    // NOTE: Routing updates might be rare, so the disconnected clients are also dropped here, so that
+    // the reconnecting clients don't pile up.
+    prune(subscriptions);
+
+    subscriptions.push_back(subscription_t {
+        name,
+        upstream,
+        std::string()
+    });
+
+    // Send the current state right away.
+    update(subscriptions.back());
+}
+
+void
+locator_t::subscribe_slot_t::update(subscription_t& subscription) {
+    // NOTE: The generation is taken before resolving, see locator_t::resolve_if_changed().
+    const uint64_t generation = self.m_router->generation(subscription.name);
+
+    boost::optional<resolve_result_type> info;
+
+    try {
+        info = self.resolve(subscription.name, std::string());
+    } catch(const std::exception&) {
+        // The service is not available at the moment.
+    }
+
+    std::string state;
+
+    // NOTE: Groups are resolved randomly, so their results can't be compared, but their state can.
+    if(!self.m_router->group_state(subscription.name, state)) {
+        buffer.clear();
+
+        io::type_traits<boost::optional<resolve_result_type>>::pack(packer, info);
+
+        state.assign(buffer.data(), buffer.size());
+    }
+
+    if(state == subscription.state) {
+        return;
+    }
+
+    subscription.state.swap(state);
+
+    buffer.clear();
+
+    io::type_traits<subscribe_result_type>::pack(
+        packer,
+        subscribe_result_type(generation, info)
+    );
 
-    return true;
+    subscription.upstream->write(buffer.data(), buffer.size());
 }
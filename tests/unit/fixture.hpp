@@ -0,0 +1,86 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COCAINE_UNIT_FIXTURE_HPP
+#define COCAINE_UNIT_FIXTURE_HPP
+
+#include "cocaine/context.hpp"
+
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+namespace cocaine { namespace unit {
+
+// NOTE: A context in a temporary directory, which is removed afterwards. The "core" storage is the
+// files storage in the "core" subdirectory.
+
+struct context_fixture_t {
+    context_fixture_t() {
+        char pattern[] = "/tmp/cocaine-unit-XXXXXX";
+
+        if(::mkdtemp(pattern) == nullptr) {
+            throw std::system_error(errno, std::system_category(), "unable to create a temporary directory");
+        }
+
+        root = pattern;
+
+        boost::filesystem::create_directory(root / "runtime");
+        boost::filesystem::create_directory(root / "core");
+
+        Json::Value config;
+
+        config["version"] = 2;
+
+        config["paths"]["plugins"] = (root / "plugins").string();
+        config["paths"]["runtime"] = (root / "runtime").string();
+
+        // NOTE: Don't clash with the locator of a runtime on this host.
+        config["locator"]["endpoint"] = "127.0.0.1";
+        config["locator"]["port"] = 0;
+
+        config["loggers"]["core"]["type"] = "files";
+        config["loggers"]["core"]["args"]["path"] = (root / "unit.log").string();
+        config["loggers"]["core"]["args"]["verbosity"] = "warning";
+
+        config["storages"]["core"]["type"] = "files";
+        config["storages"]["core"]["args"]["path"] = (root / "core").string();
+
+        {
+            std::ofstream stream((root / "cocaine.conf").string().c_str());
+            stream << Json::StyledWriter().write(config);
+        }
+
+        context.reset(new context_t(config_t((root / "cocaine.conf").string()), "core"));
+    }
+
+   ~context_fixture_t() {
+        context.reset();
+        boost::filesystem::remove_all(root);
+    }
+
+    boost::filesystem::path root;
+
+    std::unique_ptr<context_t> context;
+};
+
+}} // namespace cocaine::unit
+
+#endif
@@ -0,0 +1,200 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "cocaine/detail/storages/journal.hpp"
+
+#include "fixture.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace cocaine;
+using namespace cocaine::storage;
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+// Segments are rolled after every big object, and the long key makes the tombstones big enough to be
+// told apart from the small objects by the segment sizes alone.
+const unsigned int segment_size = 4096;
+
+const std::string big(8192, 'b');
+const std::string key(1024, 'k');
+
+const std::vector<std::string> no_tags;
+
+fs::path
+segment(const fs::path& path, unsigned int id) {
+    return path / cocaine::format("segment-%08d.log", id);
+}
+
+struct journal_fixture_t:
+    public unit::context_fixture_t
+{
+    journal_fixture_t():
+        path(root / "journal")
+    { }
+
+    std::unique_ptr<journal_t>
+    open() {
+        Json::Value args;
+
+        args["path"] = path.string();
+        args["segment-size"] = segment_size;
+
+        return std::unique_ptr<journal_t>(new journal_t(*context, "storage/journal", args));
+    }
+
+    // Waits for the background compaction to remove the given segment.
+    bool
+    compacted(unsigned int id) const {
+        for(int i = 0; i < 1000; ++i) {
+            if(!fs::exists(segment(path, id))) {
+                return true;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        return false;
+    }
+
+    const fs::path path;
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(journal_test, journal_fixture_t)
+
+BOOST_AUTO_TEST_CASE(replays_torn_write) {
+    {
+        auto journal = open();
+
+        journal->write("test", "a", "alpha", no_tags);
+        journal->write("test", "b", "beta", no_tags);
+    }
+
+    const uintmax_t size = fs::file_size(segment(path, 1));
+
+    {
+        // A record header promising more data than there is, as if the node has crashed mid-write.
+        std::ofstream stream(segment(path, 1).string().c_str(), std::ios::binary | std::ios::app);
+        stream.write("\x00\x00\x10\x00garbage", 11);
+    }
+
+    {
+        auto journal = open();
+
+        BOOST_CHECK_EQUAL(journal->read("test", "a"), "alpha");
+        BOOST_CHECK_EQUAL(journal->read("test", "b"), "beta");
+
+        journal->write("test", "c", "gamma", no_tags);
+    }
+
+    // The torn record is cut off, so the next restart sees an intact segment.
+    BOOST_CHECK_EQUAL(fs::file_size(segment(path, 1)), size);
+
+    auto journal = open();
+
+    BOOST_CHECK_EQUAL(journal->read("test", "a"), "alpha");
+    BOOST_CHECK_EQUAL(journal->read("test", "c"), "gamma");
+}
+
+BOOST_AUTO_TEST_CASE(reuses_empty_segment) {
+    for(int i = 0; i < 3; ++i) {
+        open();
+    }
+
+    BOOST_CHECK(fs::exists(segment(path, 1)));
+    BOOST_CHECK(!fs::exists(segment(path, 2)));
+}
+
+BOOST_AUTO_TEST_CASE(removes_empty_segments) {
+    {
+        auto journal = open();
+
+        journal->write("test", "a", big, no_tags);
+    }
+
+    // Left behind by the older versions, which started a new segment on every restart.
+    std::ofstream(segment(path, 3).string().c_str());
+
+    auto journal = open();
+
+    BOOST_CHECK(compacted(2));
+    BOOST_CHECK_EQUAL(journal->read("test", "a"), big);
+}
+
+BOOST_AUTO_TEST_CASE(keeps_shadowing_tombstone) {
+    {
+        auto journal = open();
+
+        // Segment 1 stays mostly live, so it still holds the removed object after the compaction.
+        journal->write("test", key, "dead", no_tags);
+        journal->write("test", "live", big, no_tags);
+
+        // Segment 2 is the tombstone and an object which is overwritten in segment 3 right away.
+        journal->remove("test", key);
+        journal->write("test", "overwritten", big, no_tags);
+        journal->write("test", "overwritten", "small", no_tags);
+
+        BOOST_REQUIRE(compacted(2));
+        BOOST_CHECK(fs::exists(segment(path, 1)));
+
+        // The tombstone has been moved into the active segment.
+        BOOST_CHECK_GT(fs::file_size(segment(path, 3)), key.size());
+    }
+
+    auto journal = open();
+
+    BOOST_CHECK_THROW(journal->read("test", key), storage_not_found_t);
+    BOOST_CHECK_EQUAL(journal->read("test", "live"), big);
+    BOOST_CHECK_EQUAL(journal->read("test", "overwritten"), "small");
+}
+
+BOOST_AUTO_TEST_CASE(drops_tombstone) {
+    {
+        auto journal = open();
+
+        // Segment 1 is the removed object alone, so it's compacted away as soon as it's dead.
+        journal->write("test", key, big, no_tags);
+
+        journal->remove("test", key);
+        journal->write("test", "overwritten", big, no_tags);
+        journal->write("test", "overwritten", "small", no_tags);
+
+        BOOST_REQUIRE(compacted(1));
+        BOOST_REQUIRE(compacted(2));
+
+        // Nothing is left for the tombstone to shadow, so it's not moved.
+        BOOST_CHECK_LT(fs::file_size(segment(path, 3)), key.size());
+    }
+
+    auto journal = open();
+
+    BOOST_CHECK_THROW(journal->read("test", key), storage_not_found_t);
+    BOOST_CHECK_EQUAL(journal->read("test", "overwritten"), "small");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,98 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "cocaine/detail/output.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace cocaine::engine;
+
+namespace {
+
+void
+push(output_ring_t& ring, const std::string& line) {
+    ring.push(line.data(), line.size());
+}
+
+std::vector<std::string>
+expected(const char* const* begin, const char* const* end) {
+    return std::vector<std::string>(begin, end);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(output_ring_test)
+
+BOOST_AUTO_TEST_CASE(keeps_last_lines) {
+    output_ring_t ring(2, 64);
+
+    push(ring, "a");
+    push(ring, "b");
+    push(ring, "c");
+
+    const char* const lines[] = { "b", "c" };
+
+    BOOST_CHECK(ring.lines() == expected(lines, lines + 2));
+}
+
+BOOST_AUTO_TEST_CASE(wraps_around) {
+    output_ring_t ring(100, 10);
+
+    push(ring, "aaaa");
+    push(ring, "bbbb");
+
+    // Doesn't fit at the end, so the arena is restarted from the beginning.
+    push(ring, "cccc");
+    push(ring, "dd");
+
+    const char* const lines[] = { "cccc", "dd" };
+
+    BOOST_CHECK(ring.lines() == expected(lines, lines + 2));
+}
+
+BOOST_AUTO_TEST_CASE(evicts_empty_lines) {
+    output_ring_t ring(100, 10);
+
+    push(ring, "aaaa");
+    push(ring, "");
+    push(ring, "bbbb");
+    push(ring, "cc");
+    push(ring, "dddd");
+    push(ring, "ee");
+
+    // The empty line shares its offset with the line after it, so both are overwritten.
+    const char* const lines[] = { "cc", "dddd", "ee" };
+
+    BOOST_CHECK(ring.lines() == expected(lines, lines + 3));
+}
+
+BOOST_AUTO_TEST_CASE(keeps_empty_lines) {
+    output_ring_t ring(100, 10);
+
+    push(ring, "aa");
+    push(ring, "");
+    push(ring, "");
+    push(ring, "bb");
+
+    const char* const lines[] = { "aa", "", "", "bb" };
+
+    BOOST_CHECK(ring.lines() == expected(lines, lines + 4));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,122 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/detail/routing.hpp"
+
+#include <random>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace cocaine::routing;
+
+namespace {
+
+std::vector<std::string>
+names(size_t count) {
+    std::vector<std::string> result;
+
+    for(size_t i = 0; i < count; ++i) {
+        result.push_back(std::string(1, 'a' + i));
+    }
+
+    return result;
+}
+
+size_t
+index_of(const std::string& name) {
+    return name[0] - 'a';
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(alias_table_test)
+
+BOOST_AUTO_TEST_CASE(empty_group) {
+    const alias_table_t table(names(3), std::vector<unsigned int>({ 0, 0, 0 }));
+
+    BOOST_CHECK(table.empty());
+}
+
+BOOST_AUTO_TEST_CASE(exact_distribution) {
+    const std::vector<unsigned int> weights({ 1, 0, 5, 10, 3, 100, 7, 0, 2, 50 });
+    const alias_table_t table(names(weights.size()), weights);
+
+    uint64_t sum = 0;
+
+    for(auto it = weights.begin(); it != weights.end(); ++it) {
+        sum += *it;
+    }
+
+    std::vector<uint64_t> counts(weights.size(), 0);
+
+    // NOTE: The table is built in exact arithmetic, so enumerating every column and every coin value
+    // gives each service the share proportional to its weight, exactly.
+    for(uint64_t column = 0; column < weights.size(); ++column) {
+        for(uint64_t coin = 0; coin < sum; ++coin) {
+            ++counts[index_of(table.select(column, coin))];
+        }
+    }
+
+    for(size_t i = 0; i < weights.size(); ++i) {
+        BOOST_CHECK_EQUAL(counts[i], weights[i] * weights.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(weighted_selection) {
+    const std::vector<unsigned int> weights({ 1, 0, 5, 10, 3, 100, 7, 0, 2, 50 });
+    const alias_table_t table(names(weights.size()), weights);
+
+    const size_t draws = 1000000;
+
+    std::mt19937_64 generator(42);
+    std::vector<size_t> counts(weights.size(), 0);
+
+    for(size_t i = 0; i < draws; ++i) {
+        const uint64_t column = generator();
+        const uint64_t coin = generator();
+
+        ++counts[index_of(table.select(column, coin))];
+    }
+
+    double sum = 0;
+
+    for(auto it = weights.begin(); it != weights.end(); ++it) {
+        sum += *it;
+    }
+
+    double chi2 = 0;
+
+    for(size_t i = 0; i < weights.size(); ++i) {
+        if(weights[i] == 0) {
+            BOOST_CHECK_EQUAL(counts[i], 0);
+            continue;
+        }
+
+        const double expected = draws * weights[i] / sum;
+
+        chi2 += (counts[i] - expected) * (counts[i] - expected) / expected;
+    }
+
+    // NOTE: Eight services with non-zero weights, so seven degrees of freedom. The critical value for
+    // p = 0.001 is 24.32.
+    BOOST_CHECK_LT(chi2, 24.32);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,118 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cocaine/asio/shared.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <poll.h>
+
+using namespace cocaine::io;
+
+namespace {
+
+// Both sides of a segment in the same process, the peer side working on its own descriptors.
+struct fixture_t {
+    fixture_t():
+        origin(std::make_shared<shared_segment>(64))
+    {
+        int fds[shared_segment::descriptor_count];
+
+        for(size_t i = 0; i < shared_segment::descriptor_count; ++i) {
+            fds[i] = ::dup(origin->fds()[i]);
+        }
+
+        peer = std::make_shared<shared_segment>(fds, 64);
+
+        writer = origin->writer();
+        reader = peer->reader();
+    }
+
+    std::shared_ptr<shared_segment> origin;
+    std::shared_ptr<shared_segment> peer;
+
+    std::shared_ptr<shared_ring> writer;
+    std::shared_ptr<shared_ring> reader;
+};
+
+bool
+pending(int fd) {
+    pollfd target = { fd, POLLIN, 0 };
+    return ::poll(&target, 1, 0) == 1;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(shared_ring_test)
+
+BOOST_FIXTURE_TEST_CASE(round_trip, fixture_t) {
+    std::error_code ec;
+
+    const std::string data(48, 'x');
+    std::vector<char> buffer(64);
+
+    // Wraps around the end of the ring on the second pass.
+    for(int i = 0; i < 2; ++i) {
+        BOOST_REQUIRE_EQUAL(writer->write(data.data(), data.size(), ec), 48);
+        BOOST_CHECK(pending(reader->fd()));
+
+        BOOST_REQUIRE_EQUAL(reader->read(buffer.data(), buffer.size(), ec), 48);
+        BOOST_CHECK(std::string(buffer.data(), 48) == data);
+    }
+
+    BOOST_CHECK_EQUAL(reader->read(buffer.data(), buffer.size(), ec), -1);
+    BOOST_CHECK_EQUAL(errno, EAGAIN);
+}
+
+BOOST_FIXTURE_TEST_CASE(wakes_producer_after_partial_write, fixture_t) {
+    std::error_code ec;
+
+    const std::string data(100, 'x');
+    std::vector<char> buffer(100);
+
+    // Fills the ring up, so the caller has to wait for the rest.
+    BOOST_REQUIRE_EQUAL(writer->write(data.data(), data.size(), ec), 64);
+    BOOST_CHECK(!pending(writer->fd()));
+
+    BOOST_REQUIRE_EQUAL(reader->read(buffer.data(), buffer.size(), ec), 64);
+    BOOST_CHECK(pending(writer->fd()));
+
+    BOOST_CHECK_EQUAL(writer->write(data.data() + 64, 36, ec), 36);
+}
+
+BOOST_FIXTURE_TEST_CASE(wakes_producer_after_full_ring, fixture_t) {
+    std::error_code ec;
+
+    const std::string data(64, 'x');
+    std::vector<char> buffer(64);
+
+    BOOST_REQUIRE_EQUAL(writer->write(data.data(), data.size(), ec), 64);
+
+    BOOST_CHECK_EQUAL(writer->write(data.data(), data.size(), ec), -1);
+    BOOST_CHECK_EQUAL(errno, EAGAIN);
+    BOOST_CHECK(!pending(writer->fd()));
+
+    BOOST_REQUIRE_EQUAL(reader->read(buffer.data(), 16, ec), 16);
+    BOOST_CHECK(pending(writer->fd()));
+
+    BOOST_CHECK_EQUAL(writer->write(data.data(), data.size(), ec), 16);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
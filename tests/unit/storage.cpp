@@ -0,0 +1,181 @@
+/*
+    Copyright (c) 2011-2013 Andrey Sibiryov <me@kobology.ru>
+    Copyright (c) 2011-2013 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "cocaine/detail/executor.hpp"
+#include "cocaine/detail/services/storage.hpp"
+
+#include "fixture.hpp"
+
+#include <chrono>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace cocaine;
+using namespace cocaine::service;
+
+namespace {
+
+// Larger than a few chunks, so that the stream can be throttled in the middle of it.
+const std::string object(300 * 1024, 'x');
+
+// NOTE: Records everything sent to the client, which can throttle the producer after the given number
+// of chunks, or right away, and then be released by hand.
+
+struct client_t:
+    public api::stream_t
+{
+    client_t(size_t limit_):
+        limit(limit_),
+        chunks(0),
+        errors(0),
+        closed(false)
+    { }
+
+    virtual
+    void
+    write(const char* chunk, size_t size) {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        data.append(chunk, size);
+
+        if(++chunks == limit && watcher) {
+            watcher(true);
+        }
+    }
+
+    virtual
+    void
+    error(int, const std::string&) {
+        std::lock_guard<std::mutex> guard(mutex);
+        ++errors;
+    }
+
+    virtual
+    void
+    close() {
+        std::lock_guard<std::mutex> guard(mutex);
+        closed = true;
+    }
+
+    virtual
+    void
+    watch(const pressure_handler_t& handler) {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        watcher = handler;
+
+        if(limit == 0) {
+            watcher(true);
+        }
+    }
+
+    void
+    release() {
+        std::lock_guard<std::mutex> guard(mutex);
+        watcher(false);
+    }
+
+    size_t
+    written() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return chunks;
+    }
+
+    // Waits for the stream to be closed.
+    bool
+    wait() {
+        for(int i = 0; i < 500; ++i) {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+
+                if(closed) {
+                    return true;
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        return false;
+    }
+
+    const size_t limit;
+
+    std::mutex mutex;
+
+    pressure_handler_t watcher;
+
+    std::string data;
+    size_t chunks;
+    size_t errors;
+    bool closed;
+};
+
+struct read_stream_fixture_t:
+    public unit::context_fixture_t
+{
+    read_stream_fixture_t():
+        storage(api::storage(*context, "core")),
+        executor(1, 16)
+    {
+        storage->write("test", "object", object, std::vector<std::string>());
+    }
+
+    void
+    stream(const std::shared_ptr<client_t>& client) {
+        std::make_shared<read_stream_t>(storage, executor, client, "test", "object")->start();
+
+        // Give the stream a chance to get stuck, if it's going to.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        BOOST_CHECK_EQUAL(client->written(), client->limit);
+
+        client->release();
+    }
+
+    api::category_traits<api::storage_t>::ptr_type storage;
+    executor_t executor;
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(read_stream_test, read_stream_fixture_t)
+
+BOOST_AUTO_TEST_CASE(resumes_after_throttling) {
+    auto client = std::make_shared<client_t>(1);
+
+    stream(client);
+
+    BOOST_REQUIRE(client->wait());
+    BOOST_CHECK(client->data == object);
+    BOOST_CHECK_EQUAL(client->errors, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(starts_throttled) {
+    auto client = std::make_shared<client_t>(0);
+
+    stream(client);
+
+    BOOST_REQUIRE(client->wait());
+    BOOST_CHECK(client->data == object);
+    BOOST_CHECK_EQUAL(client->errors, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()